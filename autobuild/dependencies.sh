@@ -6,7 +6,7 @@ makeopts="-j $(grep ^flags /proc/cpuinfo | wc -l)"
 dependencies() {
     apt-get update
 
-    apt-get install -y build-essential git libsnappy-dev libz-dev \
+    apt-get install -y build-essential git libsnappy-dev liblz4-dev libzstd-dev libz-dev \
         libtar-dev libb2-dev autoconf libtool libjansson-dev \
         libhiredis-dev libsqlite3-dev libssl-dev libmbedtls-dev
 }
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <blake2.h>
+#include "libflist.h"
+#include "zero_chunk.h"
+#include "zero_blake2.h"
+
+//
+// chunks hashing benchmark
+//
+// the same set of chunk-sized buffers is hashed one by one with libb2,
+// then by batches of lanes with the multi-lane implementation used when
+// adding files, both outputs are compared
+//
+// usage: bench_blake2 [chunk size in KB] [amount of chunks]
+//
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+int main(int argc, char *argv[]) {
+    size_t length = (argc > 1 ? strtoul(argv[1], NULL, 10) : 512) * 1024;
+    size_t count = (argc > 2 ? strtoul(argv[2], NULL, 10) : 1024);
+    size_t lanes = zero_blake2_lanes();
+    uint8_t **buffers = NULL, **scalar = NULL, **multi = NULL;
+    size_t *lengths = NULL;
+    int value = 1;
+
+    libflist_debug_enable(0);
+
+    if(!(buffers = calloc(count, sizeof(uint8_t *))) || !(lengths = calloc(count, sizeof(size_t))))
+        goto cleanup;
+
+    if(!(scalar = calloc(count, sizeof(uint8_t *))) || !(multi = calloc(count, sizeof(uint8_t *))))
+        goto cleanup;
+
+    srand(42);
+
+    for(size_t i = 0; i < count; i++) {
+        if(!(buffers[i] = malloc(length)))
+            goto cleanup;
+
+        if(!(scalar[i] = malloc(ZEROCHUNK_HASH_LENGTH)) || !(multi[i] = malloc(ZEROCHUNK_HASH_LENGTH)))
+            goto cleanup;
+
+        for(size_t j = 0; j < length; j++)
+            buffers[i][j] = rand();
+
+        lengths[i] = length;
+    }
+
+    printf("[+] hashing %lu chunks of %lu KB (%lu lanes available)\n", count, length / 1024, lanes);
+
+    double start = bench_now();
+
+    for(size_t i = 0; i < count; i++) {
+        if(blake2b(scalar[i], buffers[i], "", ZEROCHUNK_HASH_LENGTH, lengths[i], 0)) {
+            fprintf(stderr, "[-] blake2b failed\n");
+            goto cleanup;
+        }
+    }
+
+    double single = bench_now() - start;
+
+    start = bench_now();
+
+    // same batches as the chunks pipeline
+    for(size_t i = 0; i < count; i += lanes) {
+        size_t batch = (count - i < lanes) ? count - i : lanes;
+
+        if(zero_blake2_multi(multi + i, (const uint8_t **) buffers + i, lengths + i, batch)) {
+            fprintf(stderr, "[-] multi: %s\n", libflist_strerror());
+            goto cleanup;
+        }
+    }
+
+    double lanesec = bench_now() - start;
+
+    for(size_t i = 0; i < count; i++) {
+        if(memcmp(scalar[i], multi[i], ZEROCHUNK_HASH_LENGTH)) {
+            fprintf(stderr, "[-] hash mismatch on chunk %lu\n", i);
+            goto cleanup;
+        }
+    }
+
+    double total = (length * count) / (1024.0 * 1024.0);
+
+    printf("[+] libb2 : %8.1f MB/s\n", total / single);
+    printf("[+] lanes : %8.1f MB/s (x%.2f)\n", total / lanesec, single / lanesec);
+
+    value = 0;
+
+cleanup:
+    for(size_t i = 0; i < count; i++) {
+        if(buffers)
+            free(buffers[i]);
+
+        if(scalar)
+            free(scalar[i]);
+
+        if(multi)
+            free(multi[i]);
+    }
+
+    free(buffers);
+    free(scalar);
+    free(multi);
+    free(lengths);
+
+    return value;
+}
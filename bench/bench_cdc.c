@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libflist.h"
+
+//
+// chunking benchmark
+//
+// a random file is chunked, then the same file with a few bytes inserted
+// at the beginning and in the middle: the amount of chunks of the second
+// file already known from the first one is what's deduplicated
+//
+// usage: bench_cdc [size in MB] [workers]
+//
+typedef struct bench_result_t {
+    size_t chunks;
+    double seconds;
+    inode_chunks_t *list;
+
+} bench_result_t;
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+// write 'length' random bytes, with 'shift' bytes inserted
+// at the beginning and in the middle of the file
+static int bench_generate(char *path, size_t length, size_t shift) {
+    uint8_t block[4096];
+    FILE *fp;
+
+    if(!(fp = fopen(path, "w"))) {
+        perror(path);
+        return 1;
+    }
+
+    srand(42);
+
+    for(size_t i = 0; i < shift; i++)
+        fputc('X', fp);
+
+    for(size_t done = 0; done < length; done += sizeof(block)) {
+        for(size_t i = 0; i < sizeof(block); i++)
+            block[i] = rand();
+
+        if(done == (length / 2) - ((length / 2) % sizeof(block)))
+            for(size_t i = 0; i < shift; i++)
+                fputc('Y', fp);
+
+        fwrite(block, sizeof(block), 1, fp);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int bench_chunks(flist_ctx_t *ctx, char *path, bench_result_t *result) {
+    double start = bench_now();
+
+    if(!(result->list = libflist_chunks_proceed(path, ctx))) {
+        fprintf(stderr, "[-] chunks: %s\n", libflist_strerror());
+        return 1;
+    }
+
+    result->seconds = bench_now() - start;
+    result->chunks = result->list->size;
+
+    return 0;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    return memcmp(a, b, 16);
+}
+
+// amount of chunks of 'target' already found on 'source'
+static size_t bench_shared(inode_chunks_t *source, inode_chunks_t *target) {
+    uint8_t (*ids)[16];
+    size_t shared = 0;
+
+    if(!(ids = malloc(sizeof(*ids) * (source->size + 1))))
+        return 0;
+
+    for(size_t i = 0; i < source->size; i++)
+        memcpy(ids[i], source->list[i].entryid, 16);
+
+    qsort(ids, source->size, sizeof(*ids), bench_compare);
+
+    for(size_t i = 0; i < target->size; i++)
+        if(bsearch(target->list[i].entryid, ids, source->size, sizeof(*ids), bench_compare))
+            shared += 1;
+
+    free(ids);
+
+    return shared;
+}
+
+static void bench_free(inode_chunks_t *chunks) {
+    for(size_t i = 0; i < chunks->size; i++) {
+        free(chunks->list[i].entryid);
+        free(chunks->list[i].decipher);
+    }
+
+    free(chunks->list);
+    free(chunks);
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 256) * 1024 * 1024;
+    size_t workers = (argc > 2 ? strtoul(argv[2], NULL, 10) : 4);
+    char original[] = "/tmp/bench-cdc-XXXXXX";
+    char shifted[] = "/tmp/bench-cdc-XXXXXX";
+    int value = 1;
+
+    flist_chunking_t modes[] = {FLIST_CHUNKING_FIXED, FLIST_CHUNKING_CDC};
+    char *names[] = {"fixed", "cdc"};
+
+    libflist_debug_enable(0);
+
+    close(mkstemp(original));
+    close(mkstemp(shifted));
+
+    printf("[+] generating %lu MB files\n", size / (1024 * 1024));
+
+    if(bench_generate(original, size, 0) || bench_generate(shifted, size, 7))
+        goto cleanup;
+
+    for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        bench_result_t first, second;
+        flist_ctx_t *ctx;
+
+        // no backend: chunks are only hashed and encrypted
+        if(!(ctx = libflist_context_create(NULL, NULL)))
+            goto cleanup;
+
+        libflist_context_set_workers(ctx, workers);
+        libflist_context_set_chunking(ctx, modes[m], 0, 0, 0);
+
+        if(bench_chunks(ctx, original, &first) || bench_chunks(ctx, shifted, &second)) {
+            libflist_context_free(ctx);
+            goto cleanup;
+        }
+
+        size_t shared = bench_shared(first.list, second.list);
+
+        printf("[+] %-5s: %6lu chunks, %8.1f MB/s, shifted: %6lu chunks, %6lu known (%.1f%% deduplicated)\n",
+            names[m], first.chunks, (size / (1024.0 * 1024.0)) / first.seconds,
+            second.chunks, shared, second.chunks ? (100.0 * shared) / second.chunks : 0);
+
+        bench_free(first.list);
+        bench_free(second.list);
+        libflist_context_free(ctx);
+    }
+
+    value = 0;
+
+cleanup:
+    unlink(original);
+    unlink(shifted);
+
+    return value;
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libflist.h"
+
+//
+// database profiles benchmark
+//
+// the same entries are written in a new database with each write
+// profile (default, build, memory), then read back with the read-only
+// profile, close time includes the commit (and the file written back
+// with the memory profile)
+//
+// usage: bench_sqlite [amount of entries] [value size in bytes]
+//
+#define BENCH_KEY_LENGTH  16
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+static void bench_key(uint8_t *key, size_t index) {
+    // spreading keys like hashes, without collision
+    for(size_t i = 0; i < BENCH_KEY_LENGTH; i++)
+        key[i] = (uint8_t) ((index * 2654435761UL) >> ((i % 8) * 8)) ^ (uint8_t) i;
+
+    memcpy(key, &index, sizeof(index));
+}
+
+static int bench_write(flist_db_profile_t profile, char *root, size_t count, uint8_t *payload, size_t length, double *times) {
+    uint8_t key[BENCH_KEY_LENGTH];
+    flist_db_t *db;
+
+    if(!(db = libflist_db_sqlite_init_profile(root, profile)) || !db->open(db)) {
+        fprintf(stderr, "[-] open: %s\n", libflist_strerror());
+        return 1;
+    }
+
+    double start = bench_now();
+
+    for(size_t i = 0; i < count; i++) {
+        bench_key(key, i);
+
+        if(db->set(db, key, sizeof(key), payload, length)) {
+            fprintf(stderr, "[-] set: %s\n", libflist_strerror());
+            db->close(db);
+            return 1;
+        }
+    }
+
+    times[0] = bench_now() - start;
+    start = bench_now();
+
+    if(db->close(db)) {
+        fprintf(stderr, "[-] close: %s\n", libflist_strerror());
+        return 1;
+    }
+
+    times[1] = bench_now() - start;
+
+    return 0;
+}
+
+static int bench_read(char *root, size_t count, size_t length, double *seconds) {
+    uint8_t key[BENCH_KEY_LENGTH];
+    flist_db_t *db;
+    int value = 0;
+
+    if(!(db = libflist_db_sqlite_init_profile(root, FLIST_DB_READONLY)) || !db->open(db)) {
+        fprintf(stderr, "[-] open: %s\n", libflist_strerror());
+        return 1;
+    }
+
+    double start = bench_now();
+
+    for(size_t i = 0; i < count && !value; i++) {
+        value_t *entry;
+
+        bench_key(key, i);
+
+        if(!(entry = db->get(db, key, sizeof(key)))) {
+            fprintf(stderr, "[-] get: %s\n", libflist_strerror());
+            value = 1;
+            break;
+        }
+
+        if(!entry->data || entry->length != length) {
+            fprintf(stderr, "[-] get: entry %lu not found\n", i);
+            value = 1;
+        }
+
+        db->clean(entry);
+    }
+
+    *seconds = bench_now() - start;
+    db->close(db);
+
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 200000);
+    size_t length = (argc > 2 ? strtoul(argv[2], NULL, 10) : 256);
+    uint8_t *payload;
+    int value = 0;
+
+    flist_db_profile_t profiles[] = {FLIST_DB_DEFAULT, FLIST_DB_BUILD, FLIST_DB_MEMORY};
+    char *names[] = {"default", "build", "memory"};
+
+    libflist_debug_enable(0);
+
+    if(!(payload = malloc(length)))
+        return 1;
+
+    srand(42);
+
+    for(size_t i = 0; i < length; i++)
+        payload[i] = rand();
+
+    printf("[+] writing %lu entries of %lu bytes\n", count, length);
+
+    for(size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]) && !value; p++) {
+        char root[] = "/tmp/bench-sqlite-XXXXXX";
+        char *filename;
+        double times[2], reading;
+
+        if(!mkdtemp(root)) {
+            perror(root);
+            value = 1;
+            break;
+        }
+
+        if(asprintf(&filename, "%s/flistdb.sqlite3", root) < 0) {
+            value = 1;
+            break;
+        }
+
+        if(!(value = bench_write(profiles[p], root, count, payload, length, times)))
+            value = bench_read(root, count, length, &reading);
+
+        if(!value)
+            printf("[+] %-7s: %10.0f inserts/s, close %6.3f s, %10.0f lookups/s\n",
+                names[p], count / times[0], times[1], count / reading);
+
+        unlink(filename);
+        rmdir(root);
+        free(filename);
+    }
+
+    free(payload);
+
+    return value;
+}
@@ -0,0 +1,113 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "libflist.h"
+#include "xxtea.h"
+
+//
+// chunks encryption benchmark
+//
+// the same chunks are encrypted then decrypted with the copying
+// functions (three allocations and two copies of the chunk per call,
+// twice the chunk size allocated at peak) then in place on a single
+// buffer, like the chunks pipeline does, both outputs are compared
+//
+// usage: bench_xxtea [chunk size in KB] [amount of chunks]
+//
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+int main(int argc, char *argv[]) {
+    size_t length = (argc > 1 ? strtoul(argv[1], NULL, 10) : 512) * 1024;
+    size_t count = (argc > 2 ? strtoul(argv[2], NULL, 10) : 256);
+    size_t capacity = xxtea_encrypt_length(length);
+    uint8_t key[16];
+    uint8_t *source = NULL, *inplace = NULL;
+    double copying = 0, direct = 0;
+    int value = 1;
+
+    libflist_debug_enable(0);
+
+    if(!(source = malloc(length)) || !(inplace = malloc(capacity)))
+        goto cleanup;
+
+    srand(42);
+
+    for(size_t i = 0; i < length; i++)
+        source[i] = rand();
+
+    printf("[+] encrypting %lu chunks of %lu KB\n", count, length / 1024);
+
+    for(size_t i = 0; i < count; i++) {
+        size_t encrypted, decrypted;
+        uint8_t *sealed, *plain;
+
+        // one different key per chunk, like hashes of chunks
+        for(size_t j = 0; j < sizeof(key); j++)
+            key[j] = rand();
+
+        double start = bench_now();
+
+        if(!(sealed = xxtea_encrypt_bkey(source, length, key, sizeof(key), &encrypted)))
+            goto cleanup;
+
+        if(!(plain = xxtea_decrypt_bkey(sealed, encrypted, key, sizeof(key), &decrypted))) {
+            free(sealed);
+            goto cleanup;
+        }
+
+        copying += bench_now() - start;
+
+        // same input, encrypted into a buffer already allocated
+        memcpy(inplace, source, length);
+        start = bench_now();
+
+        size_t inlength;
+
+        if(xxtea_encrypt_inplace(inplace, length, capacity, key, sizeof(key), &inlength)) {
+            free(sealed);
+            free(plain);
+            goto cleanup;
+        }
+
+        int mismatch = (inlength != encrypted || memcmp(inplace, sealed, encrypted));
+
+        if(xxtea_decrypt_inplace(inplace, inlength, key, sizeof(key), &inlength))
+            mismatch = 1;
+
+        direct += bench_now() - start;
+
+        if(inlength != decrypted || memcmp(inplace, plain, decrypted) || memcmp(plain, source, length))
+            mismatch = 1;
+
+        free(sealed);
+        free(plain);
+
+        if(mismatch) {
+            fprintf(stderr, "[-] output mismatch on chunk %lu\n", i);
+            goto cleanup;
+        }
+    }
+
+    double total = (length * count) / (1024.0 * 1024.0);
+
+    // encryption and decryption, both counted, each copying
+    // call allocates two buffers of (about) the chunk size
+    printf("[+] copying : %8.1f MB/s, %lu KB allocated per chunk\n", (2 * total) / copying, (4 * capacity) / 1024);
+    printf("[+] in place: %8.1f MB/s, no allocation\n", (2 * total) / direct);
+
+    value = 0;
+
+cleanup:
+    free(source);
+    free(inplace);
+
+    return value;
+}
@@ -9,123 +9,472 @@
 #include <fcntl.h>
 #include <libtar.h>
 #include <zlib.h>
-#include <libgen.h>
+#include <zstd.h>
+#include <stdint.h>
 #include "libflist.h"
 #include "verbose.h"
+#include "archive_blocks.h"
 
 //
-// uncompress gzip archive to the temporary directory
+// streaming extraction
 //
-static char *archive_prepare(char *filename, char *target) {
-    char *destination;
-    char buffer[4096];
-    ssize_t len;
-    FILE *dst;
-    gzFile gsrc;
-
-    if(!(gsrc = gzopen(filename, "r")))
-        return libflist_errp(filename);
+// the archive is uncompressed and untarred in a single pass, directly
+// from the source file descriptor, nothing is written but the members
+//
+// libtar reads headers through a custom tar type, which reads from the
+// input stream of the current thread, members contents are copied by
+// this code using large buffers (libtar extracts by 512 bytes blocks)
+//
+// the compression (gzip or zstd) is detected from the first bytes of
+// the archive, a stream which can't be peeked (pipe) is gzip
+//
+// only directories and regular files are extracted (that's what an
+// flist contains), members needs a relative path without any '..'
+// component, anything else makes the extraction fail
+//
+#define ARCHIVE_BUFFER_SIZE  (1024 * 1024)
 
-    if(asprintf(&destination, "%s/%s.tar.gz", target, basename(filename)) < 0)
-        return libflist_errp("asprintf");
+typedef struct archive_input_t {
+    flist_archive_format_t format;
+    int fd;
 
-    if(!(dst = fopen(destination, "w")))
-        return libflist_errp(destination);
+    gzFile gzip;            // gzip stream
 
-    while((len = gzread(gsrc, buffer, sizeof(buffer))))
-        fwrite(buffer, 1, len, dst);
+    ZSTD_DCtx *dctx;        // zstd stream
+    uint8_t *buffer;        // compressed data read
+    ZSTD_inBuffer input;
+    int eof;
 
-    fclose(dst);
-    gzclose(gsrc);
+} archive_input_t;
 
-    return destination;
+static __thread archive_input_t *archive_stream = NULL;
+
+static void archive_input_free(archive_input_t *input) {
+    if(input->gzip)
+        gzclose(input->gzip);
+    else
+        close(input->fd);
+
+    ZSTD_freeDCtx(input->dctx);
+    free(input->buffer);
+    free(input);
 }
 
-char *libflist_archive_extract(char *filename, char *target) {
-    TAR *th = NULL;
-    struct stat st;
-    char *destination;
+// fill 'buffer' with uncompressed data, returns less than
+// 'length' at the end of the stream, -1 on error
+static ssize_t archive_input_read(archive_input_t *input, void *buffer, size_t length) {
+    ZSTD_outBuffer output = {.dst = buffer, .size = length, .pos = 0};
 
-    // checking if file is reachable
-    if(stat(filename, &st))
-        return libflist_errp(filename);
+    if(input->format == FLIST_ARCHIVE_GZIP)
+        return gzread(input->gzip, buffer, length);
 
-    // uncompression tar file
-    debug("[+] libflist: archive: uncompressing: %s\n", filename);
-    debug("[+] libflist: archive: target: %s\n", target);
-    if(!(destination = archive_prepare(filename, target)))
-        return libflist_errp("archive_prepare");
+    while(output.pos < output.size) {
+        size_t before = output.pos;
 
-    // loading tar and extracting contents
-    debug("[+] libflist: archive: loading: %s\n", destination);
-    if(tar_open(&th, destination, NULL, O_RDONLY, 0644, TAR_GNU))
-        return libflist_errp("tar_open");
+        if(input->input.pos == input->input.size && !input->eof) {
+            ssize_t value;
 
-    // TODO: ensure security on files
+            if((value = read(input->fd, input->buffer, ARCHIVE_BUFFER_SIZE)) < 0) {
+                if(errno == EINTR)
+                    continue;
 
-    debug("[+] libflist: archive: extracting archive\n");
-    if(tar_extract_all(th, target)) {
-        libflist_errp("tar_extract_all");
-        filename = NULL;
+                return -1;
+            }
+
+            input->eof = (value == 0);
+            input->input.size = value;
+            input->input.pos = 0;
+
+            continue;
+        }
+
+        size_t status = ZSTD_decompressStream(input->dctx, &output, &input->input);
+
+        if(ZSTD_isError(status)) {
+            libflist_set_error("archive: zstd: %s", ZSTD_getErrorName(status));
+            return -1;
+        }
+
+        // decoder can hold data after the input is consumed, the
+        // stream is over when nothing comes out anymore
+        if(input->eof && input->input.pos == input->input.size && output.pos == before)
+            break;
+    }
+
+    return output.pos;
+}
+
+// detect the compression of the archive and start reading it
+static archive_input_t *archive_input_open(int fd) {
+    uint8_t magic[4] = {0};
+    archive_input_t *input;
+    off_t offset;
+
+    if(!(input = calloc(sizeof(archive_input_t), 1))) {
+        close(fd);
+        return libflist_errp("archive: calloc");
+    }
+
+    input->fd = fd;
+    input->format = FLIST_ARCHIVE_GZIP;
+
+    // peeking without consuming (regular file)
+    if((offset = lseek(fd, 0, SEEK_CUR)) >= 0 && pread(fd, magic, sizeof(magic), offset) == sizeof(magic))
+        if(magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+            input->format = FLIST_ARCHIVE_ZSTD;
+
+    if(input->format == FLIST_ARCHIVE_ZSTD) {
+        debug("[+] libflist: archive: zstd archive\n");
+
+        if(!(input->dctx = ZSTD_createDCtx()) || !(input->buffer = malloc(ARCHIVE_BUFFER_SIZE))) {
+            archive_input_free(input);
+            return libflist_errp("archive: zstd: initialize");
+        }
+
+        input->input.src = input->buffer;
+
+        return input;
+    }
+
+    if(!(input->gzip = gzdopen(fd, "r"))) {
+        libflist_set_error("archive: gzdopen failed");
+        archive_input_free(input);
+        return NULL;
+    }
+
+    gzbuffer(input->gzip, ARCHIVE_BUFFER_SIZE);
+
+    return input;
+}
+
+static int archive_stream_open(const char *pathname, int flags, ...) {
+    (void) pathname;
+    (void) flags;
+
+    // stream is opened before libtar uses it
+    errno = EINVAL;
+    return -1;
+}
+
+static int archive_stream_close(int fd) {
+    (void) fd;
+
+    archive_input_free(archive_stream);
+    archive_stream = NULL;
+
+    return 0;
+}
+
+static ssize_t archive_stream_read(int fd, void *buffer, size_t length) {
+    (void) fd;
+    return archive_input_read(archive_stream, buffer, length);
+}
+
+static ssize_t archive_stream_write(int fd, const void *buffer, size_t length) {
+    (void) fd;
+    (void) buffer;
+    (void) length;
+
+    errno = EBADF;
+    return -1;
+}
+
+static tartype_t archive_readtype = {
+    .openfunc = archive_stream_open,
+    .closefunc = archive_stream_close,
+    .readfunc = archive_stream_read,
+    .writefunc = archive_stream_write,
+};
+
+// member path needs to stay inside the target directory
+static int archive_member_safe(char *path) {
+    char *component = path;
+
+    if(path[0] == '/')
+        return 0;
+
+    while(*component) {
+        size_t length = strcspn(component, "/");
+
+        if(length == 2 && strncmp(component, "..", 2) == 0)
+            return 0;
+
+        component += length;
+        component += (*component == '/');
+    }
+
+    return 1;
+}
+
+// create parent directories of a member (members are usually
+// ordered, parents are already there)
+static int archive_member_parents(char *path, size_t offset) {
+    char *sep = path + offset;
+
+    while((sep = strchr(sep + 1, '/'))) {
+        *sep = '\0';
+
+        if(mkdir(path, 0755) < 0 && errno != EEXIST) {
+            libflist_errp(path);
+            *sep = '/';
+            return 1;
+        }
+
+        *sep = '/';
+    }
+
+    return 0;
+}
+
+// read 'length' bytes of the archive into 'buffer'
+static int archive_stream_fill(void *buffer, size_t length) {
+    ssize_t value = archive_input_read(archive_stream, buffer, length);
+
+    if(value < 0 || (size_t) value != length) {
+        libflist_set_error("archive: unexpected end of archive");
+        return 1;
+    }
+
+    return 0;
+}
+
+// copy the contents of the current regular member into 'path',
+// the stream is then at the next header
+static int archive_member_extract(char *path, size_t size, mode_t mode, uint8_t *buffer) {
+    size_t padding = (T_BLOCKSIZE - (size % T_BLOCKSIZE)) % T_BLOCKSIZE;
+    int fd;
+
+    if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, mode & 0777)) < 0) {
+        libflist_errp(path);
+        return 1;
     }
 
+    while(size > 0) {
+        size_t length = (size < ARCHIVE_BUFFER_SIZE) ? size : ARCHIVE_BUFFER_SIZE;
+
+        if(archive_stream_fill(buffer, length))
+            goto failed;
+
+        for(size_t done = 0; done < length; ) {
+            ssize_t written = write(fd, buffer + done, length - done);
+
+            if(written < 0 && errno == EINTR)
+                continue;
+
+            if(written <= 0) {
+                libflist_errp(path);
+                goto failed;
+            }
+
+            done += written;
+        }
+
+        size -= length;
+    }
+
+    if(padding && archive_stream_fill(buffer, padding))
+        goto failed;
+
+    close(fd);
+
+    return 0;
+
+failed:
+    close(fd);
+    return 1;
+}
+
+// extract all the members of the archive
+static int archive_extract_members(TAR *th, char *target) {
+    uint8_t *buffer;
+    int value = 1;
+    int status;
+
+    if(!(buffer = malloc(ARCHIVE_BUFFER_SIZE))) {
+        libflist_errp("archive: malloc");
+        return 1;
+    }
+
+    while((status = th_read(th)) == 0) {
+        char *member = th_get_pathname(th);
+        char *path = NULL;
+
+        if(!archive_member_safe(member)) {
+            libflist_set_error("archive: %s: unsafe member path", member);
+            goto cleanup;
+        }
+
+        if(asprintf(&path, "%s/%s", target, member) < 0) {
+            libflist_errp("asprintf");
+            goto cleanup;
+        }
+
+        debug("[+] libflist: archive: extracting: %s\n", member);
+
+        if(archive_member_parents(path, strlen(target))) {
+            free(path);
+            goto cleanup;
+        }
+
+        if(TH_ISDIR(th)) {
+            if(mkdir(path, (th_get_mode(th) & 0777) | 0700) < 0 && errno != EEXIST) {
+                libflist_errp(path);
+                free(path);
+                goto cleanup;
+            }
+
+        } else if(TH_ISREG(th)) {
+            if(archive_member_extract(path, th_get_size(th), th_get_mode(th), buffer)) {
+                free(path);
+                goto cleanup;
+            }
+
+        } else {
+            libflist_set_error("archive: %s: unsupported member type", member);
+            free(path);
+            goto cleanup;
+        }
+
+        free(path);
+    }
+
+    if(status < 0) {
+        libflist_set_error("archive: could not read archive header");
+        goto cleanup;
+    }
+
+    value = 0;
+
+cleanup:
+    free(buffer);
+    return value;
+}
+
+// extract a compressed archive, read from 'fd' (which is owned and
+// closed by this function) into 'target' directory
+int libflist_archive_extract_fd(int fd, char *target) {
+    TAR *th = NULL;
+    int value;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if(!(archive_stream = archive_input_open(fd)))
+        return 1;
+
+    if(tar_fdopen(&th, fd, "archive", &archive_readtype, O_RDONLY, 0, TAR_GNU)) {
+        libflist_errp("tar_fdopen");
+        archive_stream_close(fd);
+        return 1;
+    }
+
+    debug("[+] libflist: archive: extracting archive\n");
+    value = archive_extract_members(th, target);
+
+    // closes the stream
     tar_close(th);
 
-    if(unlink(destination) < 0)
-        return libflist_errp("unlink");
+    return value;
+}
+
+char *libflist_archive_extract(char *filename, char *target) {
+    int fd;
+
+    if((fd = open(filename, O_RDONLY)) < 0)
+        return libflist_errp(filename);
+
+    debug("[+] libflist: archive: uncompressing: %s\n", filename);
+    debug("[+] libflist: archive: target: %s\n", target);
 
-    free(destination);
+    if(libflist_archive_extract_fd(fd, target))
+        return NULL;
 
     return filename;
 }
 
-static char *archive_compress(char *source, char *destination) {
-    char buffer[4096];
-    ssize_t len;
-    FILE *src;
-    gzFile gdst;
-
-    if(!(src = fopen(source, "r")))
-        return libflist_errp(source);
+//
+// archive creation
+//
+// the tar stream produced by libtar is compressed on the fly by the
+// parallel writer (see archive_blocks.c), through a custom tar type
+// writing to the compressed stream of the current thread
+//
+static __thread archive_blocks_t *archive_writer = NULL;
 
-    if(!(gdst = gzopen(destination, "w")))
-        return libflist_errp(destination);
+static int archive_writer_close(int fd) {
+    // writer is closed by the caller (to get the status)
+    (void) fd;
+    return 0;
+}
 
-    while((len = fread(buffer, 1, sizeof(buffer), src)))
-        gzwrite(gdst, buffer, len);
+static ssize_t archive_writer_read(int fd, void *buffer, size_t length) {
+    (void) fd;
+    (void) buffer;
+    (void) length;
 
-    fclose(src);
-    gzclose(gdst);
+    errno = EBADF;
+    return -1;
+}
 
-    return destination;
+static ssize_t archive_writer_write(int fd, const void *buffer, size_t length) {
+    (void) fd;
+    return archive_blocks_write(archive_writer, buffer, length);
 }
 
-char *libflist_archive_create(char *filename, char *source) {
+static tartype_t archive_writetype = {
+    .openfunc = archive_stream_open,
+    .closefunc = archive_writer_close,
+    .readfunc = archive_writer_read,
+    .writefunc = archive_writer_write,
+};
+
+// archive and compress 'source' directory into 'filename', using
+// 'format' compression, done by 'workers' threads
+char *libflist_archive_create_format(char *filename, char *source, flist_archive_format_t format, size_t workers) {
     TAR *th = NULL;
-    char *tempfile;
+    int fd, value;
 
-    if(asprintf(&tempfile, "%s.uncompressed", filename) < 0)
-        return libflist_errp("asprintf");
+    if((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return libflist_errp(filename);
 
-    debug("[+] building uncompressed archive: %s\n", tempfile);
-    if(tar_open(&th, tempfile, NULL, O_WRONLY | O_CREAT, 0644, TAR_GNU))
-        return libflist_errp("tar_open");
+    if(!(archive_writer = archive_blocks_open(fd, format, workers))) {
+        close(fd);
+        unlink(filename);
+        return NULL;
+    }
+
+    debug("[+] building compressed archive: %s\n", filename);
+
+    if(tar_fdopen(&th, fd, filename, &archive_writetype, O_WRONLY, 0644, TAR_GNU)) {
+        libflist_errp("tar_fdopen");
+        value = 1;
+
+    } else {
+        if((value = tar_append_tree(th, source, ".")))
+            libflist_errp("tar_append_tree");
 
-    if(tar_append_tree(th, source, ".")) {
-        libflist_errp("tar_append_tree");
         tar_close(th);
-        return NULL;
     }
 
-    tar_close(th);
+    // flushing pending blocks and trailer
+    if(archive_blocks_close(archive_writer))
+        value = 1;
 
-    // compressing
-    debug("[+] compressing file: %s > %s\n", tempfile, filename);
-    char *retval = archive_compress(tempfile, filename);
+    archive_writer = NULL;
+    close(fd);
 
-    // cleaning
-    unlink(tempfile);
-    free(tempfile);
+    if(value) {
+        unlink(filename);
+        return NULL;
+    }
 
-    return retval;
+    return filename;
+}
+
+char *libflist_archive_create_parallel(char *filename, char *source, size_t workers) {
+    return libflist_archive_create_format(filename, source, FLIST_ARCHIVE_GZIP, workers);
+}
+
+char *libflist_archive_create(char *filename, char *source) {
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    return libflist_archive_create_parallel(filename, source, workers > 0 ? workers : 1);
 }
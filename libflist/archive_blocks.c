@@ -0,0 +1,518 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <zstd.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "archive_blocks.h"
+
+//
+// parallel compressed stream writer
+//
+// the stream is split into fixed size blocks, compressed in parallel by
+// a pool of workers, blocks are written in order by the caller thread
+// (which also fills them)
+//
+// gzip: each block is raw deflate data, starting with the last 32 KB
+// of the previous block as dictionary (same compression ratio as a
+// sequential deflate) and ending on a byte boundary (sync flush), the
+// last one ends the deflate stream, blocks are written between a gzip
+// header and a trailer (crc32 of all the blocks combined and length),
+// the result is a standard gzip file
+//
+// zstd: each block is an independent zstd frame, a seek table (skippable
+// frame, see zstd seekable format) is written at the end: any zstd
+// decoder can read the stream, and a reader can uncompress only the
+// frames it needs (see archive_seekable.c)
+//
+// only a few blocks per worker are in flight, the caller waits for the
+// oldest block to be written before filling a new one
+//
+
+static void archive_blocks_le32(uint8_t *target, uint32_t value) {
+    for(int i = 0; i < 4; i++)
+        target[i] = (value >> (i * 8)) & 0xff;
+}
+
+static int archive_blocks_output(archive_blocks_t *blocks, const uint8_t *data, size_t length) {
+    size_t done = 0;
+
+    while(done < length) {
+        ssize_t value = write(blocks->fd, data + done, length - done);
+
+        if(value < 0 && errno == EINTR)
+            continue;
+
+        if(value <= 0) {
+            libflist_errp("archive: write");
+            return 1;
+        }
+
+        done += value;
+    }
+
+    return 0;
+}
+
+static int archive_blocks_reserve(archive_blocks_job_t *job, size_t required) {
+    uint8_t *output;
+
+    if(job->outsize >= required)
+        return 0;
+
+    if(!(output = realloc(job->output, required)))
+        return 1;
+
+    job->output = output;
+    job->outsize = required;
+
+    return 0;
+}
+
+// compress one block, the output is byte aligned and
+// can be concatenated to the previous block output
+static int archive_blocks_deflate(z_stream *stream, archive_blocks_job_t *job) {
+    int flush = job->last ? Z_FINISH : Z_SYNC_FLUSH;
+    int value;
+
+    job->crc = crc32(0, job->input, job->inlen);
+
+    if(deflateReset(stream) != Z_OK)
+        return 1;
+
+    if(job->dictlen && deflateSetDictionary(stream, job->dict, job->dictlen) != Z_OK)
+        return 1;
+
+    // worst case, plus sync flush marker
+    if(archive_blocks_reserve(job, deflateBound(stream, job->inlen) + 16))
+        return 1;
+
+    stream->next_in = job->input;
+    stream->avail_in = job->inlen;
+    job->outlen = 0;
+
+    while(1) {
+        stream->next_out = job->output + job->outlen;
+        stream->avail_out = job->outsize - job->outlen;
+
+        value = deflate(stream, flush);
+
+        job->outlen = job->outsize - stream->avail_out;
+
+        if(value == Z_STREAM_END)
+            return 0;
+
+        if(value != Z_OK && value != Z_BUF_ERROR)
+            return 1;
+
+        // sync flush completed (output buffer not full)
+        if(!job->last && stream->avail_in == 0 && stream->avail_out > 0)
+            return 0;
+
+        // output buffer not full, nothing more can be done
+        if(stream->avail_out > 0)
+            return 1;
+
+        // bound was not enough, growing output buffer
+        if(archive_blocks_reserve(job, job->outsize * 2))
+            return 1;
+    }
+}
+
+// compress one block into an independent zstd frame
+static int archive_blocks_zstd(ZSTD_CCtx *cctx, int level, archive_blocks_job_t *job) {
+    size_t value;
+
+    // empty last block, no frame
+    if(job->inlen == 0) {
+        job->outlen = 0;
+        return 0;
+    }
+
+    if(archive_blocks_reserve(job, ZSTD_compressBound(job->inlen)))
+        return 1;
+
+    value = ZSTD_compressCCtx(cctx, job->output, job->outsize, job->input, job->inlen, level);
+
+    if(ZSTD_isError(value))
+        return 1;
+
+    job->outlen = value;
+
+    return 0;
+}
+
+static void archive_blocks_fail(archive_blocks_t *blocks) {
+    pthread_mutex_lock(&blocks->lock);
+    blocks->error = 1;
+    pthread_cond_broadcast(&blocks->update);
+    pthread_mutex_unlock(&blocks->lock);
+}
+
+static void *archive_blocks_worker(void *userptr) {
+    archive_blocks_t *blocks = (archive_blocks_t *) userptr;
+    ZSTD_CCtx *cctx = NULL;
+    z_stream stream;
+
+    memset(&stream, 0, sizeof(z_stream));
+
+    // raw deflate, the gzip wrapper is written by the caller
+    if(blocks->format == FLIST_ARCHIVE_GZIP) {
+        if(deflateInit2(&stream, blocks->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            archive_blocks_fail(blocks);
+            return NULL;
+        }
+    }
+
+    if(blocks->format == FLIST_ARCHIVE_ZSTD) {
+        if(!(cctx = ZSTD_createCCtx())) {
+            archive_blocks_fail(blocks);
+            return NULL;
+        }
+    }
+
+    while(1) {
+        archive_blocks_job_t *job;
+        int value;
+
+        pthread_mutex_lock(&blocks->lock);
+
+        while(blocks->claimed == blocks->submitted && !blocks->closing && !blocks->error)
+            pthread_cond_wait(&blocks->update, &blocks->lock);
+
+        if(blocks->claimed == blocks->submitted || blocks->error) {
+            pthread_mutex_unlock(&blocks->lock);
+            break;
+        }
+
+        job = &blocks->jobs[blocks->claimed % blocks->slots];
+        blocks->claimed += 1;
+
+        pthread_mutex_unlock(&blocks->lock);
+
+        if(blocks->format == FLIST_ARCHIVE_ZSTD)
+            value = archive_blocks_zstd(cctx, blocks->level, job);
+        else
+            value = archive_blocks_deflate(&stream, job);
+
+        pthread_mutex_lock(&blocks->lock);
+
+        if(value)
+            blocks->error = 1;
+
+        job->done = 1;
+
+        pthread_cond_broadcast(&blocks->update);
+        pthread_mutex_unlock(&blocks->lock);
+    }
+
+    if(blocks->format == FLIST_ARCHIVE_GZIP)
+        deflateEnd(&stream);
+
+    ZSTD_freeCCtx(cctx);
+
+    return NULL;
+}
+
+// keep track of a frame written, for the seek table
+static int archive_blocks_frame(archive_blocks_t *blocks, archive_blocks_job_t *job) {
+    if(blocks->frameslen == blocks->framesalloc) {
+        size_t allocate = blocks->framesalloc ? blocks->framesalloc * 2 : 64;
+        archive_blocks_frame_t *frames;
+
+        if(!(frames = realloc(blocks->frames, allocate * sizeof(archive_blocks_frame_t)))) {
+            libflist_errp("archive: seek table: realloc");
+            return 1;
+        }
+
+        blocks->frames = frames;
+        blocks->framesalloc = allocate;
+    }
+
+    blocks->frames[blocks->frameslen].compressed = job->outlen;
+    blocks->frames[blocks->frameslen].decompressed = job->inlen;
+    blocks->frameslen += 1;
+
+    return 0;
+}
+
+// wait for the oldest block to be compressed and write it
+static int archive_blocks_flush(archive_blocks_t *blocks) {
+    archive_blocks_job_t *job = &blocks->jobs[blocks->written % blocks->slots];
+    int error;
+
+    pthread_mutex_lock(&blocks->lock);
+
+    while(!job->done && !blocks->error)
+        pthread_cond_wait(&blocks->update, &blocks->lock);
+
+    error = blocks->error;
+    pthread_mutex_unlock(&blocks->lock);
+
+    if(error) {
+        libflist_set_error("archive: compression failed");
+        return 1;
+    }
+
+    if(archive_blocks_output(blocks, job->output, job->outlen))
+        return 1;
+
+    if(blocks->format == FLIST_ARCHIVE_GZIP) {
+        blocks->crc = crc32_combine(blocks->crc, job->crc, job->inlen);
+        blocks->isize += job->inlen;
+    }
+
+    if(blocks->format == FLIST_ARCHIVE_ZSTD && job->outlen > 0)
+        if(archive_blocks_frame(blocks, job))
+            return 1;
+
+    // slot can be filled again
+    job->inlen = 0;
+    job->done = 0;
+    blocks->written += 1;
+
+    return 0;
+}
+
+// block currently filled by the caller, waiting for
+// a slot to be available if needed
+static archive_blocks_job_t *archive_blocks_current(archive_blocks_t *blocks) {
+    while(blocks->submitted - blocks->written >= blocks->slots)
+        if(archive_blocks_flush(blocks))
+            return NULL;
+
+    return &blocks->jobs[blocks->submitted % blocks->slots];
+}
+
+// gzip dictionary: the last 32 KB of the stream before this block
+static void archive_blocks_window(archive_blocks_t *blocks, archive_blocks_job_t *job) {
+    memcpy(job->dict, blocks->window, blocks->windowlen);
+    job->dictlen = blocks->windowlen;
+
+    if(job->inlen >= ARCHIVE_GZIP_WINDOW_SIZE) {
+        memcpy(blocks->window, job->input + job->inlen - ARCHIVE_GZIP_WINDOW_SIZE, ARCHIVE_GZIP_WINDOW_SIZE);
+        blocks->windowlen = ARCHIVE_GZIP_WINDOW_SIZE;
+
+    } else {
+        size_t keep = ARCHIVE_GZIP_WINDOW_SIZE - job->inlen;
+
+        if(keep > blocks->windowlen)
+            keep = blocks->windowlen;
+
+        memmove(blocks->window, blocks->window + blocks->windowlen - keep, keep);
+        memcpy(blocks->window + keep, job->input, job->inlen);
+        blocks->windowlen = keep + job->inlen;
+    }
+}
+
+// hand the current block to the workers
+static void archive_blocks_submit(archive_blocks_t *blocks, archive_blocks_job_t *job, int last) {
+    job->last = last;
+
+    if(blocks->format == FLIST_ARCHIVE_GZIP)
+        archive_blocks_window(blocks, job);
+
+    pthread_mutex_lock(&blocks->lock);
+    blocks->submitted += 1;
+    pthread_cond_broadcast(&blocks->update);
+    pthread_mutex_unlock(&blocks->lock);
+}
+
+static void archive_blocks_free(archive_blocks_t *blocks) {
+    for(size_t i = 0; blocks->jobs && i < blocks->slots; i++) {
+        free(blocks->jobs[i].input);
+        free(blocks->jobs[i].output);
+    }
+
+    pthread_mutex_destroy(&blocks->lock);
+    pthread_cond_destroy(&blocks->update);
+
+    free(blocks->frames);
+    free(blocks->threads);
+    free(blocks->jobs);
+    free(blocks);
+}
+
+// stop workers (all blocks needs to be written)
+static void archive_blocks_stop(archive_blocks_t *blocks) {
+    pthread_mutex_lock(&blocks->lock);
+    blocks->closing = 1;
+    pthread_cond_broadcast(&blocks->update);
+    pthread_mutex_unlock(&blocks->lock);
+
+    for(size_t i = 0; i < blocks->workers; i++)
+        pthread_join(blocks->threads[i], NULL);
+}
+
+// gzip header: no file name, no modification time, unix
+static int archive_blocks_header(archive_blocks_t *blocks) {
+    uint8_t header[10] = {0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03};
+
+    if(blocks->format != FLIST_ARCHIVE_GZIP)
+        return 0;
+
+    return archive_blocks_output(blocks, header, sizeof(header));
+}
+
+// gzip trailer (crc32 and length) or zstd seek table
+static int archive_blocks_trailer(archive_blocks_t *blocks) {
+    uint8_t *table, *entry;
+    size_t length;
+    int value;
+
+    if(blocks->format == FLIST_ARCHIVE_GZIP) {
+        uint8_t trailer[8];
+
+        archive_blocks_le32(trailer, blocks->crc);
+        archive_blocks_le32(trailer + 4, blocks->isize);
+
+        return archive_blocks_output(blocks, trailer, sizeof(trailer));
+    }
+
+    // skippable frame header, entries (without checksum) and footer
+    length = 8 + (blocks->frameslen * 8) + ARCHIVE_ZSTD_FOOTER_SIZE;
+
+    if(!(table = malloc(length))) {
+        libflist_errp("archive: seek table: malloc");
+        return 1;
+    }
+
+    archive_blocks_le32(table, ARCHIVE_ZSTD_SKIPPABLE_MAGIC);
+    archive_blocks_le32(table + 4, length - 8);
+
+    entry = table + 8;
+
+    for(size_t i = 0; i < blocks->frameslen; i++, entry += 8) {
+        archive_blocks_le32(entry, blocks->frames[i].compressed);
+        archive_blocks_le32(entry + 4, blocks->frames[i].decompressed);
+    }
+
+    archive_blocks_le32(entry, blocks->frameslen);
+    entry[4] = 0x00;  // descriptor: no checksum
+    archive_blocks_le32(entry + 5, ARCHIVE_ZSTD_SEEKABLE_MAGIC);
+
+    value = archive_blocks_output(blocks, table, length);
+    free(table);
+
+    return value;
+}
+
+// start a compressed stream on 'fd', compressed by 'workers' threads
+archive_blocks_t *archive_blocks_open(int fd, flist_archive_format_t format, size_t workers) {
+    archive_blocks_t *blocks;
+
+    if(workers < 1)
+        workers = 1;
+
+    if(!(blocks = calloc(sizeof(archive_blocks_t), 1)))
+        return libflist_errp("archive: calloc");
+
+    blocks->fd = fd;
+    blocks->format = format;
+    blocks->slots = workers * 2;
+    blocks->crc = crc32(0, NULL, 0);
+
+    blocks->level = Z_DEFAULT_COMPRESSION;
+    blocks->blocksize = ARCHIVE_GZIP_BLOCK_SIZE;
+
+    if(format == FLIST_ARCHIVE_ZSTD) {
+        blocks->level = ZSTD_CLEVEL_DEFAULT;
+        blocks->blocksize = ARCHIVE_ZSTD_BLOCK_SIZE;
+    }
+
+    pthread_mutex_init(&blocks->lock, NULL);
+    pthread_cond_init(&blocks->update, NULL);
+
+    if(!(blocks->jobs = calloc(sizeof(archive_blocks_job_t), blocks->slots)))
+        goto failed;
+
+    if(!(blocks->threads = calloc(sizeof(pthread_t), workers)))
+        goto failed;
+
+    for(size_t i = 0; i < blocks->slots; i++)
+        if(!(blocks->jobs[i].input = malloc(blocks->blocksize)))
+            goto failed;
+
+    if(archive_blocks_header(blocks)) {
+        archive_blocks_free(blocks);
+        return NULL;
+    }
+
+    for(blocks->workers = 0; blocks->workers < workers; blocks->workers++)
+        if(pthread_create(&blocks->threads[blocks->workers], NULL, archive_blocks_worker, blocks))
+            break;
+
+    if(blocks->workers == 0) {
+        libflist_set_error("archive: could not start any worker");
+        archive_blocks_free(blocks);
+        return NULL;
+    }
+
+    debug("[+] libflist: archive: compressing with %lu workers\n", blocks->workers);
+
+    return blocks;
+
+failed:
+    archive_blocks_free(blocks);
+    return libflist_errp("archive: malloc");
+}
+
+ssize_t archive_blocks_write(archive_blocks_t *blocks, const void *data, size_t length) {
+    const uint8_t *source = data;
+    size_t done = 0;
+
+    while(done < length) {
+        archive_blocks_job_t *job;
+        size_t chunk;
+
+        if(!(job = archive_blocks_current(blocks)))
+            return -1;
+
+        chunk = blocks->blocksize - job->inlen;
+
+        if(chunk > length - done)
+            chunk = length - done;
+
+        memcpy(job->input + job->inlen, source + done, chunk);
+        job->inlen += chunk;
+        done += chunk;
+
+        if(job->inlen == blocks->blocksize)
+            archive_blocks_submit(blocks, job, 0);
+    }
+
+    return length;
+}
+
+// end the stream and release the writer, the file
+// descriptor is not closed, returns 0 on success
+int archive_blocks_close(archive_blocks_t *blocks) {
+    archive_blocks_job_t *job;
+    int value = 1;
+
+    if(!(job = archive_blocks_current(blocks)))
+        goto cleanup;
+
+    archive_blocks_submit(blocks, job, 1);
+
+    while(blocks->written < blocks->submitted)
+        if(archive_blocks_flush(blocks))
+            goto cleanup;
+
+    if(archive_blocks_trailer(blocks))
+        goto cleanup;
+
+    value = 0;
+
+cleanup:
+    archive_blocks_stop(blocks);
+    archive_blocks_free(blocks);
+
+    return value;
+}
@@ -0,0 +1,83 @@
+#ifndef LIBFLIST_ARCHIVE_BLOCKS_H
+    #define LIBFLIST_ARCHIVE_BLOCKS_H
+
+    #include <pthread.h>
+    #include <zlib.h>
+    #include <zstd.h>
+
+    #define ARCHIVE_GZIP_BLOCK_SIZE   (128 * 1024)
+    #define ARCHIVE_GZIP_WINDOW_SIZE  (32 * 1024)
+    #define ARCHIVE_ZSTD_BLOCK_SIZE   (256 * 1024)
+
+    // seekable zstd format (zstd contrib/seekable_format)
+    #define ARCHIVE_ZSTD_SKIPPABLE_MAGIC  0x184D2A5E
+    #define ARCHIVE_ZSTD_SEEKABLE_MAGIC   0x8F92EAB1
+    #define ARCHIVE_ZSTD_FOOTER_SIZE      9
+
+    // reader limits: smallest possible frame (header and one block
+    // header) and largest uncompressed frame accepted (seek table
+    // of the contrib format allows up to 1 GB)
+    #define ARCHIVE_ZSTD_FRAME_MIN        9
+    #define ARCHIVE_ZSTD_FRAME_MAX        (64 * 1024 * 1024)
+
+    // one block of the stream, compressed independently
+    typedef struct archive_blocks_job_t {
+        uint8_t *input;         // plain block
+        size_t inlen;
+        uint8_t dict[ARCHIVE_GZIP_WINDOW_SIZE];  // gzip: end of the previous block
+        size_t dictlen;
+        int last;               // last block of the stream
+
+        uint8_t *output;        // compressed block
+        size_t outlen;
+        size_t outsize;         // output buffer allocated size
+        uint32_t crc;           // gzip: crc32 of the plain block
+        int done;               // compression done
+
+    } archive_blocks_job_t;
+
+    // seek table entry (zstd), one per frame
+    typedef struct archive_blocks_frame_t {
+        uint32_t compressed;
+        uint32_t decompressed;
+
+    } archive_blocks_frame_t;
+
+    typedef struct archive_blocks_t {
+        int fd;                 // destination
+        flist_archive_format_t format;
+        int level;              // compression level
+        size_t blocksize;       // plain block size
+
+        archive_blocks_job_t *jobs;  // ring of in-flight blocks
+        size_t slots;           // amount of jobs on the ring
+        size_t submitted;       // blocks submitted (sequence)
+        size_t claimed;         // blocks claimed by a worker
+        size_t written;         // blocks written to the destination
+
+        // gzip
+        uint8_t window[ARCHIVE_GZIP_WINDOW_SIZE];  // tail of the stream
+        size_t windowlen;
+        uint32_t crc;           // crc32 of the whole stream
+        uint32_t isize;         // stream length (modulo 2^32)
+
+        // zstd
+        archive_blocks_frame_t *frames;  // seek table
+        size_t frameslen;
+        size_t framesalloc;
+
+        int closing;            // no more blocks, workers can leave
+        int error;              // one block could not be compressed
+
+        pthread_t *threads;
+        size_t workers;
+
+        pthread_mutex_t lock;
+        pthread_cond_t update;
+
+    } archive_blocks_t;
+
+    archive_blocks_t *archive_blocks_open(int fd, flist_archive_format_t format, size_t workers);
+    ssize_t archive_blocks_write(archive_blocks_t *blocks, const void *data, size_t length);
+    int archive_blocks_close(archive_blocks_t *blocks);
+#endif
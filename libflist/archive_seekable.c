@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <zstd.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "archive_blocks.h"
+#include "archive_seekable.h"
+
+//
+// seekable zstd archive reader
+//
+// a seekable archive (see archive_blocks.c) is made of independent
+// zstd frames, followed by a seek table (skippable frame) containing
+// the compressed and uncompressed length of each frame
+//
+// any range of the plain tar stream can be read by uncompressing only
+// the frames covering it, this is used to reach a member (the flist
+// database) without uncompressing the whole archive
+//
+// the last uncompressed frame is kept, consecutive small reads on the
+// same frame (sqlite pages) doesn't uncompress it again
+//
+#define ARCHIVE_TAR_BLOCK  512
+
+static uint32_t seekable_le32(uint8_t *buffer) {
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t) buffer[3] << 24);
+}
+
+static int seekable_read(int fd, void *buffer, size_t length, off_t offset) {
+    ssize_t value;
+
+    while(length > 0) {
+        if((value = pread(fd, buffer, length, offset)) <= 0) {
+            if(value < 0)
+                libflist_errp("archive: seekable: pread");
+            else
+                libflist_set_error("archive: seekable: unexpected end of file");
+
+            return 1;
+        }
+
+        buffer = (uint8_t *) buffer + value;
+        length -= value;
+        offset += value;
+    }
+
+    return 0;
+}
+
+void libflist_archive_close(flist_archive_t *archive) {
+    if(!archive)
+        return;
+
+    if(archive->fd >= 0)
+        close(archive->fd);
+
+    ZSTD_freeDCtx(archive->dctx);
+    free(archive->compressed);
+    free(archive->plain);
+    free(archive->input);
+    free(archive->frame);
+    free(archive);
+}
+
+// load the seek table, which is at the end of the file
+static int seekable_table(flist_archive_t *archive, off_t filesize) {
+    uint8_t footer[ARCHIVE_ZSTD_FOOTER_SIZE];
+    uint8_t header[8];
+    uint8_t *table = NULL;
+    size_t entrysize, tablesize;
+    off_t tablestart;
+    int value = 1;
+
+    if(filesize < ARCHIVE_ZSTD_FOOTER_SIZE + 8) {
+        libflist_set_error("archive: seekable: file too small");
+        return 1;
+    }
+
+    if(seekable_read(archive->fd, footer, sizeof(footer), filesize - sizeof(footer)))
+        return 1;
+
+    if(seekable_le32(footer + 5) != ARCHIVE_ZSTD_SEEKABLE_MAGIC) {
+        libflist_set_error("archive: not a seekable zstd archive");
+        return 1;
+    }
+
+    // descriptor: checksum flag (bit 7), reserved bits needs to be zero
+    if(footer[4] & 0x7c) {
+        libflist_set_error("archive: seekable: unsupported descriptor");
+        return 1;
+    }
+
+    archive->frames = seekable_le32(footer);
+    entrysize = (footer[4] & 0x80) ? 12 : 8;
+    tablesize = archive->frames * entrysize;
+
+    // each frame takes some room in the file, the amount of frames
+    // (and the offsets allocated) is bounded by the file length
+    if((off_t) (archive->frames * (entrysize + ARCHIVE_ZSTD_FRAME_MIN) + sizeof(footer) + sizeof(header)) > filesize) {
+        libflist_set_error("archive: seekable: invalid seek table length");
+        return 1;
+    }
+
+    tablestart = filesize - sizeof(footer) - tablesize - sizeof(header);
+
+    if(seekable_read(archive->fd, header, sizeof(header), tablestart))
+        return 1;
+
+    if(seekable_le32(header) != ARCHIVE_ZSTD_SKIPPABLE_MAGIC || seekable_le32(header + 4) != tablesize + sizeof(footer)) {
+        libflist_set_error("archive: seekable: invalid seek table header");
+        return 1;
+    }
+
+    // offsets are freed with the archive on error
+    archive->compressed = malloc(sizeof(off_t) * (archive->frames + 1));
+    archive->plain = malloc(sizeof(uint64_t) * (archive->frames + 1));
+
+    if(!archive->compressed || !archive->plain || (tablesize && !(table = malloc(tablesize)))) {
+        libflist_errp("archive: seekable: malloc");
+        return 1;
+    }
+
+    if(tablesize && seekable_read(archive->fd, table, tablesize, tablestart + sizeof(header)))
+        goto cleanup;
+
+    archive->compressed[0] = 0;
+    archive->plain[0] = 0;
+
+    for(size_t i = 0; i < archive->frames; i++) {
+        uint8_t *entry = table + (i * entrysize);
+        uint32_t compressed = seekable_le32(entry);
+        uint32_t plain = seekable_le32(entry + 4);
+
+        // frames are uncompressed in memory, their length is
+        // checked before anything is allocated for them
+        if(compressed < ARCHIVE_ZSTD_FRAME_MIN || plain > ARCHIVE_ZSTD_FRAME_MAX) {
+            libflist_set_error("archive: seekable: frame %lu: invalid length", i);
+            goto cleanup;
+        }
+
+        archive->compressed[i + 1] = archive->compressed[i] + compressed;
+        archive->plain[i + 1] = archive->plain[i] + plain;
+    }
+
+    // frames needs to cover exactly the file, up to the seek table
+    if(archive->compressed[archive->frames] != tablestart) {
+        libflist_set_error("archive: seekable: seek table doesn't match file length");
+        goto cleanup;
+    }
+
+    debug("[+] libflist: archive: seekable: %lu frames, %lu bytes\n", archive->frames, archive->plain[archive->frames]);
+    value = 0;
+
+cleanup:
+    free(table);
+    return value;
+}
+
+flist_archive_t *libflist_archive_open(char *filename) {
+    flist_archive_t *archive;
+    struct stat st;
+
+    if(!(archive = calloc(sizeof(flist_archive_t), 1)))
+        return libflist_errp("archive: calloc");
+
+    archive->cached = -1;
+
+    if((archive->fd = open(filename, O_RDONLY)) < 0) {
+        libflist_errp(filename);
+        libflist_archive_close(archive);
+        return NULL;
+    }
+
+    if(fstat(archive->fd, &st) < 0) {
+        libflist_errp(filename);
+        libflist_archive_close(archive);
+        return NULL;
+    }
+
+    if(seekable_table(archive, st.st_size)) {
+        libflist_archive_close(archive);
+        return NULL;
+    }
+
+    if(!(archive->dctx = ZSTD_createDCtx())) {
+        libflist_set_error("archive: seekable: zstd context");
+        libflist_archive_close(archive);
+        return NULL;
+    }
+
+    return archive;
+}
+
+// uncompress frame 'index' into the frame cache
+static int seekable_frame(flist_archive_t *archive, size_t index) {
+    size_t compressed = archive->compressed[index + 1] - archive->compressed[index];
+    size_t plain = archive->plain[index + 1] - archive->plain[index];
+    size_t value;
+
+    if((ssize_t) index == archive->cached)
+        return 0;
+
+    if(compressed > archive->inputsize) {
+        free(archive->input);
+
+        if(!(archive->input = malloc(compressed))) {
+            archive->inputsize = 0;
+            libflist_errp("archive: seekable: malloc");
+            return 1;
+        }
+
+        archive->inputsize = compressed;
+    }
+
+    if(plain > archive->framesize) {
+        free(archive->frame);
+
+        if(!(archive->frame = malloc(plain))) {
+            archive->framesize = 0;
+            archive->cached = -1;
+            libflist_errp("archive: seekable: malloc");
+            return 1;
+        }
+
+        archive->framesize = plain;
+    }
+
+    // cache is overwritten, even if uncompression fails
+    archive->cached = -1;
+
+    if(seekable_read(archive->fd, archive->input, compressed, archive->compressed[index]))
+        return 1;
+
+    value = ZSTD_decompressDCtx(archive->dctx, archive->frame, plain, archive->input, compressed);
+
+    if(ZSTD_isError(value)) {
+        libflist_set_error("archive: seekable: zstd: %s", ZSTD_getErrorName(value));
+        return 1;
+    }
+
+    if(value != plain) {
+        libflist_set_error("archive: seekable: frame %lu: unexpected length", index);
+        return 1;
+    }
+
+    archive->cached = index;
+
+    return 0;
+}
+
+// read 'length' bytes of the plain stream (tar) at 'offset', only the frames
+// covering this range are uncompressed, returns less than 'length' at
+// the end of the stream, -1 on error
+ssize_t libflist_archive_pread(flist_archive_t *archive, void *buffer, size_t length, off_t offset) {
+    uint64_t position = offset;
+    size_t done = 0;
+    size_t low = 0, high = archive->frames;
+
+    if(offset < 0 || position >= archive->plain[archive->frames])
+        return 0;
+
+    // last frame starting before offset
+    while(high - low > 1) {
+        size_t middle = (low + high) / 2;
+
+        if(archive->plain[middle] <= position)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    for(size_t index = low; index < archive->frames && done < length; index++) {
+        uint64_t start = archive->plain[index];
+        uint64_t end = archive->plain[index + 1];
+
+        // empty frame
+        if(start == end)
+            continue;
+
+        if(seekable_frame(archive, index))
+            return -1;
+
+        size_t from = position - start;
+        size_t available = end - position;
+        size_t copy = (length - done < available) ? length - done : available;
+
+        memcpy((uint8_t *) buffer + done, archive->frame + from, copy);
+
+        done += copy;
+        position += copy;
+    }
+
+    return done;
+}
+
+// size field of a tar header, octal or base-256 (gnu)
+static size_t seekable_tar_size(uint8_t *header) {
+    uint8_t *field = header + 124;
+    size_t size = 0;
+
+    if(field[0] & 0x80) {
+        for(int i = 1; i < 12; i++)
+            size = (size << 8) | field[i];
+
+        return size;
+    }
+
+    for(int i = 0; i < 12 && field[i]; i++) {
+        if(field[i] == ' ')
+            continue;
+
+        if(field[i] < '0' || field[i] > '7')
+            break;
+
+        size = (size << 3) | (field[i] - '0');
+    }
+
+    return size;
+}
+
+// locate member 'name' in the archive, without uncompressing members
+// contents (only headers are read), sets its offset (in the plain
+// stream) and its length, returns 0 if found
+int libflist_archive_member(flist_archive_t *archive, char *name, off_t *offset, size_t *length) {
+    uint8_t header[ARCHIVE_TAR_BLOCK];
+    char *longname = NULL;
+    char path[ARCHIVE_TAR_BLOCK];
+    off_t position = 0;
+    ssize_t value;
+
+    while((value = libflist_archive_pread(archive, header, sizeof(header), position)) == sizeof(header)) {
+        size_t size = seekable_tar_size(header);
+        off_t data = position + ARCHIVE_TAR_BLOCK;
+        char *member;
+
+        // end of archive
+        if(header[0] == 0)
+            break;
+
+        position = data + ((size + ARCHIVE_TAR_BLOCK - 1) / ARCHIVE_TAR_BLOCK) * ARCHIVE_TAR_BLOCK;
+
+        // gnu long name, applies to next header
+        if(header[156] == 'L') {
+            free(longname);
+
+            if(!(longname = calloc(size + 1, 1))) {
+                libflist_errp("archive: seekable: calloc");
+                return 1;
+            }
+
+            if(libflist_archive_pread(archive, longname, size, data) != (ssize_t) size) {
+                free(longname);
+                libflist_set_error("archive: seekable: truncated long name");
+                return 1;
+            }
+
+            continue;
+        }
+
+        if(longname) {
+            member = longname;
+
+        } else {
+            // ustar prefix (gnu archives uses this area for times)
+            if(memcmp(header + 257, "ustar", 5) == 0 && header[345] && header[262] == 0) {
+                snprintf(path, sizeof(path), "%.155s/%.100s", header + 345, header);
+
+            } else {
+                snprintf(path, sizeof(path), "%.100s", header);
+            }
+
+            member = path;
+        }
+
+        if(strncmp(member, "./", 2) == 0)
+            member += 2;
+
+        if(strcmp(member, name) == 0 && (header[156] == '0' || header[156] == 0)) {
+            free(longname);
+
+            *offset = data;
+            *length = size;
+
+            return 0;
+        }
+
+        free(longname);
+        longname = NULL;
+    }
+
+    free(longname);
+
+    if(value < 0)
+        return 1;
+
+    libflist_set_error("archive: member not found: %s", name);
+    return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef LIBFLIST_ARCHIVE_SEEKABLE_H
+    #define LIBFLIST_ARCHIVE_SEEKABLE_H
+
+    #include <zstd.h>
+
+    struct flist_archive_t {
+        int fd;
+
+        size_t frames;          // amount of frames
+        off_t *compressed;      // frames offset in the file (frames + 1)
+        uint64_t *plain;        // frames offset in the plain stream (frames + 1)
+
+        ZSTD_DCtx *dctx;
+        uint8_t *input;         // compressed frame read
+        size_t inputsize;
+
+        uint8_t *frame;         // last frame uncompressed (cache)
+        size_t framesize;
+        ssize_t cached;         // index of the cached frame (-1 if none)
+
+    };
+#endif
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "archive_vfs.h"
+
+//
+// read-only sqlite vfs on top of a seekable archive
+//
+// the flist database is read from inside the archive (see archive_seekable.c),
+// sqlite pages are read from the plain tar stream, only the frames covering
+// them are uncompressed, nothing is extracted on disk
+//
+// only the main database file is served by this vfs, the database is
+// opened immutable (no journal, no lock), any other file sqlite needs
+// (temporary files) is forwarded to the default vfs
+//
+#define ARCHIVE_VFS_MEMBER  "flistdb.sqlite3"
+
+typedef struct archive_vfs_file_t {
+    sqlite3_file base;
+
+    flist_archive_t *archive;
+    off_t offset;           // database offset in the plain stream
+    size_t length;          // database length
+
+} archive_vfs_file_t;
+
+static sqlite3_vfs archive_vfs;
+static pthread_once_t archive_vfs_once = PTHREAD_ONCE_INIT;
+static int archive_vfs_registered = SQLITE_ERROR;
+
+#define ARCHIVE_VFS_PARENT  ((sqlite3_vfs *) archive_vfs.pAppData)
+
+//
+// database file
+//
+static int archive_vfs_close(sqlite3_file *file) {
+    archive_vfs_file_t *vfile = (archive_vfs_file_t *) file;
+
+    libflist_archive_close(vfile->archive);
+    vfile->archive = NULL;
+
+    return SQLITE_OK;
+}
+
+static int archive_vfs_read(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset) {
+    archive_vfs_file_t *vfile = (archive_vfs_file_t *) file;
+    size_t length = amount;
+    ssize_t value = 0;
+
+    if(offset < 0)
+        return SQLITE_IOERR_READ;
+
+    // reads are limited to the database member
+    if((uint64_t) offset < vfile->length) {
+        if(length > vfile->length - offset)
+            length = vfile->length - offset;
+
+        if((value = libflist_archive_pread(vfile->archive, buffer, length, vfile->offset + offset)) < 0) {
+            debug("[-] libflist: archive: vfs: %s\n", libflist_strerror());
+            return SQLITE_IOERR_READ;
+        }
+    }
+
+    // sqlite expects missing data to be zero-filled
+    if(value < amount) {
+        memset((uint8_t *) buffer + value, 0, amount - value);
+        return SQLITE_IOERR_SHORT_READ;
+    }
+
+    return SQLITE_OK;
+}
+
+static int archive_vfs_write(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset) {
+    (void) file;
+    (void) buffer;
+    (void) amount;
+    (void) offset;
+
+    return SQLITE_READONLY;
+}
+
+static int archive_vfs_truncate(sqlite3_file *file, sqlite3_int64 size) {
+    (void) file;
+    (void) size;
+
+    return SQLITE_READONLY;
+}
+
+static int archive_vfs_sync(sqlite3_file *file, int flags) {
+    (void) file;
+    (void) flags;
+
+    return SQLITE_OK;
+}
+
+static int archive_vfs_size(sqlite3_file *file, sqlite3_int64 *size) {
+    archive_vfs_file_t *vfile = (archive_vfs_file_t *) file;
+
+    *size = vfile->length;
+    return SQLITE_OK;
+}
+
+static int archive_vfs_lock(sqlite3_file *file, int lock) {
+    (void) file;
+    (void) lock;
+
+    return SQLITE_OK;
+}
+
+static int archive_vfs_reserved(sqlite3_file *file, int *reserved) {
+    (void) file;
+
+    *reserved = 0;
+    return SQLITE_OK;
+}
+
+static int archive_vfs_control(sqlite3_file *file, int op, void *arg) {
+    (void) file;
+    (void) op;
+    (void) arg;
+
+    return SQLITE_NOTFOUND;
+}
+
+static int archive_vfs_sector(sqlite3_file *file) {
+    (void) file;
+
+    return 512;
+}
+
+// nothing can change the archive while it's opened
+static int archive_vfs_characteristics(sqlite3_file *file) {
+    (void) file;
+
+    return SQLITE_IOCAP_IMMUTABLE;
+}
+
+static const sqlite3_io_methods archive_vfs_methods = {
+    .iVersion = 1,
+    .xClose = archive_vfs_close,
+    .xRead = archive_vfs_read,
+    .xWrite = archive_vfs_write,
+    .xTruncate = archive_vfs_truncate,
+    .xSync = archive_vfs_sync,
+    .xFileSize = archive_vfs_size,
+    .xLock = archive_vfs_lock,
+    .xUnlock = archive_vfs_lock,
+    .xCheckReservedLock = archive_vfs_reserved,
+    .xFileControl = archive_vfs_control,
+    .xSectorSize = archive_vfs_sector,
+    .xDeviceCharacteristics = archive_vfs_characteristics,
+};
+
+//
+// vfs
+//
+static int archive_vfs_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *outflags) {
+    archive_vfs_file_t *vfile = (archive_vfs_file_t *) file;
+    (void) vfs;
+
+    // temporary files (sorting, ...) are regular files
+    if(!(flags & SQLITE_OPEN_MAIN_DB))
+        return ARCHIVE_VFS_PARENT->xOpen(ARCHIVE_VFS_PARENT, name, file, flags, outflags);
+
+    memset(vfile, 0, sizeof(archive_vfs_file_t));
+
+    if(!name || (flags & SQLITE_OPEN_READWRITE))
+        return SQLITE_CANTOPEN;
+
+    if(!(vfile->archive = libflist_archive_open((char *) name)))
+        return SQLITE_CANTOPEN;
+
+    if(libflist_archive_member(vfile->archive, ARCHIVE_VFS_MEMBER, &vfile->offset, &vfile->length)) {
+        libflist_archive_close(vfile->archive);
+        vfile->archive = NULL;
+        return SQLITE_CANTOPEN;
+    }
+
+    debug("[+] libflist: archive: vfs: database found, %lu bytes\n", vfile->length);
+
+    vfile->base.pMethods = &archive_vfs_methods;
+
+    if(outflags)
+        *outflags = SQLITE_OPEN_READONLY;
+
+    return SQLITE_OK;
+}
+
+static int archive_vfs_delete(sqlite3_vfs *vfs, const char *name, int sync) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xDelete(ARCHIVE_VFS_PARENT, name, sync);
+}
+
+static int archive_vfs_access(sqlite3_vfs *vfs, const char *name, int flags, int *result) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xAccess(ARCHIVE_VFS_PARENT, name, flags, result);
+}
+
+static int archive_vfs_fullpath(sqlite3_vfs *vfs, const char *name, int length, char *output) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xFullPathname(ARCHIVE_VFS_PARENT, name, length, output);
+}
+
+static int archive_vfs_randomness(sqlite3_vfs *vfs, int length, char *output) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xRandomness(ARCHIVE_VFS_PARENT, length, output);
+}
+
+static int archive_vfs_sleep(sqlite3_vfs *vfs, int microseconds) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xSleep(ARCHIVE_VFS_PARENT, microseconds);
+}
+
+static int archive_vfs_time(sqlite3_vfs *vfs, double *now) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xCurrentTime(ARCHIVE_VFS_PARENT, now);
+}
+
+static int archive_vfs_error(sqlite3_vfs *vfs, int length, char *output) {
+    (void) vfs;
+    return ARCHIVE_VFS_PARENT->xGetLastError(ARCHIVE_VFS_PARENT, length, output);
+}
+
+static void archive_vfs_register_once() {
+    sqlite3_vfs *parent;
+
+    if(!(parent = sqlite3_vfs_find(NULL)))
+        return;
+
+    // the same file structure is used for forwarded files
+    archive_vfs.iVersion = 1;
+    archive_vfs.szOsFile = parent->szOsFile;
+    archive_vfs.mxPathname = parent->mxPathname;
+    archive_vfs.zName = ARCHIVE_VFS_NAME;
+    archive_vfs.pAppData = parent;
+
+    if(archive_vfs.szOsFile < (int) sizeof(archive_vfs_file_t))
+        archive_vfs.szOsFile = sizeof(archive_vfs_file_t);
+
+    archive_vfs.xOpen = archive_vfs_open;
+    archive_vfs.xDelete = archive_vfs_delete;
+    archive_vfs.xAccess = archive_vfs_access;
+    archive_vfs.xFullPathname = archive_vfs_fullpath;
+    archive_vfs.xRandomness = archive_vfs_randomness;
+    archive_vfs.xSleep = archive_vfs_sleep;
+    archive_vfs.xCurrentTime = archive_vfs_time;
+    archive_vfs.xGetLastError = archive_vfs_error;
+
+    archive_vfs_registered = sqlite3_vfs_register(&archive_vfs, 0);
+}
+
+// register the vfs (once), returns its name or NULL
+char *archive_vfs_register() {
+    pthread_once(&archive_vfs_once, archive_vfs_register_once);
+
+    if(archive_vfs_registered != SQLITE_OK) {
+        libflist_set_error("archive: vfs: could not register sqlite vfs");
+        return NULL;
+    }
+
+    return ARCHIVE_VFS_NAME;
+}
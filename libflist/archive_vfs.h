@@ -0,0 +1,7 @@
+#ifndef LIBFLIST_ARCHIVE_VFS_H
+    #define LIBFLIST_ARCHIVE_VFS_H
+
+    #define ARCHIVE_VFS_NAME  "flist-archive"
+
+    char *archive_vfs_register();
+#endif
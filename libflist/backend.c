@@ -13,6 +13,10 @@
 #include "database_redis.h"
 #include "database_sqlite.h"
 #include "zero_chunk.h"
+#include "backend_cache.h"
+#include "backend_known.h"
+
+#define BACKEND_UPLOAD_BATCH  256
 
 flist_backend_t *libflist_backend_init(flist_db_t *database, char *rootpath) {
     flist_backend_t *backend;
@@ -22,87 +26,213 @@ flist_backend_t *libflist_backend_init(flist_db_t *database, char *rootpath) {
 
     backend->database = database;
     backend->rootpath = rootpath;
+    backend->skipexists = 0;
+    backend->cache = NULL;
+    backend->known = NULL;
+
+    pthread_mutex_init(&backend->lock, NULL);
 
     return backend;
 }
 
-#if 0
-// FIXME: don't use global variable
-typedef struct flist_backend_t {
-    redisContext *redis;  // redis context
-    int pwrite;           // pending write
-    size_t buflen;        // buffer length
+// database handlers are not thread-safe, except pools, access
+// is serialized when the handler is not flagged concurrent
+static void backend_lock(flist_backend_t *backend) {
+    if(!backend->database->concurrent)
+        pthread_mutex_lock(&backend->lock);
+}
 
-} flist_backend_t;
+static void backend_unlock(flist_backend_t *backend) {
+    if(!backend->database->concurrent)
+        pthread_mutex_unlock(&backend->lock);
+}
 
-flist_backend_t bcontext = {
-    .redis = NULL,
-    .pwrite = 0,
-    .buflen = 0,
-};
-#endif
+// flush pending (pipelined) uploads and wait for their replies
+// returns the amount of chunks which failed to be uploaded
+size_t libflist_backend_flush(flist_backend_t *backend) {
+    flist_db_t *db = backend->database;
+    size_t failed;
 
-#if 0
-static redisContext *backend_connect(flist_backend_t *context, char *hostname, int port) {
-    debug("[+] backend: connecting (%s, %d)\n", hostname, port);
+    backend_lock(backend);
+    failed = db->flush(db);
+    backend_unlock(backend);
 
-    if(!(context->redis = redisConnect(hostname, port)))
-        diep("redisConnect");
+    if(failed > 0) {
+        debug("[-] libflist: backend: %lu chunks failed to upload\n", failed);
+        libflist_set_error("backend: %lu chunks could not be uploaded", failed);
 
-    if(context->redis->err)
-        dies(context->redis->errstr);
+        // we don't know which one failed
+        if(backend->known)
+            backend->known->tainted = 1;
+    }
 
-    return context->redis;
+    return failed;
 }
 
-void upload_free() {
-    if(bcontext.redis)
-        redisFree(bcontext.redis);
+// zero-db SET is idempotent (a duplicate key is not stored twice), on
+// such backend the existence check before uploading can be skipped to
+// save one round-trip per chunk, this is ignored on other backends
+flist_backend_t *libflist_backend_skip_exists(flist_backend_t *backend, int enabled) {
+    backend->skipexists = enabled && strcmp(backend->database->type, "ZDB") == 0;
+    debug("[+] libflist: backend: skip existence check: %s\n", backend->skipexists ? "yes" : "no");
+
+    return backend;
 }
-#endif
 
-void upload_flush(flist_backend_t *context) {
-    (void) context;
-#if 0
-    redisReply *reply;
+int libflist_backend_exists(flist_backend_t *context, flist_chunk_t *chunk) {
+    flist_db_t *db = context->database;
+    int value;
+
+    backend_lock(context);
+    value = db->exists(db, chunk->id.data, chunk->id.length);
+    backend_unlock(context);
 
-    debug("[+] upload: flushing: %d items (%.2f KB)\n", context->pwrite, context->buflen / 1024.0);
+    return value;
+}
 
-    for(int i = 0; i < context->pwrite; i++) {
-        redisGetReply(context->redis, (void **) &reply);
+// check existence of a list of chunks in one batch
+// 'exists' (optional) is filled for each chunk of the list
+// returns the amount of chunks missing on the backend, -1 on error
+ssize_t libflist_backend_chunks_exists(flist_backend_t *backend, inode_chunks_t *chunks, int *exists) {
+    flist_db_t *db = backend->database;
+    uint8_t **keys = NULL;
+    size_t *keylens = NULL;
+    int *found = exists;
+    ssize_t missing = -1;
 
-        if(reply->type == REDIS_REPLY_ERROR) {
-            fprintf(stderr, "[-] redis error: %s\n", reply->str);
-        }
+    if(chunks->size == 0)
+        return 0;
 
-        if(reply->len == 0) {
-            // if 0-db behind
-            // it's a duplicated key
-        }
+    keys = malloc(sizeof(uint8_t *) * chunks->size);
+    keylens = malloc(sizeof(size_t) * chunks->size);
 
-        freeReplyObject(reply);
+    if(!found)
+        found = malloc(sizeof(int) * chunks->size);
+
+    if(!keys || !keylens || !found) {
+        libflist_errp("backend: exists: malloc");
+        goto cleanup;
     }
 
-    context->pwrite = 0;
-    context->buflen = 0;
-#endif
-}
+    for(size_t i = 0; i < chunks->size; i++) {
+        keys[i] = chunks->list[i].entryid;
+        keylens[i] = chunks->list[i].entrylen;
+    }
 
-int libflist_backend_exists(flist_backend_t *context, flist_chunk_t *chunk) {
-    flist_db_t *db = context->database;
-    return db->exists(db, chunk->id.data, chunk->id.length);
+    backend_lock(backend);
+    int failed = db->mexists(db, keys, keylens, chunks->size, found);
+    backend_unlock(backend);
+
+    if(failed)
+        goto cleanup;
+
+    missing = 0;
+
+    for(size_t i = 0; i < chunks->size; i++)
+        if(!found[i])
+            missing += 1;
+
+cleanup:
+    if(found != exists)
+        free(found);
+
+    free(keys);
+    free(keylens);
+
+    return missing;
 }
 
 // upload a chunk on the backend
 int libflist_backend_upload_chunk(flist_backend_t *context, flist_chunk_t *chunk) {
     flist_db_t *db = context->database;
+    int value = 0;
+
+    backend_lock(context);
 
     if(db->set(db, chunk->id.data, chunk->id.length, chunk->encrypted.data, chunk->encrypted.length))
-        return 1;
+        value = 1;
+
+    backend_unlock(context);
+
+    return value;
+}
+
+// same chunk can appear more than once on the same batch (eg: blocks of
+// zero), it's only uploaded once
+static int backend_key_duplicate(uint8_t **keys, size_t *keylens, size_t length, uint8_t *key, size_t keylen) {
+    for(size_t i = 0; i < length; i++)
+        if(keylens[i] == keylen && memcmp(keys[i], key, keylen) == 0)
+            return 1;
 
     return 0;
 }
 
+// upload the chunks of the list which are not already on the backend,
+// existence is checked with one batch, missing chunks are uploaded
+// with one batch (synchronously)
+static int backend_upload_missing(flist_backend_t *context, flist_chunk_t **list, size_t count) {
+    flist_db_t *db = context->database;
+    uint8_t **keys, **payloads;
+    size_t *keylens, *lengths;
+    size_t missing = 0;
+    int *exists;
+    int value = 1;
+
+    if(count == 0)
+        return 0;
+
+    keys = malloc(sizeof(uint8_t *) * count);
+    keylens = malloc(sizeof(size_t) * count);
+    payloads = malloc(sizeof(uint8_t *) * count);
+    lengths = malloc(sizeof(size_t) * count);
+    exists = malloc(sizeof(int) * count);
+
+    if(!keys || !keylens || !payloads || !lengths || !exists) {
+        libflist_errp("backend: upload: malloc");
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        keys[i] = list[i]->id.data;
+        keylens[i] = list[i]->id.length;
+    }
+
+    backend_lock(context);
+
+    if(db->mexists(db, keys, keylens, count, exists))
+        goto unlock;
+
+    for(size_t i = 0; i < count; i++) {
+        if(exists[i] || backend_key_duplicate(keys, keylens, missing, list[i]->id.data, list[i]->id.length)) {
+            debug("[+] processing: chunk already on the backend, skipping\n");
+            continue;
+        }
+
+        keys[missing] = list[i]->id.data;
+        keylens[missing] = list[i]->id.length;
+        payloads[missing] = list[i]->encrypted.data;
+        lengths[missing] = list[i]->encrypted.length;
+        missing += 1;
+    }
+
+    if(missing && db->mset(db, keys, keylens, payloads, lengths, missing))
+        goto unlock;
+
+    value = 0;
+
+unlock:
+    backend_unlock(context);
+
+cleanup:
+    free(keys);
+    free(keylens);
+    free(payloads);
+    free(lengths);
+    free(exists);
+
+    return value;
+}
+
 flist_chunks_t *libflist_backend_upload_file(flist_backend_t *context, char *filename) {
     buffer_t *buffer;
     flist_chunks_t *chunks;
@@ -134,21 +264,23 @@ flist_chunks_t *libflist_backend_upload_file(flist_backend_t *context, char *fil
 
         chunks->chunks[i] = chunk;
         chunks->upsize += chunk->encrypted.length;
+    }
 
-        // check if chunk is already on the backend
-        if(libflist_backend_exists(context, chunk)) {
-            debug("[+] processing: chunk already on the backend, skipping\n");
+    // uploading chunks not already on the backend, by batches
+    for(size_t i = 0; i < chunks->length; i += BACKEND_UPLOAD_BATCH) {
+        size_t count = chunks->length - i;
+
+        if(count > BACKEND_UPLOAD_BATCH)
+            count = BACKEND_UPLOAD_BATCH;
+
+        if(!backend_upload_missing(context, chunks->chunks + i, count))
             continue;
-        }
 
-        // hiredis upload
-        if(libflist_backend_upload_chunk(context, chunk)) {
-            debug("[-] chunk_upload: %s\n", libflist_strerror());
+        debug("[-] chunk_upload: %s\n", libflist_strerror());
 
-            libflist_chunk_free(chunk);
-            chunks = NULL;
-            goto cleanup;
-        }
+        libflist_backend_chunks_free(chunks);
+        chunks = NULL;
+        goto cleanup;
     }
 
     debug("[+] finalsize: %lu bytes\n", chunks->upsize);
@@ -160,24 +292,141 @@ cleanup:
     return chunks;
 }
 
+// returns 1 if the chunk (only id is used) is known or confirmed
+// to be on the backend, 0 if it's missing or can't be confirmed
+// (existence check disabled)
+int libflist_backend_chunk_present(flist_backend_t *context, flist_chunk_t *chunk) {
+    // chunk already known to be on the backend
+    if(context->known && backend_known_contains(context->known, chunk->id.data))
+        return 1;
+
+    if(context->skipexists || !libflist_backend_exists(context, chunk))
+        return 0;
+
+    if(context->known)
+        backend_known_add(context->known, chunk->id.data);
+
+    return 1;
+}
+
 // check if the chunk is already on the backend
 // if it's not on the backend, uploading it
+//
+// upload is pipelined (write-behind), an error on the upload itself
+// is only reported by libflist_backend_flush
+//
+// this can be called from multiple chunks workers at the same time
 int libflist_backend_chunk_commit(flist_backend_t *context, flist_chunk_t *chunk) {
-    // check if chunk is already on the backend
-    if(libflist_backend_exists(context, chunk)) {
+    flist_db_t *db = context->database;
+    int value = 1;
+
+    if(libflist_backend_chunk_present(context, chunk)) {
         debug("[+] libflist: backend: chunk already on the backend, skipping\n");
         return 0;
     }
 
     debug("[+] libflist: backend: uploading chunk (%lu bytes)\n", chunk->encrypted.length);
 
+    backend_lock(context);
+
     // backend upload
-    if(libflist_backend_upload_chunk(context, chunk)) {
+    if(db->pset(db, chunk->id.data, chunk->id.length, chunk->encrypted.data, chunk->encrypted.length)) {
         debug("[-] libflist: backend: chunk: upload: %s\n", libflist_strerror());
-        return -1;
+        value = -1;
     }
 
-    return 1;
+    backend_unlock(context);
+
+    if(value > 0 && context->known)
+        backend_known_add(context->known, chunk->id.data);
+
+    return value;
+}
+
+// commit a batch of chunks (see libflist_backend_chunk_commit), chunks
+// not known yet are checked on the backend with one batch request,
+// missing ones are uploaded (pipelined)
+//
+// returns 0 on success, -1 if an upload could not be queued
+int libflist_backend_chunks_commit(flist_backend_t *context, flist_chunk_t **chunks, size_t count) {
+    flist_db_t *db = context->database;
+    flist_chunk_t **unknown;
+    uint8_t **keys;
+    size_t *keylens;
+    int *exists;
+    size_t length = 0;
+    int value = -1;
+
+    unknown = malloc(sizeof(flist_chunk_t *) * count);
+    keys = malloc(sizeof(uint8_t *) * count);
+    keylens = malloc(sizeof(size_t) * count);
+    exists = calloc(sizeof(int), count);
+
+    if(!unknown || !keys || !keylens || !exists) {
+        libflist_errp("backend: commit: malloc");
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        // chunk already known to be on the backend
+        if(context->known && backend_known_contains(context->known, chunks[i]->id.data)) {
+            debug("[+] libflist: backend: chunk already on the backend, skipping\n");
+            continue;
+        }
+
+        if(backend_key_duplicate(keys, keylens, length, chunks[i]->id.data, chunks[i]->id.length)) {
+            debug("[+] libflist: backend: chunk already on the backend, skipping\n");
+            continue;
+        }
+
+        unknown[length] = chunks[i];
+        keys[length] = chunks[i]->id.data;
+        keylens[length] = chunks[i]->id.length;
+        length += 1;
+    }
+
+    backend_lock(context);
+
+    // on failure, the existence can't be confirmed, chunks are uploaded
+    if(length && !context->skipexists && db->mexists(db, keys, keylens, length, exists)) {
+        debug("[-] libflist: backend: exists: %s\n", libflist_strerror());
+        memset(exists, 0, sizeof(int) * length);
+    }
+
+    for(size_t i = 0; i < length; i++) {
+        flist_chunk_t *chunk = unknown[i];
+
+        if(exists[i]) {
+            debug("[+] libflist: backend: chunk already on the backend, skipping\n");
+            continue;
+        }
+
+        debug("[+] libflist: backend: uploading chunk (%lu bytes)\n", chunk->encrypted.length);
+
+        // backend upload
+        if(db->pset(db, chunk->id.data, chunk->id.length, chunk->encrypted.data, chunk->encrypted.length)) {
+            debug("[-] libflist: backend: chunk: upload: %s\n", libflist_strerror());
+            backend_unlock(context);
+            goto cleanup;
+        }
+    }
+
+    backend_unlock(context);
+
+    // uploaded (or confirmed) chunks are now known
+    if(context->known)
+        for(size_t i = 0; i < length; i++)
+            backend_known_add(context->known, unknown[i]->id.data);
+
+    value = 0;
+
+cleanup:
+    free(unknown);
+    free(keys);
+    free(keylens);
+    free(exists);
+
+    return value;
 }
 
 void libflist_backend_chunks_free(flist_chunks_t *chunks) {
@@ -210,30 +459,82 @@ flist_chunk_t *libflist_backend_download_chunk(flist_backend_t *backend, flist_c
         free(key);
     }
 
+    // value can be owned by the database handler until it's cleaned
+    // (eg: sqlite statement), lock is kept during the whole decryption
+    backend_lock(backend);
+
     if(!(value = db->get(db, chunk->id.data, chunk->id.length))) {
         libflist_set_error("key not found on the backend");
+        backend_unlock(backend);
         return NULL;
     }
 
     chunk->encrypted.data = (uint8_t *) value->data;
     chunk->encrypted.length = value->length;
 
-    if(!libflist_chunk_decrypt(chunk))
-        return NULL;
+    flist_chunk_t *decrypted = libflist_chunk_decrypt(chunk);
 
     // clear the downloaded data not needed anymore
+    // (owned by the database value)
     chunk->encrypted.data = NULL;
     chunk->encrypted.length = 0;
+
     db->clean(value);
+    backend_unlock(backend);
 
-    return chunk;
+    return decrypted;
 }
 
-void upload_inode_flush() {
-    // upload_flush(&bcontext);
+// download a chunk and uncrypt it directly into 'target' (which can hold
+// 'length' bytes, eg: a slice of a mapped file), the encrypted payload is
+// decrypted from the database reply, no plain buffer is allocated
+//
+// returns the plain length, -1 on error
+ssize_t libflist_backend_download_chunk_into(flist_backend_t *backend, flist_chunk_t *chunk, void *target, size_t length) {
+    flist_db_t *db = backend->database;
+    value_t *value;
+    ssize_t plain;
+
+    if(libflist_debug_flag) {
+        char *key = libflist_hashhex(chunk->id.data, chunk->id.length);
+        debug("[+] backend: downloading chunk: %s (direct)\n", key);
+        free(key);
+    }
+
+    backend_lock(backend);
+
+    if(!(value = db->get(db, chunk->id.data, chunk->id.length))) {
+        libflist_set_error("key not found on the backend");
+        backend_unlock(backend);
+        return -1;
+    }
+
+    chunk->encrypted.data = (uint8_t *) value->data;
+    chunk->encrypted.length = value->length;
+
+    plain = libflist_chunk_decrypt_into(chunk, target, length);
+
+    // owned by the database value
+    chunk->encrypted.data = NULL;
+    chunk->encrypted.length = 0;
+
+    db->clean(value);
+    backend_unlock(backend);
+
+    return plain;
 }
 
 void libflist_backend_free(flist_backend_t *backend) {
+    libflist_backend_flush(backend);
+
+    if(backend->cache)
+        backend_cache_free(backend->cache);
+
+    // saving known chunks, after pending uploads
+    if(backend->known)
+        backend_known_free(backend->known);
+
     backend->database->close(backend->database);
+    pthread_mutex_destroy(&backend->lock);
     free(backend);
 }
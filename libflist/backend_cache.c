@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+#include "backend_cache.h"
+
+//
+// decrypted chunks cache
+//
+// keeps recently used plain (decrypted and uncompressed) chunks in
+// memory, chunks are borrowed by callers (refcounted handles) and
+// released when not needed anymore, a borrowed chunk is never evicted
+//
+// when multiple threads request the same missing chunk, only the
+// first one fetches it, the others wait for it to be available
+//
+#define CACHE_BUCKETS  4096
+
+static uint32_t backend_cache_hash(uint8_t *key) {
+    uint32_t hash;
+
+    // keys are already hashes
+    memcpy(&hash, key, sizeof(hash));
+
+    return hash & (CACHE_BUCKETS - 1);
+}
+
+static backend_cache_entry_t *backend_cache_find(flist_backend_cache_t *cache, uint8_t *key) {
+    backend_cache_entry_t *entry = cache->buckets[backend_cache_hash(key)];
+
+    for(; entry; entry = entry->hnext)
+        if(memcmp(entry->chunk->id.data, key, ZEROCHUNK_HASH_LENGTH) == 0)
+            return entry;
+
+    return NULL;
+}
+
+static void backend_cache_unhash(flist_backend_cache_t *cache, backend_cache_entry_t *entry) {
+    backend_cache_entry_t **link = &cache->buckets[backend_cache_hash(entry->chunk->id.data)];
+
+    while(*link != entry)
+        link = &(*link)->hnext;
+
+    *link = entry->hnext;
+}
+
+static void backend_cache_lru_remove(flist_backend_cache_t *cache, backend_cache_entry_t *entry) {
+    if(entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+
+    if(entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void backend_cache_lru_push(flist_backend_cache_t *cache, backend_cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+
+    if(cache->head)
+        cache->head->prev = entry;
+
+    cache->head = entry;
+
+    if(!cache->tail)
+        cache->tail = entry;
+}
+
+static void backend_cache_entry_free(backend_cache_entry_t *entry) {
+    libflist_chunk_free(entry->chunk);
+    free(entry->error);
+    free(entry);
+}
+
+// evict least recently used chunks not borrowed
+// needs to be called with the lock held
+static void backend_cache_evict(flist_backend_cache_t *cache) {
+    backend_cache_entry_t *entry = cache->tail;
+
+    while(entry && cache->size > cache->maxsize) {
+        backend_cache_entry_t *prev = entry->prev;
+
+        if(entry->refs == 0) {
+            backend_cache_lru_remove(cache, entry);
+            backend_cache_unhash(cache, entry);
+
+            cache->size -= entry->chunk->plain.length;
+            backend_cache_entry_free(entry);
+        }
+
+        entry = prev;
+    }
+}
+
+flist_backend_cache_t *backend_cache_new(size_t maxsize) {
+    flist_backend_cache_t *cache;
+
+    if(!(cache = calloc(sizeof(flist_backend_cache_t), 1)))
+        return libflist_errp("backend: cache: calloc");
+
+    if(!(cache->buckets = calloc(sizeof(backend_cache_entry_t *), CACHE_BUCKETS))) {
+        free(cache);
+        return libflist_errp("backend: cache: calloc");
+    }
+
+    cache->maxsize = maxsize;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+
+    return cache;
+}
+
+// all chunks needs to be released, chunks still being fetched
+// (not yet on the lru list) are waited for, then released
+void backend_cache_free(flist_backend_cache_t *cache) {
+    pthread_mutex_lock(&cache->lock);
+
+    while(cache->loading)
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+
+    pthread_mutex_unlock(&cache->lock);
+
+    // every indexed entry, whatever its state
+    for(size_t i = 0; i < CACHE_BUCKETS; i++) {
+        backend_cache_entry_t *entry = cache->buckets[i];
+
+        while(entry) {
+            backend_cache_entry_t *next = entry->hnext;
+            backend_cache_entry_free(entry);
+            entry = next;
+        }
+    }
+
+    pthread_cond_destroy(&cache->loaded);
+    pthread_mutex_destroy(&cache->lock);
+
+    free(cache->buckets);
+    free(cache);
+}
+
+//
+// public interface
+//
+
+// enable a cache of 'maxsize' bytes of decrypted chunks on the backend
+// this needs to be set before any chunk is acquired
+flist_backend_t *libflist_backend_cache(flist_backend_t *backend, size_t maxsize) {
+    if(backend->cache)
+        backend_cache_free(backend->cache);
+
+    if(!(backend->cache = backend_cache_new(maxsize)))
+        return NULL;
+
+    debug("[+] libflist: backend: chunks cache: %.2f MB\n", maxsize / (1024 * 1024.0));
+
+    return backend;
+}
+
+// borrow the decrypted chunk 'id', from the cache if available or
+// fetched from the backend otherwise, returned chunk is read-only
+// and needs to be released using libflist_backend_chunk_release
+flist_chunk_t *libflist_backend_chunk_acquire(flist_backend_t *backend, uint8_t *id, uint8_t *cipher, uint16_t codec) {
+    flist_backend_cache_t *cache = backend->cache;
+    backend_cache_entry_t *entry;
+    flist_chunk_t *chunk;
+
+    // no cache, plain download
+    if(!cache) {
+        if(!(chunk = libflist_chunk_new(id, cipher, NULL, 0)))
+            return NULL;
+
+        chunk->codec = codec;
+
+        if(!libflist_backend_download_chunk(backend, chunk)) {
+            libflist_chunk_free(chunk);
+            return NULL;
+        }
+
+        return chunk;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    if((entry = backend_cache_find(cache, id))) {
+        entry->refs += 1;
+
+        // another thread is fetching it
+        while(entry->state == CACHE_LOADING)
+            pthread_cond_wait(&cache->loaded, &cache->lock);
+
+        if(entry->state == CACHE_FAILED) {
+            libflist_set_error("%s", entry->error);
+
+            if(--entry->refs == 0)
+                backend_cache_entry_free(entry);
+
+            pthread_mutex_unlock(&cache->lock);
+            return NULL;
+        }
+
+        // most recently used
+        backend_cache_lru_remove(cache, entry);
+        backend_cache_lru_push(cache, entry);
+
+        pthread_mutex_unlock(&cache->lock);
+
+        return entry->chunk;
+    }
+
+    // not cached, this thread fetch it
+    if(!(entry = calloc(sizeof(backend_cache_entry_t), 1)) || !(entry->chunk = libflist_chunk_new(id, cipher, NULL, 0))) {
+        pthread_mutex_unlock(&cache->lock);
+        free(entry);
+        return libflist_errp("backend: cache: calloc");
+    }
+
+    uint32_t bucket = backend_cache_hash(id);
+
+    entry->chunk->codec = codec;
+
+    entry->state = CACHE_LOADING;
+    entry->refs = 1;
+    entry->hnext = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache->loading += 1;
+
+    pthread_mutex_unlock(&cache->lock);
+
+    chunk = libflist_backend_download_chunk(backend, entry->chunk);
+
+    pthread_mutex_lock(&cache->lock);
+
+    cache->loading -= 1;
+
+    if(!chunk) {
+        // waiting threads get the same error, next
+        // request will try to fetch it again
+        entry->state = CACHE_FAILED;
+        entry->error = strdup(libflist_strerror());
+        backend_cache_unhash(cache, entry);
+
+        if(--entry->refs == 0)
+            backend_cache_entry_free(entry);
+
+    } else {
+        entry->state = CACHE_READY;
+        cache->size += entry->chunk->plain.length;
+
+        backend_cache_lru_push(cache, entry);
+        backend_cache_evict(cache);
+    }
+
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->lock);
+
+    return chunk;
+}
+
+void libflist_backend_chunk_release(flist_backend_t *backend, flist_chunk_t *chunk) {
+    flist_backend_cache_t *cache = backend->cache;
+    backend_cache_entry_t *entry;
+
+    if(!cache) {
+        libflist_chunk_free(chunk);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    // a borrowed chunk is always indexed
+    if((entry = backend_cache_find(cache, chunk->id.data)) && entry->chunk == chunk) {
+        entry->refs -= 1;
+        backend_cache_evict(cache);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,40 @@
+#ifndef LIBFLIST_BACKEND_CACHE_H
+    #define LIBFLIST_BACKEND_CACHE_H
+
+    typedef enum backend_cache_state_t {
+        CACHE_LOADING,      // chunk is being fetched
+        CACHE_READY,        // chunk is available
+        CACHE_FAILED,       // chunk could not be fetched
+
+    } backend_cache_state_t;
+
+    // one decrypted chunk
+    typedef struct backend_cache_entry_t {
+        flist_chunk_t *chunk;
+        backend_cache_state_t state;
+        size_t refs;        // amount of handles borrowed
+        char *error;        // fetch error message (failed)
+
+        struct backend_cache_entry_t *hnext;  // next entry on the same bucket
+        struct backend_cache_entry_t *prev;   // lru list (most recent first)
+        struct backend_cache_entry_t *next;
+
+    } backend_cache_entry_t;
+
+    typedef struct flist_backend_cache_t {
+        backend_cache_entry_t **buckets;
+        backend_cache_entry_t *head;    // most recently used
+        backend_cache_entry_t *tail;    // least recently used
+
+        size_t size;        // plain bytes currently cached
+        size_t maxsize;     // maximum plain bytes cached
+        size_t loading;     // chunks being fetched
+
+        pthread_mutex_t lock;
+        pthread_cond_t loaded;
+
+    } flist_backend_cache_t;
+
+    flist_backend_cache_t *backend_cache_new(size_t maxsize);
+    void backend_cache_free(flist_backend_cache_t *cache);
+#endif
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+#include "backend_known.h"
+
+//
+// known chunks
+//
+// keeps track of chunks confirmed present on a backend (found by
+// an existence check, or uploaded), to avoid asking the backend again
+//
+// chunks confirmed during this run are always trusted, chunks known
+// from previous runs (persistent index, one file per backend identity)
+// are trusted or only used as hint, according to the policy:
+//  - trust: chunk is not checked again (backend is never cleaned)
+//  - verify: chunk existence is still checked on the backend
+//
+// persistent index is updated when the backend is released
+//
+
+// returns 1 if the chunk can be skipped without asking the backend
+int backend_known_contains(flist_backend_known_t *known, uint8_t *id) {
+    int value = 0;
+
+    pthread_mutex_lock(&known->lock);
+
+    if(flist_table_lookup(known->session, id))
+        value = 1;
+
+    if(!value && known->policy == FLIST_KNOWN_TRUST && known->persistent)
+        value = (flist_table_lookup(known->persistent, id) != NULL);
+
+    pthread_mutex_unlock(&known->lock);
+
+    return value;
+}
+
+void backend_known_add(flist_backend_known_t *known, uint8_t *id) {
+    pthread_mutex_lock(&known->lock);
+
+    if(flist_table_insert(known->session, id, NULL))
+        debug("[-] libflist: known: could not record chunk\n");
+
+    pthread_mutex_unlock(&known->lock);
+}
+
+void backend_known_free(flist_backend_known_t *known) {
+    if(known->tainted) {
+        debug("[-] libflist: known: some upload failed, index not updated\n");
+
+    } else if(known->session->count > 0) {
+        debug("[+] libflist: known: saving %lu chunks\n", known->session->count);
+
+        if(flist_table_merge(known->filename, known->session))
+            debug("[-] libflist: known: could not update index\n");
+    }
+
+    if(known->persistent)
+        flist_table_free(known->persistent);
+
+    flist_table_free(known->session);
+    pthread_mutex_destroy(&known->lock);
+
+    free(known->filename);
+    free(known);
+}
+
+//
+// public interface
+//
+
+// keep track of chunks present on the backend, persistent index is
+// stored on 'directory', in a file named after backend 'identity'
+// (see libflist_metadata_backend_identity)
+flist_backend_t *libflist_backend_known_chunks(flist_backend_t *backend, char *directory, char *identity, flist_known_policy_t policy) {
+    flist_backend_known_t *known;
+
+    if(mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        libflist_set_error("known: %s: %s", directory, strerror(errno));
+        return NULL;
+    }
+
+    if(!(known = calloc(sizeof(flist_backend_known_t), 1)))
+        return libflist_errp("known: calloc");
+
+    uint8_t *hash = libflist_chunk_hash(identity, strlen(identity));
+    char *hexhash = libflist_hashhex(hash, ZEROCHUNK_HASH_LENGTH);
+
+    if(asprintf(&known->filename, "%s/%s.idx", directory, hexhash) < 0)
+        known->filename = NULL;
+
+    free(hexhash);
+    free(hash);
+
+    if(!known->filename || !(known->session = flist_table_new(ZEROCHUNK_HASH_LENGTH, 0))) {
+        free(known->filename);
+        free(known);
+        return NULL;
+    }
+
+    known->policy = policy;
+    known->persistent = flist_table_open(known->filename, ZEROCHUNK_HASH_LENGTH, 0);
+
+    pthread_mutex_init(&known->lock, NULL);
+
+    debug("[+] libflist: known: %s (%s), %lu chunks\n", known->filename,
+          policy == FLIST_KNOWN_TRUST ? "trust" : "verify",
+          known->persistent ? known->persistent->count : 0);
+
+    if(backend->known)
+        backend_known_free(backend->known);
+
+    backend->known = known;
+
+    return backend;
+}
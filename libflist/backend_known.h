@@ -0,0 +1,20 @@
+#ifndef LIBFLIST_BACKEND_KNOWN_H
+    #define LIBFLIST_BACKEND_KNOWN_H
+
+    #include "flist_table.h"
+
+    typedef struct flist_backend_known_t {
+        char *filename;             // persistent index file
+        flist_table_t *persistent;  // chunks known from previous runs (can be NULL)
+        flist_table_t *session;     // chunks confirmed during this run
+        flist_known_policy_t policy;
+        int tainted;                // some upload failed, session is not saved
+
+        pthread_mutex_t lock;
+
+    } flist_backend_known_t;
+
+    int backend_known_contains(flist_backend_known_t *known, uint8_t *id);
+    void backend_known_add(flist_backend_known_t *known, uint8_t *id);
+    void backend_known_free(flist_backend_known_t *known);
+#endif
@@ -0,0 +1,818 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_cache.h"
+
+//
+// local disk cache
+//
+// this database wraps another one (usually a remote backend) and
+// keeps a copy of fetched objects on local disk, further requests
+// are served from disk without reaching the source database
+//
+// objects are stored as file named by their hex key, sharded on two
+// levels of directories (eg: root/ab/cd/abcd...), the index of cached
+// objects is kept in memory (rebuilt from disk on init), and objects
+// are evicted (CLOCK algorithm) when the cache reach its maximum size
+//
+// the cache can be used by multiple threads, disk access is done
+// without lock, access to the source is serialized if the source
+// is not concurrent itself
+//
+#define CACHE_BUCKETS  (1 << 16)
+
+static uint32_t database_cache_hash(uint8_t *key, size_t keylen) {
+    uint32_t hash = 2166136261;
+
+    // fnv-1a
+    for(size_t i = 0; i < keylen; i++) {
+        hash ^= key[i];
+        hash *= 16777619;
+    }
+
+    return hash & (CACHE_BUCKETS - 1);
+}
+
+static char *database_cache_path(database_cache_t *cache, uint8_t *key, size_t keylen) {
+    char *hexkey = libflist_hashhex(key, keylen);
+    char *path;
+
+    // keys shorter than two bytes are not sharded
+    if(keylen < 2) {
+        if(asprintf(&path, "%s/%s", cache->root, hexkey) < 0)
+            path = NULL;
+
+    } else {
+        if(asprintf(&path, "%s/%.2s/%.2s/%s", cache->root, hexkey, hexkey + 2, hexkey) < 0)
+            path = NULL;
+    }
+
+    free(hexkey);
+
+    return path;
+}
+
+//
+// index
+//
+static ssize_t database_cache_find(database_cache_t *cache, uint8_t *key, size_t keylen) {
+    ssize_t index = cache->buckets[database_cache_hash(key, keylen)];
+
+    while(index >= 0) {
+        database_cache_entry_t *entry = &cache->entries[index];
+
+        if(entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0)
+            return index;
+
+        index = entry->next;
+    }
+
+    return -1;
+}
+
+static void database_cache_unlink(database_cache_t *cache, ssize_t index) {
+    database_cache_entry_t *entry = &cache->entries[index];
+    uint32_t bucket = database_cache_hash(entry->key, entry->keylen);
+    ssize_t *link = &cache->buckets[bucket];
+
+    while(*link != index)
+        link = &cache->entries[*link].next;
+
+    *link = entry->next;
+}
+
+// remove an object from disk and from the index
+// needs to be called with the index lock held
+static void database_cache_remove(database_cache_t *cache, ssize_t index) {
+    database_cache_entry_t *entry = &cache->entries[index];
+    char *path = database_cache_path(cache, entry->key, entry->keylen);
+
+    if(path && unlink(path) < 0)
+        debug("[-] libflist: cache: unlink: %s: %s\n", path, strerror(errno));
+
+    free(path);
+
+    database_cache_unlink(cache, index);
+
+    cache->size -= entry->length;
+    cache->length -= 1;
+
+    entry->used = 0;
+    entry->next = cache->freelist;
+    cache->freelist = index;
+}
+
+// evict entries until 'needed' bytes fit in the cache
+// needs to be called with the index lock held
+static void database_cache_evict(database_cache_t *cache, size_t needed) {
+    while(cache->size + needed > cache->maxsize && cache->length > 0) {
+        database_cache_entry_t *entry = &cache->entries[cache->hand];
+        ssize_t index = cache->hand;
+
+        cache->hand = (cache->hand + 1) % cache->allocated;
+
+        if(!entry->used)
+            continue;
+
+        // second chance
+        if(entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+
+        database_cache_remove(cache, index);
+    }
+}
+
+// needs to be called with the index lock held
+static int database_cache_insert(database_cache_t *cache, uint8_t *key, size_t keylen, size_t length) {
+    database_cache_entry_t *entry;
+    ssize_t index;
+
+    // could be inserted by another thread meanwhile
+    if(database_cache_find(cache, key, keylen) >= 0)
+        return 0;
+
+    if(cache->freelist < 0) {
+        size_t allocated = cache->allocated ? cache->allocated * 2 : 1024;
+        database_cache_entry_t *entries;
+
+        if(!(entries = realloc(cache->entries, sizeof(database_cache_entry_t) * allocated)))
+            return 1;
+
+        // chaining new free slots
+        for(size_t i = cache->allocated; i < allocated; i++) {
+            entries[i].used = 0;
+            entries[i].next = (i + 1 < allocated) ? (ssize_t) i + 1 : -1;
+        }
+
+        cache->freelist = cache->allocated;
+        cache->entries = entries;
+        cache->allocated = allocated;
+    }
+
+    index = cache->freelist;
+    entry = &cache->entries[index];
+    cache->freelist = entry->next;
+
+    memcpy(entry->key, key, keylen);
+    entry->keylen = keylen;
+    entry->length = length;
+    entry->referenced = 1;
+    entry->used = 1;
+
+    uint32_t bucket = database_cache_hash(key, keylen);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = index;
+
+    cache->size += length;
+    cache->length += 1;
+
+    return 0;
+}
+
+// check if an object is cached, and mark it as recently used
+static int database_cache_lookup(database_cache_t *cache, uint8_t *key, size_t keylen) {
+    ssize_t index;
+
+    if(keylen > CACHE_KEY_MAXLEN)
+        return 0;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if((index = database_cache_find(cache, key, keylen)) >= 0)
+        cache->entries[index].referenced = 1;
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return (index >= 0);
+}
+
+//
+// disk
+//
+static value_t *database_cache_read(database_cache_t *cache, uint8_t *key, size_t keylen) {
+    value_t *value = NULL;
+    struct stat st;
+    char *path;
+    int fd;
+
+    if(!(path = database_cache_path(cache, key, keylen)))
+        return NULL;
+
+    // object could have been evicted meanwhile
+    fd = open(path, O_RDONLY);
+    free(path);
+
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) < 0)
+        goto cleanup;
+
+    if(!(value = calloc(sizeof(value_t), 1)))
+        goto cleanup;
+
+    if(!(value->data = malloc(st.st_size + 1))) {
+        free(value);
+        value = NULL;
+        goto cleanup;
+    }
+
+    value->length = st.st_size;
+
+    for(size_t done = 0; done < value->length; ) {
+        ssize_t length = read(fd, value->data + done, value->length - done);
+
+        if(length < 0 && errno == EINTR)
+            continue;
+
+        if(length <= 0) {
+            free(value->data);
+            free(value);
+            value = NULL;
+            goto cleanup;
+        }
+
+        done += length;
+    }
+
+    value->handler = value->data;
+
+cleanup:
+    close(fd);
+    return value;
+}
+
+static int database_cache_mkdirs(database_cache_t *cache, char *path) {
+    char *sep = path + strlen(cache->root);
+
+    // creating shards directories
+    while((sep = strchr(sep + 1, '/'))) {
+        *sep = '\0';
+
+        if(mkdir(path, 0755) < 0 && errno != EEXIST) {
+            *sep = '/';
+            return 1;
+        }
+
+        *sep = '/';
+    }
+
+    return 0;
+}
+
+// write object on disk, object is written on a temporary file
+// and renamed, a partial object can't be read
+static int database_cache_write(database_cache_t *cache, uint8_t *key, size_t keylen, char *data, size_t length) {
+    char *path, *temp;
+    int fd, value = 1;
+
+    if(!(path = database_cache_path(cache, key, keylen)))
+        return 1;
+
+    if(asprintf(&temp, "%s.XXXXXX", path) < 0) {
+        free(path);
+        return 1;
+    }
+
+    if((fd = mkstemp(temp)) < 0) {
+        // template is modified by mkstemp, even on failure
+        strcpy(temp + strlen(path) + 1, "XXXXXX");
+
+        if(database_cache_mkdirs(cache, temp) || (fd = mkstemp(temp)) < 0) {
+            debug("[-] libflist: cache: %s: %s\n", temp, strerror(errno));
+            goto cleanup;
+        }
+    }
+
+    for(size_t done = 0; done < length; ) {
+        ssize_t written = write(fd, data + done, length - done);
+
+        if(written < 0 && errno == EINTR)
+            continue;
+
+        if(written <= 0) {
+            close(fd);
+            unlink(temp);
+            goto cleanup;
+        }
+
+        done += written;
+    }
+
+    close(fd);
+
+    if(rename(temp, path) < 0) {
+        unlink(temp);
+        goto cleanup;
+    }
+
+    value = 0;
+
+cleanup:
+    free(temp);
+    free(path);
+
+    return value;
+}
+
+static void database_cache_store(database_cache_t *cache, uint8_t *key, size_t keylen, char *data, size_t length) {
+    if(keylen > CACHE_KEY_MAXLEN || length > cache->maxsize)
+        return;
+
+    // making room first, cache size is never exceeded
+    pthread_mutex_lock(&cache->lock);
+    database_cache_evict(cache, length);
+    pthread_mutex_unlock(&cache->lock);
+
+    if(database_cache_write(cache, key, keylen, data, length))
+        return;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if(database_cache_insert(cache, key, keylen, length))
+        debug("[-] libflist: cache: could not index object\n");
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// parse a file name as an hex key, returns 0 if it's not a valid key
+static int database_cache_hexkey(const char *name, uint8_t *key, size_t hexlen) {
+    if(hexlen == 0 || hexlen % 2 || hexlen / 2 > CACHE_KEY_MAXLEN)
+        return 0;
+
+    for(size_t i = 0; i < hexlen; i++)
+        if(!isxdigit((unsigned char) name[i]))
+            return 0;
+
+    for(size_t i = 0; i < hexlen / 2; i++)
+        if(sscanf(name + (i * 2), "%2hhx", &key[i]) != 1)
+            return 0;
+
+    return 1;
+}
+
+// rebuilding index from files already on disk
+static void database_cache_load(database_cache_t *cache, char *path, int depth) {
+    struct dirent *ep;
+    DIR *dp;
+
+    if(!(dp = opendir(path)))
+        return;
+
+    while((ep = readdir(dp))) {
+        char *fullpath;
+        struct stat st;
+
+        if(ep->d_name[0] == '.')
+            continue;
+
+        if(asprintf(&fullpath, "%s/%s", path, ep->d_name) < 0)
+            break;
+
+        if(depth < 2) {
+            database_cache_load(cache, fullpath, depth + 1);
+            free(fullpath);
+            continue;
+        }
+
+        size_t hexlen = strlen(ep->d_name);
+        uint8_t key[CACHE_KEY_MAXLEN];
+        char *expected;
+
+        // skipping temporary or unexpected files
+        if(!database_cache_hexkey(ep->d_name, key, hexlen) || stat(fullpath, &st) < 0) {
+            free(fullpath);
+            continue;
+        }
+
+        // the file needs to be where its key is stored, otherwise
+        // eviction would not remove it (cache root is not trusted)
+        if(!(expected = database_cache_path(cache, key, hexlen / 2)) || strcmp(expected, fullpath) != 0) {
+            debug("[-] libflist: cache: skipping misplaced object: %s\n", fullpath);
+            free(expected);
+            free(fullpath);
+            continue;
+        }
+
+        database_cache_insert(cache, key, hexlen / 2, st.st_size);
+        free(expected);
+        free(fullpath);
+    }
+
+    closedir(dp);
+}
+
+//
+// database interface
+//
+static value_t *database_cache_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    value_t *value, *remote;
+
+    if(database_cache_lookup(cache, key, keylen)) {
+        if((value = database_cache_read(cache, key, keylen)))
+            return value;
+    }
+
+    if(!(value = calloc(sizeof(value_t), 1)))
+        return libflist_errp("cache: get: calloc");
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    if((remote = source->get(source, key, keylen)) && remote->data) {
+        // keep our own copy, value is owned by the source
+        if((value->data = malloc(remote->length + 1))) {
+            memcpy(value->data, remote->data, remote->length);
+            value->length = remote->length;
+        }
+    }
+
+    if(remote)
+        source->clean(remote);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    if(!value->data) {
+        free(value);
+        return NULL;
+    }
+
+    value->handler = value->data;
+    database_cache_store(cache, key, keylen, value->data, value->length);
+
+    return value;
+}
+
+static int database_cache_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->set(source, key, keylen, data, datalen);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+static int database_cache_pset(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->pset(source, key, keylen, data, datalen);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+static size_t database_cache_flush(flist_db_t *database) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    size_t value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->flush(source);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+// existence is always checked on the source: the cache directory can be
+// shared by multiple backends, an object found on disk doesn't mean it's
+// stored on this backend (existence decides if a chunk needs to be uploaded)
+static int database_cache_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->exists(source, key, keylen);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+static int database_cache_mexists(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, int *exists) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->mexists(source, keys, keylens, count, exists);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+static void database_cache_clean(value_t *value);
+
+// only keys not found on the cache are fetched from the source
+static int database_cache_mget(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, value_t **values) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    uint8_t **mkeys = malloc(sizeof(uint8_t *) * count);
+    size_t *mkeylens = malloc(sizeof(size_t) * count);
+    value_t **mvalues = calloc(sizeof(value_t *), count);
+    size_t missing = 0;
+    int value = 1;
+
+    for(size_t i = 0; i < count; i++)
+        values[i] = NULL;
+
+    if(!mkeys || !mkeylens || !mvalues) {
+        libflist_errp("cache: mget: malloc");
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        if(database_cache_lookup(cache, keys[i], keylens[i]))
+            if((values[i] = database_cache_read(cache, keys[i], keylens[i])))
+                continue;
+
+        mkeys[missing] = keys[i];
+        mkeylens[missing] = keylens[i];
+        missing += 1;
+    }
+
+    if(missing == 0) {
+        value = 0;
+        goto cleanup;
+    }
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    if(source->mget(source, mkeys, mkeylens, missing, mvalues) == 0) {
+        value = 0;
+
+        // dispatching source replies, keeping our own copy
+        for(size_t i = 0, j = 0; i < count; i++) {
+            value_t *remote;
+
+            if(values[i])
+                continue;
+
+            remote = mvalues[j++];
+
+            if(!(values[i] = calloc(sizeof(value_t), 1))) {
+                libflist_errp("cache: mget: calloc");
+                value = 1;
+                continue;
+            }
+
+            if(!remote->data)
+                continue;
+
+            if(!(values[i]->data = malloc(remote->length + 1))) {
+                libflist_errp("cache: mget: malloc");
+                value = 1;
+                continue;
+            }
+
+            memcpy(values[i]->data, remote->data, remote->length);
+            values[i]->length = remote->length;
+            values[i]->handler = values[i]->data;
+
+            database_cache_store(cache, keys[i], keylens[i], values[i]->data, values[i]->length);
+        }
+
+        for(size_t j = 0; j < missing; j++)
+            source->clean(mvalues[j]);
+    }
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+cleanup:
+    if(value) {
+        for(size_t i = 0; i < count; i++) {
+            if(values[i])
+                database_cache_clean(values[i]);
+
+            values[i] = NULL;
+        }
+    }
+
+    free(mkeys);
+    free(mkeylens);
+    free(mvalues);
+
+    return value;
+}
+
+static int database_cache_mset(flist_db_t *database, uint8_t **keys, size_t *keylens, uint8_t **data, size_t *datalens, size_t count) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->mset(source, keys, keylens, data, datalens, count);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    return value;
+}
+
+// keys are deleted on the source, cached copies are dropped
+static int database_cache_mdel(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    flist_db_t *source = cache->source;
+    int value;
+
+    if(!source->concurrent)
+        pthread_mutex_lock(&cache->slock);
+
+    value = source->mdel(source, keys, keylens, count);
+
+    if(!source->concurrent)
+        pthread_mutex_unlock(&cache->slock);
+
+    pthread_mutex_lock(&cache->lock);
+
+    for(size_t i = 0; i < count; i++) {
+        ssize_t index;
+
+        if(keylens[i] <= CACHE_KEY_MAXLEN && (index = database_cache_find(cache, keys[i], keylens[i])) >= 0)
+            database_cache_remove(cache, index);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return value;
+}
+
+static value_t *database_cache_sget(flist_db_t *database, char *key) {
+    return database_cache_get(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_cache_sset(flist_db_t *database, char *key, uint8_t *data, size_t datalen) {
+    return database_cache_set(database, (uint8_t *) key, strlen(key), data, datalen);
+}
+
+static int database_cache_sexists(flist_db_t *database, char *key) {
+    return database_cache_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static value_t *database_cache_mdget(flist_db_t *database, char *key) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    return cache->source->mdget(cache->source, key);
+}
+
+static int database_cache_mdset(flist_db_t *database, char *key, char *data) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    return cache->source->mdset(cache->source, key, data);
+}
+
+static int database_cache_mddel(flist_db_t *database, char *key) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    return cache->source->mddel(cache->source, key);
+}
+
+static slist_t database_cache_mdlist(flist_db_t *database) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    return cache->source->mdlist(cache->source);
+}
+
+static void database_cache_clean(value_t *value) {
+    free(value->data);
+    free(value);
+}
+
+static flist_db_t *database_cache_dummy(flist_db_t *database) {
+    (void) database;
+    return 0;
+}
+
+static int database_cache_close(flist_db_t *database) {
+    database_cache_t *cache = (database_cache_t *) database->handler;
+    int value = cache->source->close(cache->source);
+
+    pthread_mutex_destroy(&cache->lock);
+    pthread_mutex_destroy(&cache->slock);
+
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache->root);
+    free(cache);
+    free(database);
+
+    return value;
+}
+
+// wraps 'source' database with a local disk cache stored on 'root'
+// directory, using at most 'maxsize' bytes (0 for default size)
+// the cache takes ownership of the source database
+flist_db_t *libflist_db_cache_init(flist_db_t *source, char *root, size_t maxsize) {
+    database_cache_t *cache;
+    flist_db_t *db;
+
+    if(mkdir(root, 0755) < 0 && errno != EEXIST) {
+        libflist_set_error("cache: %s: %s", root, strerror(errno));
+        return NULL;
+    }
+
+    if(!(db = calloc(sizeof(flist_db_t), 1)))
+        return libflist_errp("cache: calloc");
+
+    if(!(cache = calloc(sizeof(database_cache_t), 1))) {
+        free(db);
+        return libflist_errp("cache: calloc");
+    }
+
+    if(!(cache->buckets = malloc(sizeof(ssize_t) * CACHE_BUCKETS))) {
+        free(cache);
+        free(db);
+        return libflist_errp("cache: buckets: malloc");
+    }
+
+    for(size_t i = 0; i < CACHE_BUCKETS; i++)
+        cache->buckets[i] = -1;
+
+    cache->source = source;
+    cache->root = strdup(root);
+    cache->freelist = -1;
+    cache->maxsize = maxsize ? maxsize : CACHE_DEFAULT_SIZE;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_mutex_init(&cache->slock, NULL);
+
+    database_cache_load(cache, cache->root, 0);
+
+    debug("[+] libflist: cache: %s, %lu objects, %.2f MB / %.2f MB\n", root, cache->length,
+          cache->size / (1024 * 1024.0), cache->maxsize / (1024 * 1024.0));
+
+    // cache could be larger than allowed (settings changed)
+    database_cache_evict(cache, 0);
+
+    // cache is transparent, same type as the source
+    db->handler = cache;
+    db->type = source->type;
+    db->concurrent = 1;
+
+    // fillin handlers
+    db->open = database_cache_dummy;
+    db->create = database_cache_dummy;
+    db->close = database_cache_close;
+    db->get = database_cache_get;
+    db->set = database_cache_set;
+    db->pset = database_cache_pset;
+    db->flush = database_cache_flush;
+    db->exists = database_cache_exists;
+    db->mexists = database_cache_mexists;
+    db->mget = database_cache_mget;
+    db->mset = database_cache_mset;
+    db->mdel = database_cache_mdel;
+    db->sget = database_cache_sget;
+    db->sset = database_cache_sset;
+    db->sexists = database_cache_sexists;
+    db->mdget = database_cache_mdget;
+    db->mdset = database_cache_mdset;
+    db->mddel = database_cache_mddel;
+    db->mdlist = database_cache_mdlist;
+    db->clean = database_cache_clean;
+
+    return db;
+}
@@ -0,0 +1,37 @@
+#ifndef LIBFLIST_DATABASE_CACHE_H
+    #define LIBFLIST_DATABASE_CACHE_H
+
+    #define CACHE_KEY_MAXLEN   64
+    #define CACHE_DEFAULT_SIZE (1024 * 1024 * 1024)    // 1 GB
+
+    // one object stored on disk
+    typedef struct database_cache_entry_t {
+        uint8_t key[CACHE_KEY_MAXLEN];
+        uint8_t keylen;
+        size_t length;      // object size on disk
+        int referenced;     // clock: recently used
+        int used;           // slot contains an object
+        ssize_t next;       // next entry on the same bucket
+
+    } database_cache_entry_t;
+
+    typedef struct database_cache_t {
+        flist_db_t *source;     // database cached
+        char *root;             // cache directory
+
+        database_cache_entry_t *entries;
+        size_t length;          // amount of slots used
+        size_t allocated;       // amount of slots allocated
+        ssize_t *buckets;       // hash table (index on entries)
+        ssize_t freelist;       // first free slot (chained via next)
+        size_t hand;            // clock hand
+
+        size_t size;            // current size of the cache
+        size_t maxsize;         // maximum size allowed
+
+        pthread_mutex_t lock;   // index lock
+        pthread_mutex_t slock;  // source lock (if source is not concurrent)
+
+    } database_cache_t;
+
+#endif
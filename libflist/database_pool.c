@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_pool.h"
+
+//
+// connection pool
+//
+// this database wraps multiple connections to the same database
+// and dispatch each request on an available connection, this
+// handler can be shared between threads (it's flagged concurrent),
+// a request waits until a connection is available
+//
+// values returned needs to stay valid after the connection is
+// released, this is the case for redis (reply object) but not for
+// sqlite (statement owned), pools are made for redis/zdb
+//
+
+// take any available connection
+static flist_db_t *database_pool_acquire(database_pool_t *pool, size_t *index) {
+    pthread_mutex_lock(&pool->lock);
+
+    while(1) {
+        for(size_t i = 0; i < pool->length; i++) {
+            if(pool->busy[i])
+                continue;
+
+            pool->busy[i] = 1;
+            pthread_mutex_unlock(&pool->lock);
+
+            *index = i;
+            return pool->list[i];
+        }
+
+        pthread_cond_wait(&pool->available, &pool->lock);
+    }
+}
+
+// take one specific connection
+static flist_db_t *database_pool_acquire_index(database_pool_t *pool, size_t index) {
+    pthread_mutex_lock(&pool->lock);
+
+    while(pool->busy[index])
+        pthread_cond_wait(&pool->available, &pool->lock);
+
+    pool->busy[index] = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool->list[index];
+}
+
+static void database_pool_release(database_pool_t *pool, size_t index) {
+    pthread_mutex_lock(&pool->lock);
+
+    pool->busy[index] = 0;
+    pthread_cond_broadcast(&pool->available);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int database_pool_close(flist_db_t *database) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    int value = 0;
+
+    for(size_t i = 0; i < pool->length; i++)
+        value |= pool->list[i]->close(pool->list[i]);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+
+    free(pool->list);
+    free(pool->busy);
+    free(pool);
+    free(database);
+
+    return value;
+}
+
+static flist_db_t *database_pool_dummy(flist_db_t *database) {
+    (void) database;
+    return 0;
+}
+
+static value_t *database_pool_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    value_t *value = db->get(db, key, keylen);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->set(db, key, keylen, data, datalen);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_pset(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->pset(db, key, keylen, data, datalen);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+// pending commands can be on any connection
+static size_t database_pool_flush(flist_db_t *database) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t failed = 0;
+
+    for(size_t i = 0; i < pool->length; i++) {
+        flist_db_t *db = database_pool_acquire_index(pool, i);
+        failed += db->flush(db);
+        database_pool_release(pool, i);
+    }
+
+    return failed;
+}
+
+static int database_pool_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->exists(db, key, keylen);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mexists(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, int *exists) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mexists(db, keys, keylens, count, exists);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mget(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, value_t **values) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mget(db, keys, keylens, count, values);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mset(flist_db_t *database, uint8_t **keys, size_t *keylens, uint8_t **data, size_t *datalens, size_t count) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mset(db, keys, keylens, data, datalens, count);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mdel(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mdel(db, keys, keylens, count);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static value_t *database_pool_sget(flist_db_t *database, char *key) {
+    return database_pool_get(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_pool_sset(flist_db_t *database, char *key, uint8_t *data, size_t datalen) {
+    return database_pool_set(database, (uint8_t *) key, strlen(key), data, datalen);
+}
+
+static int database_pool_sexists(flist_db_t *database, char *key) {
+    return database_pool_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static value_t *database_pool_mdget(flist_db_t *database, char *key) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    value_t *value = db->mdget(db, key);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mdset(flist_db_t *database, char *key, char *data) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mdset(db, key, data);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static int database_pool_mddel(flist_db_t *database, char *key) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    int value = db->mddel(db, key);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+static slist_t database_pool_mdlist(flist_db_t *database) {
+    database_pool_t *pool = (database_pool_t *) database->handler;
+    size_t index;
+
+    flist_db_t *db = database_pool_acquire(pool, &index);
+    slist_t value = db->mdlist(db);
+    database_pool_release(pool, index);
+
+    return value;
+}
+
+// create a pool from a list of already connected databases
+// all the databases needs to use the same driver and point to the
+// same database, the pool takes ownership of theses databases
+flist_db_t *libflist_db_pool_init(flist_db_t **databases, size_t length) {
+    database_pool_t *pool;
+    flist_db_t *db;
+
+    if(length == 0)
+        return libflist_set_error("pool: no database provided");
+
+    if(!(db = calloc(sizeof(flist_db_t), 1)))
+        return libflist_errp("pool: calloc");
+
+    if(!(pool = calloc(sizeof(database_pool_t), 1))) {
+        free(db);
+        return libflist_errp("pool: calloc");
+    }
+
+    pool->length = length;
+    pool->list = malloc(sizeof(flist_db_t *) * length);
+    pool->busy = calloc(sizeof(int), length);
+
+    if(!pool->list || !pool->busy) {
+        free(pool->list);
+        free(pool->busy);
+        free(pool);
+        free(db);
+        return libflist_errp("pool: malloc");
+    }
+
+    memcpy(pool->list, databases, sizeof(flist_db_t *) * length);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    debug("[+] libflist: pool: %lu connections (%s)\n", length, databases[0]->type);
+
+    // pool is transparent, same type as the underlaying databases
+    db->handler = pool;
+    db->type = databases[0]->type;
+    db->concurrent = 1;
+
+    // fillin handlers
+    db->open = database_pool_dummy;
+    db->create = database_pool_dummy;
+    db->close = database_pool_close;
+    db->get = database_pool_get;
+    db->set = database_pool_set;
+    db->pset = database_pool_pset;
+    db->flush = database_pool_flush;
+    db->exists = database_pool_exists;
+    db->mexists = database_pool_mexists;
+    db->mget = database_pool_mget;
+    db->mset = database_pool_mset;
+    db->mdel = database_pool_mdel;
+    db->sget = database_pool_sget;
+    db->sset = database_pool_sset;
+    db->sexists = database_pool_sexists;
+    db->mdget = database_pool_mdget;
+    db->mdset = database_pool_mdset;
+    db->mddel = database_pool_mddel;
+    db->mdlist = database_pool_mdlist;
+
+    // values are allocated by the underlaying databases, they all
+    // use the same driver, their cleaner can be used directly
+    db->clean = databases[0]->clean;
+
+    return db;
+}
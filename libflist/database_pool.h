@@ -0,0 +1,14 @@
+#ifndef LIBFLIST_DATABASE_POOL_H
+    #define LIBFLIST_DATABASE_POOL_H
+
+    typedef struct database_pool_t {
+        flist_db_t **list;      // connections
+        int *busy;              // connection currently in use
+        size_t length;          // amount of connections
+
+        pthread_mutex_t lock;
+        pthread_cond_t available;
+
+    } database_pool_t;
+
+#endif
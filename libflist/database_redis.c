@@ -10,12 +10,22 @@
 #include "database.h"
 #include "database_redis.h"
 
-static void database_redis_close(flist_db_t *database) {
+static size_t database_redis_flush(flist_db_t *database);
+
+static int database_redis_close(flist_db_t *database) {
     database_redis_t *db = (database_redis_t *) database->handler;
+
+    if(db->redis)
+        database_redis_flush(database);
+
     redisFree(db->redis);
+    free(db->namespace);
+    free(db->pending);
 
     free(database->handler);
     free(database);
+
+    return 0;
 }
 
 static flist_db_t *database_redis_dummy(flist_db_t *database) {
@@ -36,11 +46,16 @@ static redisReply *database_redis_get_zdb(flist_db_t *database, uint8_t *key, si
     return redisCommand(db->redis, "GET %b", key, keylen);
 }
 
+static void database_redis_drain(database_redis_t *db);
+
 static value_t *database_redis_get(flist_db_t *database, uint8_t *key, size_t keylen) {
     database_redis_t *db = (database_redis_t *) database->handler;
     redisReply *reply;
     value_t *value = NULL;
 
+    // replies of pending commands needs to be read first
+    database_redis_drain(db);
+
     if(!(value = calloc(1, sizeof(value_t)))) {
         diep("malloc");
         return NULL;
@@ -111,6 +126,8 @@ static int database_redis_set(flist_db_t *database, uint8_t *key, size_t keylen,
     database_redis_t *db = (database_redis_t *) database->handler;
     redisReply *reply;
 
+    database_redis_drain(db);
+
     if(!(reply = db->internal_set(database, key, keylen, payload, length)))
         return 1;
 
@@ -119,6 +136,135 @@ static int database_redis_set(flist_db_t *database, uint8_t *key, size_t keylen,
     return 0;
 }
 
+//
+// pipelined SET (write-behind)
+//
+// commands are appended to the output buffer and sent without waiting
+// for the reply, replies are collected when the amount of pending
+// commands or bytes reach a threshold, before any synchronous command,
+// or on explicit flush, which returns the amount of failures
+//
+#define REDIS_PIPELINE_COUNT  128
+#define REDIS_PIPELINE_BYTES  (32 * 1024 * 1024)
+
+static int database_redis_check_set_reply(database_redis_t *db, redisReply *reply, database_redis_pending_t *pending) {
+    if(reply->type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: set: %s", reply->str);
+        return 1;
+    }
+
+    // redis HSET replies with an integer
+    if(db->namespace)
+        return 0;
+
+    // zero-db replies with the key, or an empty
+    // reply if the key already exists (duplicate)
+    if(reply->type != REDIS_REPLY_STRING || reply->len == 0)
+        return 0;
+
+    if(reply->len != pending->keylen || memcmp(reply->str, pending->key, pending->keylen)) {
+        libflist_set_error("set: invalid response: %.*s", (int) reply->len, reply->str);
+        return 1;
+    }
+
+    return 0;
+}
+
+// read replies of all pending commands
+static void database_redis_drain(database_redis_t *db) {
+    redisReply *reply;
+
+    if(db->pendlen == 0)
+        return;
+
+    debug("[+] libflist: redis: flushing: %lu items (%.2f KB)\n", db->pendlen, db->pendbytes / 1024.0);
+
+    for(size_t i = 0; i < db->pendlen; i++) {
+        database_redis_pending_t *pending = &db->pending[i];
+
+        if(redisGetReply(db->redis, (void **) &reply) != REDIS_OK) {
+            libflist_set_error("redis: set: %s", db->redis->errstr);
+
+            // connection is broken, all the remaining replies are lost
+            db->failed += db->pendlen - i;
+
+            for(; i < db->pendlen; i++)
+                free(db->pending[i].key);
+
+            break;
+        }
+
+        if(database_redis_check_set_reply(db, reply, pending)) {
+            if(libflist_debug_flag) {
+                char *hexkey = libflist_hashhex(pending->key, pending->keylen);
+                debug("[-] libflist: redis: set: %s: %s\n", hexkey, libflist_strerror());
+                free(hexkey);
+            }
+
+            db->failed += 1;
+        }
+
+        freeReplyObject(reply);
+        free(pending->key);
+    }
+
+    db->pendlen = 0;
+    db->pendbytes = 0;
+}
+
+static int database_redis_pset(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    database_redis_pending_t *pending;
+    int value;
+
+    if(!db->pending && !(db->pending = malloc(sizeof(database_redis_pending_t) * REDIS_PIPELINE_COUNT))) {
+        libflist_errp("redis: pipeline: malloc");
+        return 1;
+    }
+
+    // keep a copy of the key to validate the reply later
+    pending = &db->pending[db->pendlen];
+    pending->keylen = keylen;
+
+    if(!(pending->key = malloc(keylen))) {
+        libflist_errp("redis: pipeline: malloc");
+        return 1;
+    }
+
+    memcpy(pending->key, key, keylen);
+
+    if(db->namespace)
+        value = redisAppendCommand(db->redis, "HSET %s %b %b", db->namespace, key, keylen, payload, length);
+    else
+        value = redisAppendCommand(db->redis, "SET %b %b", key, keylen, payload, length);
+
+    if(value != REDIS_OK) {
+        libflist_set_error("redis: set: %s", db->redis->errstr);
+        free(pending->key);
+        return 1;
+    }
+
+    db->pendlen += 1;
+    db->pendbytes += length;
+
+    if(db->pendlen == REDIS_PIPELINE_COUNT || db->pendbytes >= REDIS_PIPELINE_BYTES)
+        database_redis_drain(db);
+
+    return 0;
+}
+
+static size_t database_redis_flush(flist_db_t *database) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    size_t failed;
+
+    database_redis_drain(db);
+
+    failed = db->failed;
+    db->failed = 0;
+
+    return failed;
+}
+
 static int database_redis_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
     return database_redis_set(database, (uint8_t *) key, strlen(key), payload, length);
 }
@@ -129,19 +275,222 @@ static void database_redis_clean(value_t *value) {
 }
 
 
-// poor implementation of exists
-static int database_redis_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
-    int retval = 0;
+//
+// batch commands
+//
+// commands of a batch operation are pipelined, by groups of
+// REDIS_BATCH_SIZE commands sent at once, then all the replies of
+// the group are read, this avoids one round trip per key
+//
+// 'append' sends the command for key 'i', 'reply' handles its reply
+// and takes ownership of it, both returns non-zero on failure
+//
+#define REDIS_BATCH_SIZE  256
+
+typedef struct database_redis_batch_t {
+    uint8_t **keys;
+    size_t *keylens;
+    uint8_t **payloads;     // mset
+    size_t *lengths;        // mset
+    int *exists;            // mexists
+    value_t **values;       // mget
+
+} database_redis_batch_t;
+
+typedef int (*database_redis_append_t)(database_redis_t *db, database_redis_batch_t *batch, size_t i);
+typedef int (*database_redis_reply_t)(database_redis_t *db, database_redis_batch_t *batch, size_t i, redisReply *reply);
+
+static int database_redis_pipeline(database_redis_t *db, database_redis_batch_t *batch, size_t count, char *name, database_redis_append_t append, database_redis_reply_t handler) {
+    redisReply *reply;
+    int failed = 0;
+
+    // replies of write-behind commands needs to be read first
+    database_redis_drain(db);
+
+    for(size_t first = 0; first < count && !failed; first += REDIS_BATCH_SIZE) {
+        size_t length = count - first;
+        size_t sent = 0;
+
+        if(length > REDIS_BATCH_SIZE)
+            length = REDIS_BATCH_SIZE;
+
+        for(sent = 0; sent < length; sent++) {
+            if(append(db, batch, first + sent) != REDIS_OK) {
+                libflist_set_error("redis: %s: %s", name, db->redis->errstr);
+                failed = 1;
+                break;
+            }
+        }
+
+        // fetching all the replies of commands sent
+        for(size_t j = 0; j < sent; j++) {
+            if(redisGetReply(db->redis, (void **) &reply) != REDIS_OK) {
+                libflist_set_error("redis: %s: %s", name, db->redis->errstr);
+                return 1;
+            }
+
+            if(reply->type == REDIS_REPLY_ERROR) {
+                libflist_set_error("redis: %s: %s", name, reply->str);
+                failed = 1;
+            }
+
+            if(handler(db, batch, first + j, reply))
+                failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+//
+// EXISTS
+//
+// existence is checked natively (EXISTS on zdb, HEXISTS on redis),
+// without transfering the payload
+//
+static int database_redis_append_exists(database_redis_t *db, database_redis_batch_t *batch, size_t i) {
+    if(db->namespace)
+        return redisAppendCommand(db->redis, "HEXISTS %s %b", db->namespace, batch->keys[i], batch->keylens[i]);
+
+    return redisAppendCommand(db->redis, "EXISTS %b", batch->keys[i], batch->keylens[i]);
+}
+
+static int database_redis_reply_exists(database_redis_t *db, database_redis_batch_t *batch, size_t i, redisReply *reply) {
+    (void) db;
+
+    batch->exists[i] = (reply->type == REDIS_REPLY_INTEGER && reply->integer > 0);
+    freeReplyObject(reply);
+
+    return 0;
+}
+
+static int database_redis_mexists(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, int *exists) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    database_redis_batch_t batch = {.keys = keys, .keylens = keylens, .exists = exists};
+
+    for(size_t i = 0; i < count; i++)
+        exists[i] = 0;
 
-    value_t *value = database_redis_get(database, key, keylen);
-    if(!value)
+    return database_redis_pipeline(db, &batch, count, "exists", database_redis_append_exists, database_redis_reply_exists);
+}
+
+//
+// batch GET
+//
+static int database_redis_append_get(database_redis_t *db, database_redis_batch_t *batch, size_t i) {
+    if(db->namespace)
+        return redisAppendCommand(db->redis, "HGET %s %b", db->namespace, batch->keys[i], batch->keylens[i]);
+
+    return redisAppendCommand(db->redis, "GET %b", batch->keys[i], batch->keylens[i]);
+}
+
+static int database_redis_reply_get(database_redis_t *db, database_redis_batch_t *batch, size_t i, redisReply *reply) {
+    (void) db;
+
+    if(!(batch->values[i] = calloc(1, sizeof(value_t)))) {
+        libflist_errp("redis: mget: calloc");
+        freeReplyObject(reply);
+        return 1;
+    }
+
+    // key not found (nil reply), data stays empty
+    if(reply->type != REDIS_REPLY_STRING) {
+        freeReplyObject(reply);
         return 0;
+    }
 
-    if(value->data)
-        retval = 1;
+    batch->values[i]->data = reply->str;
+    batch->values[i]->length = reply->len;
+    batch->values[i]->handler = reply;
 
-    database_redis_clean(value);
-    return retval;
+    return 0;
+}
+
+static void database_redis_clean(value_t *value);
+
+static int database_redis_mget(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, value_t **values) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    database_redis_batch_t batch = {.keys = keys, .keylens = keylens, .values = values};
+
+    for(size_t i = 0; i < count; i++)
+        values[i] = NULL;
+
+    if(database_redis_pipeline(db, &batch, count, "mget", database_redis_append_get, database_redis_reply_get) == 0)
+        return 0;
+
+    for(size_t i = 0; i < count; i++) {
+        if(values[i])
+            database_redis_clean(values[i]);
+
+        values[i] = NULL;
+    }
+
+    return 1;
+}
+
+//
+// batch SET
+//
+// unlike pset, replies are read (and checked) before returning
+//
+static int database_redis_append_set(database_redis_t *db, database_redis_batch_t *batch, size_t i) {
+    if(db->namespace)
+        return redisAppendCommand(db->redis, "HSET %s %b %b", db->namespace, batch->keys[i], batch->keylens[i], batch->payloads[i], batch->lengths[i]);
+
+    return redisAppendCommand(db->redis, "SET %b %b", batch->keys[i], batch->keylens[i], batch->payloads[i], batch->lengths[i]);
+}
+
+static int database_redis_reply_set(database_redis_t *db, database_redis_batch_t *batch, size_t i, redisReply *reply) {
+    database_redis_pending_t pending = {.key = batch->keys[i], .keylen = batch->keylens[i]};
+    int value = database_redis_check_set_reply(db, reply, &pending);
+
+    freeReplyObject(reply);
+
+    return value;
+}
+
+static int database_redis_mset(flist_db_t *database, uint8_t **keys, size_t *keylens, uint8_t **payloads, size_t *lengths, size_t count) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    database_redis_batch_t batch = {.keys = keys, .keylens = keylens, .payloads = payloads, .lengths = lengths};
+
+    return database_redis_pipeline(db, &batch, count, "mset", database_redis_append_set, database_redis_reply_set);
+}
+
+//
+// batch DEL
+//
+static int database_redis_append_del(database_redis_t *db, database_redis_batch_t *batch, size_t i) {
+    if(db->namespace)
+        return redisAppendCommand(db->redis, "HDEL %s %b", db->namespace, batch->keys[i], batch->keylens[i]);
+
+    return redisAppendCommand(db->redis, "DEL %b", batch->keys[i], batch->keylens[i]);
+}
+
+static int database_redis_reply_del(database_redis_t *db, database_redis_batch_t *batch, size_t i, redisReply *reply) {
+    (void) db;
+    (void) batch;
+    (void) i;
+
+    // errors are already reported by the pipeline
+    freeReplyObject(reply);
+
+    return 0;
+}
+
+static int database_redis_mdel(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    database_redis_batch_t batch = {.keys = keys, .keylens = keylens};
+
+    return database_redis_pipeline(db, &batch, count, "mdel", database_redis_append_del, database_redis_reply_del);
+}
+
+static int database_redis_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    int exists = 0;
+
+    if(database_redis_mexists(database, &key, &keylen, 1, &exists))
+        return 0;
+
+    return exists;
 }
 
 static int database_redis_sexists(flist_db_t *database, char *key) {
@@ -184,6 +533,7 @@ static slist_t database_redis_mdlist(flist_db_t *database) {
 static flist_db_t *database_redis_init_global(flist_db_t *db) {
     // setting global db
     db->type = "REDIS";
+    db->concurrent = 0;
 
     // fillin handlers
     db->open = database_redis_dummy;
@@ -191,7 +541,13 @@ static flist_db_t *database_redis_init_global(flist_db_t *db) {
     db->close = database_redis_close;
     db->get = database_redis_get;
     db->set = database_redis_set;
+    db->pset = database_redis_pset;
+    db->flush = database_redis_flush;
     db->exists = database_redis_exists;
+    db->mexists = database_redis_mexists;
+    db->mget = database_redis_mget;
+    db->mset = database_redis_mset;
+    db->mdel = database_redis_mdel;
     db->clean = database_redis_clean;
     db->sget = database_redis_sget;
     db->sset = database_redis_sset;
@@ -213,7 +569,7 @@ static flist_db_t *database_redis_init() {
         return NULL;
 
     // set our custom redis database handler
-    if(!(db->handler = malloc(sizeof(database_redis_t)))) {
+    if(!(db->handler = calloc(sizeof(database_redis_t), 1))) {
         free(db);
         return NULL;
     }
@@ -221,7 +577,8 @@ static flist_db_t *database_redis_init() {
     return database_redis_init_global(db);
 }
 
-static int database_redis_set_namespace(database_redis_t *db, char *namespace, char *password, char *token) {
+static int database_redis_set_namespace(flist_db_t *database, char *namespace, char *password, char *token) {
+    database_redis_t *db = (database_redis_t *) database->handler;
     redisReply *reply;
 
     if(!(reply = redisCommand(db->redis, "INFO")))
@@ -235,6 +592,7 @@ static int database_redis_set_namespace(database_redis_t *db, char *namespace, c
         freeReplyObject(reply);
 
         // linking to zdb settings
+        database->type = "ZDB";
         db->namespace = NULL;
         db->internal_get = database_redis_get_zdb;
         db->internal_set = database_redis_set_zdb;
@@ -279,8 +637,9 @@ static int database_redis_set_namespace(database_redis_t *db, char *namespace, c
         // this is a redis-compatible server
         debug("[+] database: redis compatible detected\n");
 
-        // linking to redis settings
-        db->namespace = namespace;
+        // linking to redis settings, namespace is kept
+        // during the whole connection lifetime
+        db->namespace = namespace ? strdup(namespace) : NULL;
         db->internal_get = database_redis_get_real;
         db->internal_set = database_redis_set_real;
     }
@@ -305,7 +664,7 @@ flist_db_t *libflist_db_redis_init_tcp(char *host, int port, char *namespace, ch
         return NULL;
     }
 
-    if(database_redis_set_namespace(handler, namespace, password, token)) {
+    if(database_redis_set_namespace(db, namespace, password, token)) {
         // error should have been set
         database_redis_close(db);
         return NULL;
@@ -329,7 +688,7 @@ flist_db_t *libflist_db_redis_init_unix(char *socket, char *namespace, char *pas
         return NULL;
     }
 
-    database_redis_set_namespace(handler, namespace, password, token);
+    database_redis_set_namespace(db, namespace, password, token);
 
     return db;
 }
@@ -3,10 +3,22 @@
 
     #include <hiredis/hiredis.h>
 
+    // one SET sent but which reply was not read yet
+    typedef struct database_redis_pending_t {
+        uint8_t *key;
+        size_t keylen;
+
+    } database_redis_pending_t;
+
     typedef struct database_redis_t {
         redisContext *redis;
         char *namespace;
 
+        database_redis_pending_t *pending;  // write-behind commands sent
+        size_t pendlen;                     // amount of pending commands
+        size_t pendbytes;                   // amount of payload bytes pending
+        size_t failed;                      // failures since last flush
+
         redisReply* (*internal_get)(flist_db_t *database, uint8_t *key, size_t keylen);
         redisReply* (*internal_set)(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length);
 
@@ -9,6 +9,141 @@
 #include "verbose.h"
 #include "database.h"
 #include "database_sqlite.h"
+#include "archive_vfs.h"
+
+//
+// workload profiles
+//
+// default profile keeps sqlite settings, all the changes are done
+// in a single transaction, committed on close
+//
+// build profile is made for bulk insertion (putdir, merge), the workspace
+// database is temporary (the flist is the archive built on commit), there
+// is no need for a journal nor for syncing, an interrupted build already
+// means the workspace needs to be created again, the larger page size
+// only applies to new databases: an existing database keeps its page
+// size until it's rebuilt (VACUUM), which is not worth doing here
+//
+// read-only profile doesn't create nor lock anything for writing, pages
+// are mapped instead of being copied to the page cache
+//
+// memory profile loads the whole database in memory and writes it
+// back on close (online backup), only if something changed, close
+// fails if the file could not be written
+//
+// an archived database (seekable archive) can be opened in place,
+// read-only, through the archive vfs (see archive_vfs.c)
+//
+// the database is not compacted on close anymore, this rewrites the
+// whole file, it's done once when the flist is committed
+//
+static char *database_sqlite_pragmas_build[] = {
+    "PRAGMA page_size = 8192;",
+    "PRAGMA journal_mode = OFF;",
+    "PRAGMA synchronous = OFF;",
+    "PRAGMA cache_size = -262144;",
+    "PRAGMA mmap_size = 1073741824;",
+    "PRAGMA temp_store = MEMORY;",
+    NULL,
+};
+
+static char *database_sqlite_pragmas_readonly[] = {
+    "PRAGMA mmap_size = 1073741824;",
+    "PRAGMA query_only = 1;",
+    NULL,
+};
+
+static char *database_sqlite_pragmas_memory[] = {
+    "PRAGMA temp_store = MEMORY;",
+    NULL,
+};
+
+static int database_sqlite_pragmas(database_sqlite_t *db) {
+    char **pragmas = NULL;
+
+    if(db->profile == FLIST_DB_BUILD)
+        pragmas = database_sqlite_pragmas_build;
+
+    if(db->profile == FLIST_DB_READONLY)
+        pragmas = database_sqlite_pragmas_readonly;
+
+    if(db->profile == FLIST_DB_MEMORY)
+        pragmas = database_sqlite_pragmas_memory;
+
+    for(size_t i = 0; pragmas && pragmas[i]; i++) {
+        debug("[+] libflist: sqlite: %s\n", pragmas[i]);
+
+        if(sqlite3_exec(db->db, pragmas[i], NULL, NULL, NULL) != SQLITE_OK) {
+            libflist_set_error("sqlite: %s: %s", pragmas[i], sqlite3_errmsg(db->db));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// copy a whole database, using sqlite online backup
+static int database_sqlite_copy(sqlite3 *target, sqlite3 *source) {
+    sqlite3_backup *backup;
+    int value;
+
+    if(!(backup = sqlite3_backup_init(target, "main", source, "main"))) {
+        libflist_set_error("sqlite3_backup_init: %s", sqlite3_errmsg(target));
+        return 1;
+    }
+
+    value = sqlite3_backup_step(backup, -1);
+    sqlite3_backup_finish(backup);
+
+    if(value != SQLITE_DONE) {
+        libflist_set_error("sqlite3_backup_step: %s", sqlite3_errstr(value));
+        return 1;
+    }
+
+    return 0;
+}
+
+// load existing database file into memory
+static int database_sqlite_load(database_sqlite_t *db) {
+    sqlite3 *source;
+    int value;
+
+    // new database
+    if(access(db->filename, F_OK) != 0)
+        return 0;
+
+    debug("[+] libflist: sqlite: loading database in memory\n");
+
+    if(sqlite3_open_v2(db->filename, &source, SQLITE_OPEN_READONLY, NULL)) {
+        libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(source));
+        sqlite3_close(source);
+        return 1;
+    }
+
+    value = database_sqlite_copy(db->db, source);
+    sqlite3_close(source);
+
+    return value;
+}
+
+// write in-memory database back to the database file
+static int database_sqlite_save(database_sqlite_t *db) {
+    sqlite3 *target;
+    int value;
+
+    debug("[+] libflist: sqlite: saving in-memory database\n");
+
+    if(sqlite3_open_v2(db->filename, &target, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL)) {
+        libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(target));
+        sqlite3_close(target);
+        return 1;
+    }
+
+    value = database_sqlite_copy(target, db->db);
+    sqlite3_close(target);
+
+    return value;
+}
 
 static int database_sqlite_build(database_sqlite_t *db) {
     char *queries[] = {
@@ -21,6 +156,10 @@ static int database_sqlite_build(database_sqlite_t *db) {
     //
     value_t value;
 
+    // nothing can be created nor modified
+    if(db->profile == FLIST_DB_READONLY)
+        return 0;
+
     for(size_t i = 0; i < sizeof(queries) / sizeof(char *); i++) {
         if(sqlite3_prepare_v2(db->db, queries[i], -1, (sqlite3_stmt **) &value.handler, NULL) != SQLITE_OK) {
             libflist_set_error("create: sqlite3_prepare_v2: %s: %s", queries[i], sqlite3_errmsg(db->db));
@@ -85,18 +224,34 @@ static int database_sqlite_optimize(flist_db_t *database) {
 
 static database_sqlite_t *database_sqlite_root_init(flist_db_t *database) {
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    char *filename = db->filename;
 
-    if(sqlite3_open(db->filename, &db->db)) {
+    if(db->profile == FLIST_DB_READONLY)
+        flags = SQLITE_OPEN_READONLY;
+
+    if(db->profile == FLIST_DB_MEMORY)
+        filename = ":memory:";
+
+    if(sqlite3_open_v2(filename, &db->db, flags, db->vfs)) {
         libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(db->db));
         return NULL;
     }
 
+    if(db->profile == FLIST_DB_MEMORY && database_sqlite_load(db))
+        return NULL;
+
+    if(database_sqlite_pragmas(db))
+        return NULL;
+
     return db;
 }
 
 static flist_db_t *database_sqlite_create(flist_db_t *database) {
-    database->handler = database_sqlite_root_init(database);
-    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    database_sqlite_t *db;
+
+    if(!(db = database_sqlite_root_init(database)))
+        return NULL;
 
     if(database_sqlite_build(db))
         return NULL;
@@ -112,19 +267,31 @@ static flist_db_t *database_sqlite_open(flist_db_t *database) {
     return database_sqlite_create(database);
 }
 
-static void database_sqlite_close(flist_db_t *database) {
+// changes are committed (and saved back to the file on memory
+// profile), returns non-zero if they could not be saved
+static int database_sqlite_close(flist_db_t *database) {
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    int value = 0;
 
     if(db->updated) {
-        debug("[+] libflist: sqlite: committing and compacting\n");
+        debug("[+] libflist: sqlite: committing changes\n");
+
+        if(sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL) != SQLITE_OK) {
+            libflist_set_error("sqlite: commit: %s", sqlite3_errmsg(db->db));
+            value = 1;
+
+        } else if(db->profile == FLIST_DB_MEMORY && database_sqlite_save(db)) {
+            value = 1;
+        }
 
-        sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL);
-        sqlite3_exec(db->db, "VACUUM;", NULL, NULL, NULL);
+        if(value)
+            debug("[-] libflist: sqlite: %s\n", libflist_strerror());
     }
 
     sqlite3_stmt *stmts[] = {
         db->select, db->insert, db->delete,
-        db->mdget, db->mdset, db->mddel,
+        db->mdget, db->mdset, db->mddel, db->mdlist,
+        db->mselect, db->mexists, db->minsert, db->mdelete,
     };
 
     debug("[+] libflist: sqlite: cleaning context\n");
@@ -141,6 +308,8 @@ static void database_sqlite_close(flist_db_t *database) {
 
     // freeing global database object
     free(database);
+
+    return value;
 }
 
 static value_t *database_sqlite_get(flist_db_t *database, uint8_t *key, size_t keylen) {
@@ -198,6 +367,12 @@ static int database_sqlite_set(flist_db_t *database, uint8_t *key, size_t keylen
     return 0;
 }
 
+// sqlite is local, nothing to pipeline
+static size_t database_sqlite_flush(flist_db_t *database) {
+    (void) database;
+    return 0;
+}
+
 static int database_sqlite_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
     return database_sqlite_set(database, (uint8_t *) key, strlen(key), payload, length);
 }
@@ -337,16 +512,283 @@ static int database_sqlite_sexists(flist_db_t *database, char *key) {
     return database_sqlite_exists(database, (uint8_t *) key, strlen(key));
 }
 
-// public sqlite function initializer
-flist_db_t *libflist_db_sqlite_init(char *rootpath) {
+//
+// batch operations
+//
+// keys are processed by groups of DATABASE_SQLITE_BATCH, using one
+// statement (multi-row insert or 'IN' list) prepared once and reused,
+// the last incomplete group uses the single key statements
+//
+// everything is done inside the transaction already opened
+//
+
+// build and prepare: prefix, 'count' times item (comma separated), suffix
+static sqlite3_stmt *database_sqlite_prepare_batch(database_sqlite_t *db, char *prefix, char *item, char *suffix) {
+    size_t length = strlen(prefix) + (strlen(item) + 1) * DATABASE_SQLITE_BATCH + strlen(suffix) + 1;
+    sqlite3_stmt *stmt = NULL;
+    char *query, *ptr;
+
+    if(!(query = malloc(length)))
+        return libflist_errp("sqlite: batch: malloc");
+
+    ptr = stpcpy(query, prefix);
+
+    for(size_t i = 0; i < DATABASE_SQLITE_BATCH; i++)
+        ptr = stpcpy(stpcpy(ptr, i ? "," : ""), item);
+
+    strcpy(ptr, suffix);
+
+    debug("[+] libflist: sqlite: preparing: %s [x%d]\n", prefix, DATABASE_SQLITE_BATCH);
+
+    if(sqlite3_prepare_v2(db->db, query, -1, &stmt, 0) != SQLITE_OK) {
+        libflist_set_error("sqlite3_prepare_v2: %s: %s", prefix, sqlite3_errmsg(db->db));
+        stmt = NULL;
+    }
+
+    free(query);
+
+    return stmt;
+}
+
+static int database_sqlite_batch_ready(database_sqlite_t *db) {
+    if(!db->mselect && !(db->mselect = database_sqlite_prepare_batch(db, "SELECT key, value FROM entries WHERE key IN (", "?", ")")))
+        return 1;
+
+    if(!db->mexists && !(db->mexists = database_sqlite_prepare_batch(db, "SELECT key FROM entries WHERE key IN (", "?", ")")))
+        return 1;
+
+    if(!db->minsert && !(db->minsert = database_sqlite_prepare_batch(db, "INSERT INTO entries (key, value) VALUES ", "(?, ?)", "")))
+        return 1;
+
+    if(!db->mdelete && !(db->mdelete = database_sqlite_prepare_batch(db, "DELETE FROM entries WHERE key IN (", "?", ")")))
+        return 1;
+
+    return 0;
+}
+
+// value with its own copy of the data (released with the value),
+// rows of a batch are not valid after the next step
+static value_t *database_sqlite_value_copy(const void *data, size_t length) {
+    value_t *value;
+
+    if(!(value = calloc(sizeof(value_t) + length + 1, 1)))
+        return libflist_errp("sqlite: value: calloc");
+
+    if(data) {
+        value->data = (char *) (value + 1);
+        value->length = length;
+        memcpy(value->data, data, length);
+    }
+
+    return value;
+}
+
+// bind one group of keys on an 'IN' statement
+static void database_sqlite_bind_keys(sqlite3_stmt *stmt, uint8_t **keys, size_t *keylens) {
+    sqlite3_reset(stmt);
+
+    for(size_t i = 0; i < DATABASE_SQLITE_BATCH; i++)
+        sqlite3_bind_text(stmt, i + 1, (char *) keys[i], keylens[i], SQLITE_STATIC);
+}
+
+// index of each key of the group matching the row key (keys can be duplicated)
+static int database_sqlite_row_match(sqlite3_stmt *stmt, uint8_t *key, size_t keylen) {
+    size_t length = sqlite3_column_bytes(stmt, 0);
+    const unsigned char *rowkey = sqlite3_column_text(stmt, 0);
+
+    return (length == keylen && memcmp(rowkey, key, keylen) == 0);
+}
+
+static int database_sqlite_mget(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, value_t **values) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    size_t i = 0;
+    int data;
+
+    for(size_t j = 0; j < count; j++)
+        values[j] = NULL;
+
+    if(count >= DATABASE_SQLITE_BATCH && database_sqlite_batch_ready(db))
+        goto failed;
+
+    for(; i + DATABASE_SQLITE_BATCH <= count; i += DATABASE_SQLITE_BATCH) {
+        database_sqlite_bind_keys(db->mselect, keys + i, keylens + i);
+
+        while((data = sqlite3_step(db->mselect)) == SQLITE_ROW) {
+            const void *blob = sqlite3_column_blob(db->mselect, 1);
+            size_t length = sqlite3_column_bytes(db->mselect, 1);
+
+            for(size_t j = i; j < i + DATABASE_SQLITE_BATCH; j++) {
+                if(values[j] || !database_sqlite_row_match(db->mselect, keys[j], keylens[j]))
+                    continue;
+
+                if(!(values[j] = database_sqlite_value_copy(blob, length)))
+                    goto failed;
+            }
+        }
+
+        if(data != SQLITE_DONE) {
+            libflist_set_error("mget: sqlite3_step: %s", sqlite3_errmsg(db->db));
+            goto failed;
+        }
+
+        // keys not found
+        for(size_t j = i; j < i + DATABASE_SQLITE_BATCH; j++)
+            if(!values[j] && !(values[j] = database_sqlite_value_copy(NULL, 0)))
+                goto failed;
+    }
+
+    for(; i < count; i++) {
+        value_t *value = database_sqlite_get(database, keys[i], keylens[i]);
+
+        if(!value)
+            goto failed;
+
+        values[i] = database_sqlite_value_copy(value->data, value->length);
+        database_sqlite_clean(value);
+
+        if(!values[i])
+            goto failed;
+    }
+
+    return 0;
+
+failed:
+    for(size_t j = 0; j < count; j++) {
+        free(values[j]);
+        values[j] = NULL;
+    }
+
+    return 1;
+}
+
+static int database_sqlite_mexists(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count, int *exists) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    size_t i = 0;
+    int data;
+
+    if(count >= DATABASE_SQLITE_BATCH && database_sqlite_batch_ready(db))
+        return 1;
+
+    for(; i + DATABASE_SQLITE_BATCH <= count; i += DATABASE_SQLITE_BATCH) {
+        for(size_t j = i; j < i + DATABASE_SQLITE_BATCH; j++)
+            exists[j] = 0;
+
+        database_sqlite_bind_keys(db->mexists, keys + i, keylens + i);
+
+        while((data = sqlite3_step(db->mexists)) == SQLITE_ROW)
+            for(size_t j = i; j < i + DATABASE_SQLITE_BATCH; j++)
+                if(database_sqlite_row_match(db->mexists, keys[j], keylens[j]))
+                    exists[j] = 1;
+
+        if(data != SQLITE_DONE) {
+            libflist_set_error("mexists: sqlite3_step: %s", sqlite3_errmsg(db->db));
+            return 1;
+        }
+    }
+
+    for(; i < count; i++)
+        exists[i] = database_sqlite_exists(database, keys[i], keylens[i]);
+
+    return 0;
+}
+
+static int database_sqlite_mset(flist_db_t *database, uint8_t **keys, size_t *keylens, uint8_t **payloads, size_t *lengths, size_t count) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    size_t i = 0;
+
+    if(count >= DATABASE_SQLITE_BATCH && database_sqlite_batch_ready(db))
+        return 1;
+
+    for(; i + DATABASE_SQLITE_BATCH <= count; i += DATABASE_SQLITE_BATCH) {
+        sqlite3_reset(db->minsert);
+
+        for(size_t j = 0; j < DATABASE_SQLITE_BATCH; j++) {
+            sqlite3_bind_text(db->minsert, (j * 2) + 1, (char *) keys[i + j], keylens[i + j], SQLITE_STATIC);
+            sqlite3_bind_blob(db->minsert, (j * 2) + 2, payloads[i + j], lengths[i + j], SQLITE_STATIC);
+        }
+
+        if(sqlite3_step(db->minsert) != SQLITE_DONE) {
+            libflist_set_error("mset: sqlite3_step: %s", sqlite3_errmsg(db->db));
+            return 1;
+        }
+
+        db->updated = 1;
+    }
+
+    for(; i < count; i++)
+        if(database_sqlite_set(database, keys[i], keylens[i], payloads[i], lengths[i]))
+            return 1;
+
+    return 0;
+}
+
+static int database_sqlite_mdel(flist_db_t *database, uint8_t **keys, size_t *keylens, size_t count) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    size_t i = 0;
+
+    if(count >= DATABASE_SQLITE_BATCH && database_sqlite_batch_ready(db))
+        return 1;
+
+    for(; i + DATABASE_SQLITE_BATCH <= count; i += DATABASE_SQLITE_BATCH) {
+        database_sqlite_bind_keys(db->mdelete, keys + i, keylens + i);
+
+        if(sqlite3_step(db->mdelete) != SQLITE_DONE) {
+            libflist_set_error("mdel: sqlite3_step: %s", sqlite3_errmsg(db->db));
+            return 1;
+        }
+
+        db->updated = 1;
+    }
+
+    for(; i < count; i++)
+        if(database_sqlite_del(database, keys[i], keylens[i]))
+            return 1;
+
+    return 0;
+}
+
+// compact the database, this rewrites the whole file and is only
+// done once, when the flist is committed
+int libflist_db_sqlite_vacuum(char *rootpath) {
+    char *filename;
+    sqlite3 *db;
+    int value = 0;
+
+    if(asprintf(&filename, "%s/flistdb.sqlite3", rootpath) < 0) {
+        diep("asprintf");
+        return 1;
+    }
+
+    debug("[+] libflist: sqlite: compacting database\n");
+
+    if(sqlite3_open_v2(filename, &db, SQLITE_OPEN_READWRITE, NULL)) {
+        libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(db));
+        value = 1;
+
+    } else if(sqlite3_exec(db, "VACUUM;", NULL, NULL, NULL) != SQLITE_OK) {
+        libflist_set_error("sqlite: vacuum: %s", sqlite3_errmsg(db));
+        value = 1;
+    }
+
+    sqlite3_close(db);
+    free(filename);
+
+    return value;
+}
+
+// sqlite database object, using 'filename' database (owned)
+static flist_db_t *database_sqlite_init(char *rootpath, char *filename, flist_db_profile_t profile, char *vfs) {
     flist_db_t *db;
 
     // allocate generic database object
-    if(!(db = malloc(sizeof(flist_db_t))))
+    if(!(db = malloc(sizeof(flist_db_t)))) {
+        free(filename);
         return NULL;
+    }
 
     // set our custom sqlite database handler
-    if(!(db->handler = malloc(sizeof(database_sqlite_t)))) {
+    if(!(db->handler = calloc(sizeof(database_sqlite_t), 1))) {
+        free(filename);
         free(db);
         return NULL;
     }
@@ -355,21 +797,18 @@ flist_db_t *libflist_db_sqlite_init(char *rootpath) {
 
     // setting the sqlite handler
     handler->root = rootpath;
+    handler->filename = filename;
     handler->updated = 0;
+    handler->profile = profile;
+    handler->vfs = vfs;
 
     // database not optimized yet
     handler->insert = NULL;
     handler->select = NULL;
 
-    if(asprintf(&handler->filename, "%s/flistdb.sqlite3", rootpath) < 0) {
-        diep("asprintf");
-        free(db->handler);
-        free(db);
-        return NULL;
-    }
-
     // setting global db
     db->type = "SQLITE3";
+    db->concurrent = 0;
 
     // fillin handlers
     db->open = database_sqlite_open;
@@ -377,8 +816,14 @@ flist_db_t *libflist_db_sqlite_init(char *rootpath) {
     db->close = database_sqlite_close;
     db->get = database_sqlite_get;
     db->set = database_sqlite_set;
+    db->pset = database_sqlite_set;
+    db->flush = database_sqlite_flush;
     db->del = database_sqlite_del;
     db->exists = database_sqlite_exists;
+    db->mexists = database_sqlite_mexists;
+    db->mget = database_sqlite_mget;
+    db->mset = database_sqlite_mset;
+    db->mdel = database_sqlite_mdel;
     db->clean = database_sqlite_clean;
     db->sset = database_sqlite_sset;
     db->sget = database_sqlite_sget;
@@ -391,3 +836,35 @@ flist_db_t *libflist_db_sqlite_init(char *rootpath) {
 
     return db;
 }
+
+// public sqlite function initializer
+flist_db_t *libflist_db_sqlite_init_profile(char *rootpath, flist_db_profile_t profile) {
+    char *filename;
+
+    if(asprintf(&filename, "%s/flistdb.sqlite3", rootpath) < 0) {
+        diep("asprintf");
+        return NULL;
+    }
+
+    return database_sqlite_init(rootpath, filename, profile, NULL);
+}
+
+// database read in place from a seekable archive (read-only),
+// the archive needs to stay unchanged while opened
+flist_db_t *libflist_db_sqlite_init_archive(char *filename) {
+    char *vfs, *copy;
+
+    if(!(vfs = archive_vfs_register()))
+        return NULL;
+
+    if(!(copy = strdup(filename))) {
+        diep("strdup");
+        return NULL;
+    }
+
+    return database_sqlite_init(NULL, copy, FLIST_DB_READONLY, vfs);
+}
+
+flist_db_t *libflist_db_sqlite_init(char *rootpath) {
+    return libflist_db_sqlite_init_profile(rootpath, FLIST_DB_DEFAULT);
+}
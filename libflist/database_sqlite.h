@@ -3,10 +3,15 @@
 
     #include <sqlite3.h>
 
+    // amount of keys per batch statement
+    #define DATABASE_SQLITE_BATCH  64
+
     typedef struct database_sqlite_t {
         char *root;
         char *filename;
+        char *vfs;              // sqlite vfs name (NULL for default)
         sqlite3 *db;
+        flist_db_profile_t profile;
 
         int updated;
         sqlite3_stmt *select;
@@ -18,6 +23,11 @@
         sqlite3_stmt *mddel;
         sqlite3_stmt *mdlist;
 
+        sqlite3_stmt *mselect;  // batch statements (prepared when needed)
+        sqlite3_stmt *mexists;
+        sqlite3_stmt *minsert;
+        sqlite3_stmt *mdelete;
+
     } database_sqlite_t;
 
 #endif
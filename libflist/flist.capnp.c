@@ -12,12 +12,12 @@ static const capn_text capn_val0 = {0,"",0};
 
 FileBlock_ptr new_FileBlock(struct capn_segment *s) {
 	FileBlock_ptr p;
-	p.p = capn_new_struct(s, 0, 2);
+	p.p = capn_new_struct(s, 8, 2);
 	return p;
 }
 FileBlock_list new_FileBlock_list(struct capn_segment *s, int len) {
 	FileBlock_list p;
-	p.p = capn_new_list(s, len, 0, 2);
+	p.p = capn_new_list(s, len, 8, 2);
 	return p;
 }
 void read_FileBlock(struct FileBlock *s capnp_unused, FileBlock_ptr p) {
@@ -25,12 +25,16 @@ void read_FileBlock(struct FileBlock *s capnp_unused, FileBlock_ptr p) {
 	capnp_use(s);
 	s->hash = capn_get_data(p.p, 0);
 	s->key = capn_get_data(p.p, 1);
+	s->size = capn_read32(p.p, 0);
+	s->codec = capn_read16(p.p, 4);
 }
 void write_FileBlock(const struct FileBlock *s capnp_unused, FileBlock_ptr p) {
 	capn_resolve(&p.p);
 	capnp_use(s);
 	capn_setp(p.p, 0, s->hash.p);
 	capn_setp(p.p, 1, s->key.p);
+	capn_write32(p.p, 0, s->size);
+	capn_write16(p.p, 4, s->codec);
 }
 void get_FileBlock(struct FileBlock *s, FileBlock_list l, int i) {
 	FileBlock_ptr p;
@@ -64,13 +64,15 @@ enum Special_Type {
 struct FileBlock {
 	capn_data hash;
 	capn_data key;
+	uint32_t size;
+	uint16_t codec;
 };
 
-static const size_t FileBlock_word_count = 0;
+static const size_t FileBlock_word_count = 1;
 
 static const size_t FileBlock_pointer_count = 2;
 
-static const size_t FileBlock_struct_bytes_count = 16;
+static const size_t FileBlock_struct_bytes_count = 24;
 
 struct File {
 	uint16_t blockSize;
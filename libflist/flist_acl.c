@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <errno.h>
 #include <blake2.h>
 #include <pwd.h>
 #include <grp.h>
@@ -14,37 +15,85 @@
 //
 // access-control list management
 //
-static char *uidstr(struct passwd *passwd, uid_t uid) {
-    char *target;
+// initial buffer size for reentrant passwd and group lookups
+// (acl are created from multiple threads when adding files)
+static size_t flist_acl_bufsize(int name) {
+    long value = sysconf(name);
+    return (value > 0) ? (size_t) value : 1024;
+}
+
+static char *uidstr(uid_t uid) {
+    size_t length = flist_acl_bufsize(_SC_GETPW_R_SIZE_MAX);
+    struct passwd pwd, *passwd = NULL;
+    char *buffer = NULL, *target;
+    int value;
+
+    do {
+        char *grow;
+
+        if(!(grow = realloc(buffer, length)))
+            diep("realloc");
+
+        buffer = grow;
+        value = getpwuid_r(uid, &pwd, buffer, length, &passwd);
+        length *= 2;
+
+    } while(value == ERANGE);
 
     // if username cannot be found
     // let use user id as username
     if(!passwd) {
+        errno = value;
         libflist_warnp("getpwuid");
 
         if(asprintf(&target, "%d", uid) < 0)
             diep("asprintf");
 
+        free(buffer);
         return target;
     }
 
-    return strdup(passwd->pw_name);
+    target = strdup(passwd->pw_name);
+    free(buffer);
+
+    return target;
 }
 
-static char *gidstr(struct group *group, gid_t gid) {
-    char *target;
+static char *gidstr(gid_t gid) {
+    size_t length = flist_acl_bufsize(_SC_GETGR_R_SIZE_MAX);
+    struct group grp, *group = NULL;
+    char *buffer = NULL, *target;
+    int value;
+
+    do {
+        char *grow;
+
+        if(!(grow = realloc(buffer, length)))
+            diep("realloc");
+
+        buffer = grow;
+        value = getgrgid_r(gid, &grp, buffer, length, &group);
+        length *= 2;
+
+    } while(value == ERANGE);
 
     // if group name cannot be found
     // let use group id as groupname
     if(!group) {
+        errno = value;
         warnp("getgrpid");
+
         if(asprintf(&target, "%d", gid) < 0)
             diep("asprintf");
 
+        free(buffer);
         return target;
     }
 
-    return strdup(group->gr_name);
+    target = strdup(group->gr_name);
+    free(buffer);
+
+    return target;
 }
 
 char *flist_acl_key(acl_t *acl) {
@@ -130,8 +179,8 @@ acl_t *libflist_acl_duplicate(acl_t *source) {
 }
 
 acl_t *flist_acl_from_stat(const struct stat *sb) {
-    char *uname = uidstr(getpwuid(sb->st_uid), sb->st_uid);
-    char *gname = gidstr(getgrgid(sb->st_gid), sb->st_gid);
+    char *uname = uidstr(sb->st_uid);
+    char *gname = gidstr(sb->st_gid);
 
     // keep only the permissions mode
     mode_t mode = sb->st_mode & ~S_IFMT;
@@ -168,6 +168,22 @@ int flist_directory_rm_recursively(flist_db_t *database, dirnode_t *dirnode) {
     return 0;
 }
 
+// incremental mode: check if a regular file didn't change since
+// the previous inode was created (device and inode number of the source
+// are not stored on the flist, change time is used on strict mode)
+static int flist_inode_unchanged(inode_t *previous, const struct stat *sb, flist_incremental_t mode) {
+    if(previous->type != INODE_FILE || !previous->chunks)
+        return 0;
+
+    if(previous->size != (size_t) sb->st_size || previous->modification != sb->st_mtime)
+        return 0;
+
+    if(mode == FLIST_INCREMENTAL_STRICT && previous->creation != sb->st_ctime)
+        return 0;
+
+    return 1;
+}
+
 static inode_t *flist_process_file(const char *iname, const struct stat *sb, const char *realpath, dirnode_t *parent, flist_ctx_t *ctx) {
     inode_t *inode;
 
@@ -194,13 +210,6 @@ static inode_t *flist_process_file(const char *iname, const struct stat *sb, con
     if(S_ISDIR(sb->st_mode)) {
         inode->type = INODE_DIRECTORY;
         inode->subdirkey = libflist_path_key(vpath);
-
-        // create entry on the database
-        debug("[+] libflist: process file: creating new directory entry\n");
-        dirnode_t *newdir = flist_dirnode_create_from_stat(parent, iname, sb);
-        flist_dirnode_appends_dirnode(parent, newdir);
-        flist_serial_commit_dirnode(newdir, ctx, parent);
-        // flist_dirnode_free(newdir); // FIXME ?
     }
 
     if(S_ISCHR(sb->st_mode) || S_ISBLK(sb->st_mode)) {
@@ -224,8 +233,21 @@ static inode_t *flist_process_file(const char *iname, const struct stat *sb, con
     }
 
     if(S_ISREG(sb->st_mode)) {
+        inode_t *previous;
         inode->type = INODE_FILE;
 
+        // file unchanged since previous run, reusing chunks
+        if(ctx->incremental && (previous = flist_inode_search(parent, (char *) iname))) {
+            if(flist_inode_unchanged(previous, sb, ctx->incremental)) {
+                debug("[+] libflist: process file: %s unchanged, reusing chunks\n", vpath);
+
+                if(!(inode->chunks = flist_chunks_duplicate(previous->chunks)))
+                    return NULL;
+
+                return inode;
+            }
+        }
+
         // computing chunks
         if(!(inode->chunks = libflist_chunks_proceed((char *) realpath, ctx)))
             return NULL;
@@ -281,6 +303,22 @@ inode_t *flist_inode_from_localfile(char *localpath, dirnode_t *parent, flist_ct
     if(!(inode = flist_process_file(filename, &sb, localpath, parent, ctx)))
         return NULL;
 
+    if(inode->type == INODE_DIRECTORY) {
+        // create entry on the database
+        debug("[+] libflist: process file: creating new directory entry\n");
+        dirnode_t *newdir = flist_dirnode_create_from_stat(parent, filename, &sb);
+        flist_dirnode_appends_dirnode(parent, newdir);
+
+        if(flist_serial_commit_dirnode(newdir, ctx, parent)) {
+            fprintf(stderr, "[-] libflist: process file: %s\n", libflist_strerror());
+            flist_inode_free(inode);
+            free(localdup);
+            return NULL;
+        }
+
+        // flist_dirnode_free(newdir); // FIXME ?
+    }
+
     free(localdup);
 
     return inode;
@@ -290,6 +328,86 @@ static int fts_compare(const FTSENT **one, const FTSENT **two) {
     return (strcmp((*one)->fts_name, (*two)->fts_name));
 }
 
+// release working directories not committed (error)
+static void flist_localdir_abort(dirnode_t *workingdir, dirnode_t *parent) {
+    while(workingdir && workingdir != parent) {
+        dirnode_t *next = workingdir->next;
+        flist_dirnode_free(workingdir);
+        workingdir = next;
+    }
+}
+
+// incremental mode: amount of entries loaded from the flist and not found
+// (yet) on the local directory, per depth of the walk, these entries are
+// always at the head of the directory list (new entries are appended)
+static size_t *flist_localdir_unseen(size_t **unseen, size_t *length, size_t level) {
+    if(level >= *length) {
+        size_t allocated = level + 32;
+        size_t *list;
+
+        if(!(list = realloc(*unseen, sizeof(size_t) * allocated)))
+            return libflist_errp("localdir: unseen: realloc");
+
+        memset(list + *length, 0, sizeof(size_t) * (allocated - *length));
+
+        *unseen = list;
+        *length = allocated;
+    }
+
+    return &(*unseen)[level];
+}
+
+// remove an entry loaded from the flist, a directory replaced by another
+// type of entry (or removed) is removed from the database with its contents
+static void flist_localdir_remove(dirnode_t *dirnode, inode_t *inode, int keepdir, flist_ctx_t *ctx) {
+    if(inode->type == INODE_DIRECTORY && !keepdir) {
+        dirnode_t *removed;
+
+        if((removed = flist_dirnode_get_recursive(ctx->db, inode->fullpath))) {
+            flist_directory_rm_recursively(ctx->db, removed);
+            flist_dirnode_free_recursive(removed);
+        }
+    }
+
+    flist_directory_rm_inode(dirnode, inode);
+    flist_inode_free(inode);
+}
+
+// incremental mode: entry found again on the local directory,
+// the previous version is replaced by the new one
+static void flist_localdir_replace(dirnode_t *dirnode, inode_t *inode, size_t *unseen, flist_ctx_t *ctx) {
+    inode_t *previous;
+
+    if(!(previous = flist_inode_search(dirnode, inode->name)))
+        return;
+
+    flist_localdir_remove(dirnode, previous, inode->type == INODE_DIRECTORY, ctx);
+
+    if(*unseen)
+        *unseen -= 1;
+}
+
+// incremental mode: directory completed, entries loaded from
+// the flist and not found on the local directory are removed
+static void flist_localdir_prune(dirnode_t *dirnode, size_t unseen, flist_ctx_t *ctx) {
+    for(; unseen && dirnode->inode_list; unseen--) {
+        debug("[+] libflist: localdir: removed from source: %s\n", dirnode->inode_list->fullpath);
+        flist_localdir_remove(dirnode, dirnode->inode_list, 0, ctx);
+    }
+}
+
+//
+// the local tree is walked once, each directory is kept in memory
+// while it's contents is processed (pre-order) and serialized once,
+// when it's completed (post-order), only the current branch is
+// kept in memory
+//
+// on incremental mode, directories already on the flist are loaded and
+// updated: metadata are refreshed, entries replaced and entries which
+// don't exist anymore on the local directory are removed
+//
+// serialized directories are written to the database by batches
+//
 inode_t *flist_inode_from_localdir(char *localreldir, dirnode_t *parent, flist_ctx_t *ctx) {
     discard char *localdir = NULL;
     struct stat sb;
@@ -316,126 +434,164 @@ inode_t *flist_inode_from_localdir(char *localreldir, dirnode_t *parent, flist_c
     FTS* fs = NULL;
     FTSENT *fentry = NULL;
     char *ftsargv[2] = {localdir, NULL};
-    discard char *tmpsrcdup = strdup(localdir);
-    char *tmpsrc = dirname(tmpsrcdup);
     inode_t *inode = NULL;
     dirnode_t *workingdir = parent;
+    flist_serial_batch_t *batch;
+    size_t *unseen = NULL;
+    size_t unseenlen = 0;
 
-    if(strcmp(tmpsrc, "/") == 0) {
-        free(tmpsrcdup);
-        tmpsrcdup = strdup("");
-        tmpsrc = tmpsrcdup;
-    }
+    // counting entries, only needed for progression report
+    if(ctx->progress_cb) {
+        if(!(fs = fts_open(ftsargv, FTS_NOCHDIR | FTS_NOSTAT | FTS_PHYSICAL, &fts_compare)))
+            diep(localdir);
 
-    //
-    // first pass:
-    //   creating all directories hierarchy
-    //
-    debug("[+] libflist: localdir: ---\n");
-    debug("[+] libflist: localdir: processing pass one\n");
-    debug("[+] libflist: localdir: ---\n");
+        libflist_progress(ctx, "computing hierarchy", 0, 0);
+
+        while((fentry = fts_read(fs)))
+            total += 1;
+
+        fts_close(fs);
+    }
 
     if(!(fs = fts_open(ftsargv, FTS_NOCHDIR | FTS_NOSTAT | FTS_PHYSICAL, &fts_compare)))
         diep(localdir);
 
-    libflist_progress(ctx, "computing hierarchy", 0, 0);
+    batch = flist_serial_batch_new(ctx);
+
+    // current statistic
+    size_t current = 0;
 
     while((fentry = fts_read(fs))) {
-        // update statistics
-        total += 1;
+        // updating statistics
+        current += 1;
+        libflist_progress(ctx, "processing", current, total);
 
-        // skip non directory
-        if(fentry->fts_info != FTS_D)
-            continue;
+        discard char *target = flist_dirnode_virtual_path(parent, fentry->fts_path + strlen(localdir));
 
-        if(strcmp(fentry->fts_path, localdir) == 0)
-            continue;
+        debug("[+] libflist: processing: %s -> %s\n", fentry->fts_path, target);
 
-        discard char *vpath = flist_dirnode_virtual_path(workingdir, fentry->fts_path + strlen(localdir));
-        discard char *parentdup = strdup(vpath);
-        char *parentpath = dirname(parentdup);
+        if(fentry->fts_info == FTS_D) {
+            // pre-order directory, let's load (or create) the directory
+            // and keep track of the previous (inside 'next' field)
+            debug("[+] libflist: switching to virtual directory: %s\n", target);
+            dirnode_t *newdir = NULL;
+            size_t *previous;
 
-        debug("[+] libflist: local directory: adding: %s [%s]\n", fentry->fts_name, parentpath);
+            if(!(previous = flist_localdir_unseen(&unseen, &unseenlen, fentry->fts_level)))
+                goto failed;
 
-        // fetching parent directory
-        dirnode_t *localparent = flist_dirnode_get(ctx->db, parentpath);
+            *previous = 0;
 
-        // adding this new directory
-        if(!(inode = libflist_inode_from_localfile(fentry->fts_path, localparent, ctx))) {
-            fprintf(stderr, "[-] libflist: local directory: could not create inode (pass 1)\n");
-            return NULL;
-        }
+            // root directory contents is added to the existing parent
+            if(fentry->fts_level == FTS_ROOTLEVEL) {
+                if((newdir = flist_dirnode_get(ctx->db, target)) && ctx->incremental)
+                    *previous = newdir->inode_length;
 
-        // saving changes
-        flist_dirnode_appends_inode(localparent, inode);
-        flist_serial_commit_dirnode(localparent, ctx, localparent);
+            } else {
+                // stat buffer is not filled by fts (FTS_NOSTAT)
+                if(lstat(fentry->fts_path, &sb) < 0) {
+                    warnp(fentry->fts_path);
+                    goto failed;
+                }
 
-        flist_dirnode_free(localparent);
-    }
+                // incremental mode: directory already exists, keeping
+                // it's contents, metadata are refreshed
+                if(ctx->incremental) {
+                    inode_t *existing = flist_inode_search(workingdir, fentry->fts_name);
 
-    fts_close(fs);
+                    if(existing && existing->type == INODE_DIRECTORY && (newdir = flist_dirnode_get(ctx->db, target))) {
+                        if(newdir->acl)
+                            flist_acl_free(newdir->acl);
 
-    //
-    // second pass:
-    //   processing all files
-    //
-    debug("[+] libflist: localdir: ---\n");
-    debug("[+] libflist: localdir: processing pass two\n");
-    debug("[+] libflist: localdir: ---\n");
+                        newdir->acl = flist_acl_from_stat(&sb);
+                        newdir->creation = sb.st_ctime;
+                        newdir->modification = sb.st_mtime;
 
-    if(!(fs = fts_open(ftsargv, FTS_NOCHDIR | FTS_NOSTAT | FTS_PHYSICAL, &fts_compare)))
-        diep(localdir);
+                        *previous = newdir->inode_length;
+                    }
+                }
 
-    // reset working directory
-    workingdir = parent;
+                if(!(inode = flist_process_file(fentry->fts_name, &sb, fentry->fts_path, workingdir, ctx))) {
+                    fprintf(stderr, "[-] libflist: local directory: could not create inode\n");
 
-    // current statistic
-    size_t current = 0;
+                    if(newdir)
+                        flist_dirnode_free(newdir);
 
-    while((fentry = fts_read(fs))) {
-        // updating statistics
-        current += 1;
-        libflist_progress(ctx, "processing", current, total);
+                    goto failed;
+                }
 
-        discard char *target = flist_dirnode_virtual_path(parent, fentry->fts_path + strlen(localdir));
+                if(ctx->incremental)
+                    flist_localdir_replace(workingdir, inode, &unseen[fentry->fts_level - 1], ctx);
 
-        debug("[+] libflist: processing: %s -> %s\n", fentry->fts_path, target);
+                flist_dirnode_appends_inode(workingdir, inode);
 
-        if(fentry->fts_info == FTS_D) {
-            // pre-order directory, let's load the new directory
-            // and keep track of the previous (insde 'next' field)
-            debug("[+] libflist: switching to virtual directory: %s\n", target);
+                // adding this new directory
+                if(!newdir)
+                    newdir = flist_dirnode_create_from_stat(workingdir, fentry->fts_name, &sb);
+            }
+
+            if(!newdir) {
+                fprintf(stderr, "[-] libflist: local directory: could not load directory: %s\n", target);
+                goto failed;
+            }
 
-            dirnode_t *newdir = flist_dirnode_get(ctx->db, target);
             newdir->next = workingdir;
             workingdir = newdir;
             continue;
         }
 
         if(fentry->fts_info == FTS_DP) {
-            // post-order directory, let's commit it's contents
-            // and reload previous directory
+            // post-order directory, contents is complete, let's
+            // serialize it and reload previous directory
+            if(ctx->incremental)
+                flist_localdir_prune(workingdir, unseen[fentry->fts_level], ctx);
+
             debug("[+] libflist: commiting: %s\n", workingdir->fullpath);
 
-            flist_serial_commit_dirnode(workingdir, ctx, workingdir->next);
+            int committed = flist_serial_batch_commit(batch, workingdir, workingdir->next);
             dirnode_t *next = workingdir->next;
 
             flist_dirnode_free(workingdir);
             workingdir = next;
+
+            if(committed) {
+                fprintf(stderr, "[-] libflist: local directory: %s\n", libflist_strerror());
+                goto failed;
+            }
+
             continue;
         }
 
         if(!(inode = libflist_inode_from_localfile(fentry->fts_path, workingdir, ctx))) {
-            fprintf(stderr, "[-] libflist: local directory: could not create inode (pass 2)\n");
-            return NULL;
+            fprintf(stderr, "[-] libflist: local directory: could not create inode\n");
+            goto failed;
         }
 
+        // incremental mode: replacing previous version of this entry
+        if(ctx->incremental)
+            flist_localdir_replace(workingdir, inode, &unseen[fentry->fts_level - 1], ctx);
+
         flist_dirnode_appends_inode(workingdir, inode);
     }
 
     fts_close(fs);
+    free(unseen);
+
+    if(flist_serial_batch_free(batch)) {
+        fprintf(stderr, "[-] libflist: local directory: %s\n", libflist_strerror());
+        return NULL;
+    }
 
     return inode;
+
+failed:
+    // directories already completed are kept
+    flist_localdir_abort(workingdir, parent);
+    fts_close(fs);
+    free(unseen);
+    flist_serial_batch_free(batch);
+
+    return NULL;
 }
 
 inode_t *flist_inode_from_dirnode(dirnode_t *dirnode) {
@@ -12,6 +12,7 @@
 #include "flist.capnp.h"
 #include "flist_dirnode.h"
 #include "flist_inode.h"
+#include "flist_acl.h"
 #include "flist_serial.h"
 
 
@@ -82,12 +83,32 @@ static inode_chunks_t *flist_inode_to_chunks(struct Inode *inode) {
 
         blocks->list[i].decipher = libflist_bufdup(block.key.p.data, block.key.p.len);
         blocks->list[i].decipherlen = block.key.p.len;
+
+        // not set on flist created before block size was stored
+        blocks->list[i].size = block.size;
+        blocks->list[i].codec = block.codec;
     }
 
     return blocks;
 }
 
-inode_t *flist_itementry_to_inode(flist_db_t *database, struct Dir *dir, int fileindex) {
+//
+// acls of a directory
+//
+// entries of a directory usually shares a few distinct acls, they are
+// all fetched with one batch request when the directory is loaded, and
+// each entry gets its own copy
+//
+typedef struct flist_serial_acls_t {
+    char **keys;      // distinct keys (pointing to the capnp message)
+    acl_t **acls;     // loaded acls (NULL if not found)
+    size_t length;
+
+} flist_serial_acls_t;
+
+static acl_t *flist_serial_acl_lookup(flist_db_t *database, flist_serial_acls_t *acls, const char *aclkey);
+
+inode_t *flist_itementry_to_inode(flist_db_t *database, flist_serial_acls_t *acls, struct Dir *dir, int fileindex) {
     inode_t *target;
     Inode_ptr inodep;
     struct Inode inode;
@@ -108,7 +129,7 @@ inode_t *flist_itementry_to_inode(flist_db_t *database, struct Dir *dir, int fil
     target->creation = inode.creationTime;
     target->modification = inode.modificationTime;
 
-    if(!(target->acl = flist_serial_get_acl(database, inode.aclkey.str))) {
+    if(!(target->acl = flist_serial_acl_lookup(database, acls, inode.aclkey.str))) {
         flist_inode_free(target);
         return NULL;
     }
@@ -156,20 +177,9 @@ inode_t *flist_itementry_to_inode(flist_db_t *database, struct Dir *dir, int fil
 //
 // capnp deserializers
 //
-acl_t *flist_serial_get_acl(flist_db_t *database, const char *aclkey) {
+static acl_t *flist_serial_acl_parse(value_t *rawdata, const char *aclkey) {
     acl_t *acl;
 
-    if(strlen(aclkey) == 0) {
-        debug("[-] libflist: acl: get: empty key, cannot load it\n");
-        return NULL;
-    }
-
-    value_t *rawdata = database->sget(database, (char *) aclkey);
-    if(!rawdata->data) {
-        debug("[-] libflist: acl: get: acl key <%s> not found\n", aclkey);
-        return NULL;
-    }
-
     if(!(acl = malloc(sizeof(acl_t)))) {
         warnp("acl: malloc");
         return NULL;
@@ -183,6 +193,7 @@ acl_t *flist_serial_get_acl(flist_db_t *database, const char *aclkey) {
     struct capn permsctx;
     if(capn_init_mem(&permsctx, (unsigned char *) rawdata->data, rawdata->length, 0)) {
         debug("[-] libflist: acl: capnp: init error\n");
+        free(acl);
         return NULL;
     }
 
@@ -199,18 +210,154 @@ acl_t *flist_serial_get_acl(flist_db_t *database, const char *aclkey) {
     acl->gid = aci.gid;
 
     capn_free(&permsctx);
+
+    return acl;
+}
+
+acl_t *flist_serial_get_acl(flist_db_t *database, const char *aclkey) {
+    acl_t *acl;
+
+    if(strlen(aclkey) == 0) {
+        debug("[-] libflist: acl: get: empty key, cannot load it\n");
+        return NULL;
+    }
+
+    value_t *rawdata = database->sget(database, (char *) aclkey);
+    if(!rawdata->data) {
+        debug("[-] libflist: acl: get: acl key <%s> not found\n", aclkey);
+        database->clean(rawdata);
+        return NULL;
+    }
+
+    acl = flist_serial_acl_parse(rawdata, aclkey);
     database->clean(rawdata);
 
     return acl;
 }
 
+static void flist_serial_acls_free(flist_serial_acls_t *acls) {
+    for(size_t i = 0; i < acls->length; i++)
+        if(acls->acls[i])
+            flist_acl_free(acls->acls[i]);
+
+    free(acls->keys);
+    free(acls->acls);
+}
+
+static void flist_serial_acls_append(flist_serial_acls_t *acls, char *key) {
+    if(strlen(key) == 0)
+        return;
+
+    for(size_t i = 0; i < acls->length; i++)
+        if(strcmp(acls->keys[i], key) == 0)
+            return;
+
+    acls->keys[acls->length++] = key;
+}
+
+// collect and load all acls used by a directory, returns 1 if the
+// batch could not be done (entries acls are then loaded one by one)
+static int flist_serial_acls_load(flist_db_t *database, struct Dir *dir, flist_serial_acls_t *acls) {
+    size_t entries = capn_len(dir->contents) + 1;
+    uint8_t **keys = NULL;
+    size_t *keylens = NULL;
+    value_t **values = NULL;
+    int value = 1;
+
+    acls->keys = calloc(sizeof(char *), entries);
+    acls->acls = calloc(sizeof(acl_t *), entries);
+    acls->length = 0;
+
+    if(!acls->keys || !acls->acls) {
+        warnp("acls: calloc");
+        goto cleanup;
+    }
+
+    flist_serial_acls_append(acls, (char *) dir->aclkey.str);
+
+    for(int i = 0; i < capn_len(dir->contents); i++) {
+        Inode_ptr inodep;
+        struct Inode inode;
+
+        inodep.p = capn_getp(dir->contents.p, i, 1);
+        read_Inode(&inode, inodep);
+
+        flist_serial_acls_append(acls, (char *) inode.aclkey.str);
+    }
+
+    keys = malloc(sizeof(uint8_t *) * acls->length);
+    keylens = malloc(sizeof(size_t) * acls->length);
+    values = malloc(sizeof(value_t *) * acls->length);
+
+    if(acls->length && (!keys || !keylens || !values)) {
+        warnp("acls: malloc");
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < acls->length; i++) {
+        keys[i] = (uint8_t *) acls->keys[i];
+        keylens[i] = strlen(acls->keys[i]);
+    }
+
+    if(database->mget(database, keys, keylens, acls->length, values)) {
+        debug("[-] libflist: acls: batch load failed: %s\n", libflist_strerror());
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < acls->length; i++) {
+        if(values[i]->data)
+            acls->acls[i] = flist_serial_acl_parse(values[i], acls->keys[i]);
+
+        database->clean(values[i]);
+    }
+
+    value = 0;
+
+cleanup:
+    free(keys);
+    free(keylens);
+    free(values);
+
+    return value;
+}
+
+// private copy of a loaded acl, directly from the database
+// if the directory acls could not be loaded
+static acl_t *flist_serial_acl_lookup(flist_db_t *database, flist_serial_acls_t *acls, const char *aclkey) {
+    acl_t *source = NULL;
+    acl_t *acl;
+
+    if(!acls)
+        return flist_serial_get_acl(database, aclkey);
+
+    for(size_t i = 0; i < acls->length && !source; i++)
+        if(strcmp(acls->keys[i], aclkey) == 0)
+            source = acls->acls[i];
+
+    if(!source) {
+        debug("[-] libflist: acl: get: acl key <%s> not found\n", aclkey);
+        return NULL;
+    }
+
+    if(!(acl = malloc(sizeof(acl_t)))) {
+        warnp("acl: malloc");
+        return NULL;
+    }
+
+    acl->uname = strdup(source->uname);
+    acl->gname = strdup(source->gname);
+    acl->mode = source->mode;
+    acl->key = strdup(source->key);
+    acl->uid = source->uid;
+    acl->gid = source->gid;
+
+    return acl;
+}
+
 //
 // capnp serializers
 //
-void flist_serial_commit_acl(flist_db_t *database, acl_t *acl) {
-    if(database->sexists(database, acl->key))
-        return;
-
+static uint8_t *flist_serial_acl_payload(acl_t *acl, size_t *length) {
     // create a capnp aci object
     struct ACI aci = {
         .uname = chars_to_text(acl->uname),
@@ -237,12 +384,210 @@ void flist_serial_commit_acl(flist_db_t *database, acl_t *acl) {
     int sz = capn_write_mem(&c, buffer, 4096, 0);
     capn_free(&c);
 
+    *length = sz;
+
+    return libflist_bufdup(buffer, sz);
+}
+
+void flist_serial_commit_acl(flist_db_t *database, acl_t *acl) {
+    uint8_t *payload;
+    size_t length;
+
+    if(database->sexists(database, acl->key))
+        return;
+
+    if(!(payload = flist_serial_acl_payload(acl, &length)))
+        diep("acl: malloc");
+
     debug("[+]   writing acl into db: %s\n", acl->key);
-    if(database->sset(database, acl->key, buffer, sz))
+    if(database->sset(database, acl->key, payload, length))
         dies("acl database error");
+
+    free(payload);
+}
+
+//
+// batched commit
+//
+// directories of a tree are written by batches of FLIST_SERIAL_BATCH
+// entries (existing ones are deleted first), acls are deduplicated and
+// only the missing ones are written, with one existence check per batch
+//
+// a batch owns a copy of everything it keeps (keys and payloads), a
+// directory can be freed as soon as it's queued, this way a batch can
+// be kept over a whole tree walk (see flist_inode_from_localdir)
+//
+#define FLIST_SERIAL_BATCH   256
+#define FLIST_SERIAL_BUFFER  (8 * 512 * 1024)  // FIXME
+
+struct flist_serial_batch_t {
+    flist_db_t *database;
+    flist_ctx_t *ctx;
+    unsigned char *buffer;    // serialization buffer
+
+    // directories entries
+    uint8_t *keys[FLIST_SERIAL_BATCH];
+    size_t keylens[FLIST_SERIAL_BATCH];
+    uint8_t *payloads[FLIST_SERIAL_BATCH];
+    size_t lengths[FLIST_SERIAL_BATCH];
+    size_t length;
+
+    // distinct acls
+    uint8_t *aclkeys[FLIST_SERIAL_BATCH];
+    size_t aclkeylens[FLIST_SERIAL_BATCH];
+    uint8_t *aclpayloads[FLIST_SERIAL_BATCH];
+    size_t acllengths[FLIST_SERIAL_BATCH];
+    size_t aclslen;
+
+};
+
+static void flist_serial_batch_acls_release(flist_serial_batch_t *batch) {
+    for(size_t i = 0; i < batch->aclslen; i++) {
+        free(batch->aclkeys[i]);
+        free(batch->aclpayloads[i]);
+    }
+
+    batch->aclslen = 0;
+}
+
+// queued entries are released, even on error
+static int flist_serial_batch_acls_flush(flist_serial_batch_t *batch) {
+    flist_db_t *database = batch->database;
+    uint8_t *keys[FLIST_SERIAL_BATCH];
+    size_t keylens[FLIST_SERIAL_BATCH];
+    uint8_t *payloads[FLIST_SERIAL_BATCH];
+    size_t lengths[FLIST_SERIAL_BATCH];
+    int exists[FLIST_SERIAL_BATCH];
+    size_t missing = 0;
+
+    if(database->mexists(database, batch->aclkeys, batch->aclkeylens, batch->aclslen, exists)) {
+        libflist_set_error("acl: database error (exists)");
+        flist_serial_batch_acls_release(batch);
+        return 1;
+    }
+
+    for(size_t i = 0; i < batch->aclslen; i++) {
+        if(exists[i])
+            continue;
+
+        debug("[+]   writing acl into db: %s\n", (char *) batch->aclkeys[i]);
+
+        keys[missing] = batch->aclkeys[i];
+        keylens[missing] = batch->aclkeylens[i];
+        payloads[missing] = batch->aclpayloads[i];
+        lengths[missing] = batch->acllengths[i];
+        missing += 1;
+    }
+
+    if(missing && database->mset(database, keys, keylens, payloads, lengths, missing)) {
+        libflist_set_error("acl: database error (set)");
+        flist_serial_batch_acls_release(batch);
+        return 1;
+    }
+
+    flist_serial_batch_acls_release(batch);
+
+    return 0;
+}
+
+static int flist_serial_batch_acl(flist_serial_batch_t *batch, acl_t *acl) {
+    size_t keylen = strlen(acl->key);
+
+    for(size_t i = 0; i < batch->aclslen; i++)
+        if(batch->aclkeylens[i] == keylen && memcmp(batch->aclkeys[i], acl->key, keylen) == 0)
+            return 0;
+
+    if(batch->aclslen == FLIST_SERIAL_BATCH)
+        if(flist_serial_batch_acls_flush(batch))
+            return 1;
+
+    if(!(batch->aclkeys[batch->aclslen] = (uint8_t *) strdup(acl->key)))
+        diep("acl: strdup");
+
+    if(!(batch->aclpayloads[batch->aclslen] = flist_serial_acl_payload(acl, &batch->acllengths[batch->aclslen])))
+        diep("acl: malloc");
+
+    batch->aclkeylens[batch->aclslen] = keylen;
+    batch->aclslen += 1;
+
+    return 0;
+}
+
+static void flist_serial_batch_release(flist_serial_batch_t *batch) {
+    for(size_t i = 0; i < batch->length; i++) {
+        free(batch->keys[i]);
+        free(batch->payloads[i]);
+    }
+
+    batch->length = 0;
+}
+
+// write queued entries, they are released even on error, the
+// batch can still be freed (but the tree is not fully written)
+static int flist_serial_batch_flush(flist_serial_batch_t *batch) {
+    flist_db_t *database = batch->database;
+    uint8_t *existing[FLIST_SERIAL_BATCH];
+    size_t existinglens[FLIST_SERIAL_BATCH];
+    int exists[FLIST_SERIAL_BATCH];
+    size_t found = 0;
+
+    if(batch->length == 0 && batch->aclslen == 0)
+        return 0;
+
+    // chunks are uploaded write-behind, the ones referenced by these
+    // directories need to be stored before the metadata is written
+    if(batch->ctx->backend && libflist_backend_flush(batch->ctx->backend)) {
+        flist_serial_batch_acls_release(batch);
+        flist_serial_batch_release(batch);
+        return 1;
+    }
+
+    if(batch->aclslen && flist_serial_batch_acls_flush(batch)) {
+        flist_serial_batch_release(batch);
+        return 1;
+    }
+
+    if(batch->length == 0)
+        return 0;
+
+    debug("[+] writing %lu directories into db\n", batch->length);
+
+    // replacing existing entries
+    if(database->mexists(database, batch->keys, batch->keylens, batch->length, exists)) {
+        libflist_set_error("dirnode: database error (exists)");
+        flist_serial_batch_release(batch);
+        return 1;
+    }
+
+    for(size_t i = 0; i < batch->length; i++) {
+        if(!exists[i])
+            continue;
+
+        existing[found] = batch->keys[i];
+        existinglens[found] = batch->keylens[i];
+        found += 1;
+    }
+
+    if(found && database->mdel(database, existing, existinglens, found)) {
+        libflist_set_error("dirnode: database error (replacing existing)");
+        flist_serial_batch_release(batch);
+        return 1;
+    }
+
+    if(database->mset(database, batch->keys, batch->keylens, batch->payloads, batch->lengths, batch->length)) {
+        libflist_set_error("dirnode: database error (set)");
+        flist_serial_batch_release(batch);
+        return 1;
+    }
+
+    flist_serial_batch_release(batch);
+
+    return 0;
 }
 
-void flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent) {
+static int flist_serial_batch_dirnode(flist_serial_batch_t *batch, dirnode_t *root, dirnode_t *parent) {
+    flist_ctx_t *ctx = batch->ctx;
+    size_t keylen = strlen(root->hashkey);
     struct capn c;
     capn_init_malloc(&c);
     capn_ptr cr = capn_root(&c);
@@ -262,7 +607,10 @@ void flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *p
         .creationTime = root->creation,
     };
 
-    flist_serial_commit_acl(ctx->db, root->acl);
+    if(flist_serial_batch_acl(batch, root->acl)) {
+        capn_free(&c);
+        return 1;
+    }
 
     // populating contents
     int index = 0;
@@ -335,6 +683,8 @@ void flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *p
 
                         block.hash.p = capn_databinary(cs, (char *) chk->entryid, chk->entrylen);
                         block.key.p = capn_databinary(cs, (char *) chk->decipher, chk->decipherlen);
+                        block.size = chk->size;
+                        block.codec = chk->codec;
 
                         set_FileBlock(&block, f.blocks, i);
                     }
@@ -349,37 +699,104 @@ void flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *p
         }
 
         set_Inode(&target, dir.contents, index);
-        flist_serial_commit_acl(ctx->db, inode->acl);
+
+        if(flist_serial_batch_acl(batch, inode->acl)) {
+            capn_free(&c);
+            return 1;
+        }
     }
 
     // commit capnp object
-    unsigned char *buffer = malloc(8 * 512 * 1024); // FIXME
-
     Dir_ptr dp = new_Dir(cs);
     write_Dir(&dir, dp);
 
-
     if(capn_setp(capn_root(&c), 0, dp.p))
         dies("capnp setp failed");
 
-    int sz = capn_write_mem(&c, buffer, 8 * 512 * 1024, 0); // FIXME
+    int sz = capn_write_mem(&c, batch->buffer, FLIST_SERIAL_BUFFER, 0);
     capn_free(&c);
 
-    // commit this object into the database
+    // queue this object for the database, the same directory
+    // can't be written twice on the same batch
     debug("[+] writing into db: %s\n", root->hashkey);
-    if(ctx->db->sexists(ctx->db, root->hashkey)) {
-        if(ctx->db->sdel(ctx->db, root->hashkey))
-            dies("key exists, deleting: database error");
+
+    for(size_t i = 0; i < batch->length; i++) {
+        if(batch->keylens[i] == keylen && memcmp(batch->keys[i], root->hashkey, keylen) == 0) {
+            if(flist_serial_batch_flush(batch))
+                return 1;
+
+            break;
+        }
     }
 
-    if(ctx->db->sset(ctx->db, root->hashkey, buffer, sz))
-        dies("database error");
+    if(batch->length == FLIST_SERIAL_BATCH)
+        if(flist_serial_batch_flush(batch))
+            return 1;
+
+    if(!(batch->keys[batch->length] = (uint8_t *) strdup(root->hashkey)))
+        diep("dirnode: strdup");
+
+    batch->keylens[batch->length] = keylen;
+    batch->lengths[batch->length] = sz;
 
-    free(buffer);
+    if(!(batch->payloads[batch->length] = libflist_bufdup(batch->buffer, sz)))
+        diep("dirnode: malloc");
+
+    batch->length += 1;
 
     // walking over the sub-directories
     for(dirnode_t *subdir = root->dir_list; subdir; subdir = subdir->next)
-        flist_serial_commit_dirnode(subdir, ctx, root);
+        if(flist_serial_batch_dirnode(batch, subdir, root))
+            return 1;
+
+    return 0;
+}
+
+flist_serial_batch_t *flist_serial_batch_new(flist_ctx_t *ctx) {
+    flist_serial_batch_t *batch;
+
+    if(!(batch = calloc(sizeof(flist_serial_batch_t), 1)))
+        diep("batch: calloc");
+
+    if(!(batch->buffer = malloc(FLIST_SERIAL_BUFFER)))
+        diep("batch: malloc");
+
+    batch->database = ctx->db;
+    batch->ctx = ctx;
+
+    return batch;
+}
+
+// queue a directory (and it's in-memory sub-directories), it's
+// written at latest when the batch is freed
+// returns non-zero if a database write failed (queued entries
+// are lost, the caller should stop)
+int flist_serial_batch_commit(flist_serial_batch_t *batch, dirnode_t *root, dirnode_t *parent) {
+    return flist_serial_batch_dirnode(batch, root, parent);
+}
+
+// flush pending entries and release the batch
+// returns non-zero if pending entries could not be written
+int flist_serial_batch_free(flist_serial_batch_t *batch) {
+    int value = flist_serial_batch_flush(batch);
+
+    flist_serial_batch_acls_release(batch);
+    free(batch->buffer);
+    free(batch);
+
+    return value;
+}
+
+int flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent) {
+    flist_serial_batch_t *batch = flist_serial_batch_new(ctx);
+    int value;
+
+    value = flist_serial_batch_commit(batch, root, parent);
+
+    if(flist_serial_batch_free(batch))
+        value = 1;
+
+    return value;
 }
 
 static dirnode_t *flist_dir_to_dirnode(flist_db_t *database, struct Dir *dir) {
@@ -395,17 +812,25 @@ static dirnode_t *flist_dir_to_dirnode(flist_db_t *database, struct Dir *dir) {
     dirnode->creation = dir->creationTime;
     dirnode->modification = dir->modificationTime;
 
-    dirnode->acl = flist_serial_get_acl(database, dir->aclkey.str);
+    // fetching all acls used by this directory at once
+    flist_serial_acls_t batch, *acls = &batch;
+
+    if(flist_serial_acls_load(database, dir, &batch))
+        acls = NULL;
+
+    dirnode->acl = flist_serial_acl_lookup(database, acls, dir->aclkey.str);
 
     // iterating over the full contents
     // and add each inode to the inode list of this directory
     for(int i = 0; i < capn_len(dir->contents); i++) {
         inode_t *inode;
 
-        if((inode = flist_itementry_to_inode(database, dir, i)))
+        if((inode = flist_itementry_to_inode(database, acls, dir, i)))
             flist_dirnode_appends_inode(dirnode, inode);
     }
 
+    flist_serial_acls_free(&batch);
+
     return dirnode;
 }
 
@@ -451,7 +876,7 @@ dirnode_t *flist_serial_get_dirnode(flist_db_t *database, char *key, char *fullp
 //
 // public interface
 //
-void libflist_serial_dirnode_commit(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent) {
+int libflist_serial_dirnode_commit(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent) {
     return flist_serial_commit_dirnode(root, ctx, parent);
 }
 
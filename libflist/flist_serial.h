@@ -1,9 +1,15 @@
 #ifndef LIBFLIST_FLIST_SERIAL_H
     #define LIBFLIST_FLIST_SERIAL_H
 
+    typedef struct flist_serial_batch_t flist_serial_batch_t;
+
     // serializers
     void flist_serial_commit_acl(flist_db_t *database, acl_t *acl);
-    void flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent);
+    int flist_serial_commit_dirnode(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent);
+
+    flist_serial_batch_t *flist_serial_batch_new(flist_ctx_t *ctx);
+    int flist_serial_batch_commit(flist_serial_batch_t *batch, dirnode_t *root, dirnode_t *parent);
+    int flist_serial_batch_free(flist_serial_batch_t *batch);
 
     // deserializers
     dirnode_t *flist_serial_get_dirnode(flist_db_t *database, char *key, char *fullpath);
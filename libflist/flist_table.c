@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "flist_table.h"
+
+//
+// persistent hash table
+//
+// fixed size records (key and value) stored on an open-addressing
+// table (linear probing), which can be written as-is on disk and
+// mapped back read-only, without any parsing
+//
+// a mapped table is never modified, new records are added on an
+// in-memory table and merged into the file (under file lock, other
+// processes could have updated it meanwhile) when done
+//
+#define TABLE_INITIAL_CAPACITY  1024
+
+static size_t table_slotlen(flist_table_t *table) {
+    return table->keylen + table->valuelen;
+}
+
+static size_t table_hash(flist_table_t *table, uint8_t *key) {
+    uint64_t hash = 0;
+
+    // keys are already hashes
+    memcpy(&hash, key, table->keylen < sizeof(hash) ? table->keylen : sizeof(hash));
+
+    return hash & (table->capacity - 1);
+}
+
+static int table_empty(flist_table_t *table, uint8_t *slot) {
+    for(size_t i = 0; i < table->keylen; i++)
+        if(slot[i])
+            return 0;
+
+    return 1;
+}
+
+// find the slot of a key, or the empty slot where it should be inserted,
+// returns NULL if the table is full and doesn't contains the key
+static uint8_t *table_slot(flist_table_t *table, uint8_t *key) {
+    size_t index = table_hash(table, key);
+
+    // probing is bounded, a mapped table could be corrupted
+    for(size_t probe = 0; probe < table->capacity; probe++) {
+        uint8_t *slot = table->slots + (index * table_slotlen(table));
+
+        if(table_empty(table, slot) || memcmp(slot, key, table->keylen) == 0)
+            return slot;
+
+        index = (index + 1) & (table->capacity - 1);
+    }
+
+    return NULL;
+}
+
+static flist_table_t *table_create(size_t keylen, size_t valuelen, size_t capacity) {
+    flist_table_t *table;
+
+    if(!(table = calloc(sizeof(flist_table_t), 1)))
+        return libflist_errp("table: calloc");
+
+    table->keylen = keylen;
+    table->valuelen = valuelen;
+    table->capacity = capacity;
+
+    if(!(table->slots = calloc(capacity, table_slotlen(table)))) {
+        free(table);
+        return libflist_errp("table: slots: calloc");
+    }
+
+    return table;
+}
+
+// copy all records from source into target
+static int table_import(flist_table_t *target, flist_table_t *source) {
+    for(size_t i = 0; i < source->capacity; i++) {
+        uint8_t *slot = source->slots + (i * table_slotlen(source));
+
+        if(table_empty(source, slot))
+            continue;
+
+        if(flist_table_insert(target, slot, slot + source->keylen))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int table_grow(flist_table_t *table) {
+    flist_table_t *larger;
+
+    if(!(larger = table_create(table->keylen, table->valuelen, table->capacity * 2)))
+        return 1;
+
+    if(table_import(larger, table)) {
+        flist_table_free(larger);
+        return 1;
+    }
+
+    free(table->slots);
+
+    table->slots = larger->slots;
+    table->capacity = larger->capacity;
+    table->count = larger->count;
+
+    free(larger);
+
+    return 0;
+}
+
+flist_table_t *flist_table_new(size_t keylen, size_t valuelen) {
+    return table_create(keylen, valuelen, TABLE_INITIAL_CAPACITY);
+}
+
+// map a table file (read-only), returns NULL if the file doesn't
+// exists or is not a valid table with the same records size
+flist_table_t *flist_table_open(char *filename, size_t keylen, size_t valuelen) {
+    flist_table_header_t *header;
+    flist_table_t *table;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if((fd = open(filename, O_RDONLY)) < 0)
+        return NULL;
+
+    if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(flist_table_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED)
+        return libflist_errp("table: mmap");
+
+    header = (flist_table_header_t *) map;
+
+    if(memcmp(header->magic, FLIST_TABLE_MAGIC, sizeof(header->magic)) || header->version != FLIST_TABLE_VERSION)
+        goto invalid;
+
+    if(header->keylen != keylen || header->valuelen != valuelen)
+        goto invalid;
+
+    if(header->capacity == 0 || (header->capacity & (header->capacity - 1)))
+        goto invalid;
+
+    // compared without multiplying, capacity could overflow
+    if(header->capacity > (st.st_size - sizeof(flist_table_header_t)) / (keylen + valuelen))
+        goto invalid;
+
+    // tables are written with a load factor under 50%
+    if(header->count > header->capacity / 2)
+        goto invalid;
+
+    if(!(table = calloc(sizeof(flist_table_t), 1))) {
+        munmap(map, st.st_size);
+        return libflist_errp("table: calloc");
+    }
+
+    table->slots = (uint8_t *) map + sizeof(flist_table_header_t);
+    table->capacity = header->capacity;
+    table->count = header->count;
+    table->keylen = keylen;
+    table->valuelen = valuelen;
+    table->map = map;
+    table->maplen = st.st_size;
+
+    debug("[+] libflist: table: %s: %lu records\n", filename, table->count);
+
+    return table;
+
+invalid:
+    debug("[-] libflist: table: %s: invalid table, ignored\n", filename);
+    munmap(map, st.st_size);
+    return NULL;
+}
+
+// returns a pointer to the value (or to the key if there is
+// no value) if the key is found, NULL otherwise
+uint8_t *flist_table_lookup(flist_table_t *table, uint8_t *key) {
+    uint8_t *slot = table_slot(table, key);
+
+    if(!slot || table_empty(table, slot))
+        return NULL;
+
+    return slot + (table->valuelen ? table->keylen : 0);
+}
+
+// insert (or update) a record, in-memory tables only
+int flist_table_insert(flist_table_t *table, uint8_t *key, uint8_t *value) {
+    uint8_t *slot;
+
+    if(table->map)
+        return 1;
+
+    // keep load factor under 50%
+    if((table->count + 1) * 2 > table->capacity)
+        if(table_grow(table))
+            return 1;
+
+    if(!(slot = table_slot(table, key)))
+        return 1;
+
+    if(table_empty(table, slot)) {
+        memcpy(slot, key, table->keylen);
+        table->count += 1;
+    }
+
+    if(table->valuelen)
+        memcpy(slot + table->keylen, value, table->valuelen);
+
+    return 0;
+}
+
+static int table_write(int fd, flist_table_t *table) {
+    flist_table_header_t header = {
+        .magic = FLIST_TABLE_MAGIC,
+        .version = FLIST_TABLE_VERSION,
+        .keylen = table->keylen,
+        .valuelen = table->valuelen,
+        .capacity = table->capacity,
+        .count = table->count,
+    };
+
+    uint8_t *source = (uint8_t *) &header;
+    size_t length = sizeof(header);
+
+    for(int part = 0; part < 2; part++) {
+        for(size_t done = 0; done < length; ) {
+            ssize_t written = write(fd, source + done, length - done);
+
+            if(written < 0 && errno == EINTR)
+                continue;
+
+            if(written <= 0)
+                return 1;
+
+            done += written;
+        }
+
+        source = table->slots;
+        length = table->capacity * table_slotlen(table);
+    }
+
+    return 0;
+}
+
+// merge records of 'table' into the file, the file is locked during
+// the merge, records added by another process meanwhile are kept
+int flist_table_merge(char *filename, flist_table_t *table) {
+    flist_table_t *current, *merged = NULL;
+    char *lockname = NULL, *tempname = NULL;
+    int lockfd, fd = -1, value = 1;
+
+    if(asprintf(&lockname, "%s.lock", filename) < 0 || asprintf(&tempname, "%s.XXXXXX", filename) < 0) {
+        free(lockname);
+        return 1;
+    }
+
+    if((lockfd = open(lockname, O_CREAT | O_RDWR, 0644)) < 0) {
+        libflist_warnp(lockname);
+        goto cleanup;
+    }
+
+    if(flock(lockfd, LOCK_EX) < 0) {
+        libflist_warnp("table: flock");
+        goto cleanup;
+    }
+
+    if(!(merged = table_create(table->keylen, table->valuelen, TABLE_INITIAL_CAPACITY)))
+        goto cleanup;
+
+    if((current = flist_table_open(filename, table->keylen, table->valuelen))) {
+        int failed = table_import(merged, current);
+        flist_table_free(current);
+
+        if(failed)
+            goto cleanup;
+    }
+
+    if(table_import(merged, table))
+        goto cleanup;
+
+    if((fd = mkstemp(tempname)) < 0) {
+        libflist_warnp(tempname);
+        goto cleanup;
+    }
+
+    if(table_write(fd, merged) || fchmod(fd, 0644) < 0) {
+        libflist_warnp("table: write");
+        unlink(tempname);
+        goto cleanup;
+    }
+
+    if(rename(tempname, filename) < 0) {
+        libflist_warnp("table: rename");
+        unlink(tempname);
+        goto cleanup;
+    }
+
+    debug("[+] libflist: table: %s: %lu records saved\n", filename, merged->count);
+    value = 0;
+
+cleanup:
+    if(fd >= 0)
+        close(fd);
+
+    if(lockfd >= 0)
+        close(lockfd);
+
+    if(merged)
+        flist_table_free(merged);
+
+    free(lockname);
+    free(tempname);
+
+    return value;
+}
+
+void flist_table_free(flist_table_t *table) {
+    if(table->map)
+        munmap(table->map, table->maplen);
+    else
+        free(table->slots);
+
+    free(table);
+}
@@ -0,0 +1,43 @@
+#ifndef LIBFLIST_FLIST_TABLE_H
+    #define LIBFLIST_FLIST_TABLE_H
+
+    #include <stdint.h>
+
+    #define FLIST_TABLE_MAGIC    "FLISTIDX"
+    #define FLIST_TABLE_VERSION  1
+
+    // on-disk header, followed by 'capacity' slots
+    // of fixed size records (key then value)
+    typedef struct flist_table_header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t keylen;
+        uint32_t valuelen;
+        uint32_t reserved;
+        uint64_t capacity;
+        uint64_t count;
+
+    } flist_table_header_t;
+
+    // open-addressing hash table of fixed size records, keys needs to
+    // be hashes (first bytes are used as hash) and can't be all zero
+    // (empty slot), the table can be in memory or mapped from a file
+    typedef struct flist_table_t {
+        uint8_t *slots;
+        size_t capacity;    // amount of slots (power of two)
+        size_t count;       // amount of slots used
+        size_t keylen;
+        size_t valuelen;
+
+        void *map;          // file mapping (read-only table)
+        size_t maplen;
+
+    } flist_table_t;
+
+    flist_table_t *flist_table_new(size_t keylen, size_t valuelen);
+    flist_table_t *flist_table_open(char *filename, size_t keylen, size_t valuelen);
+    uint8_t *flist_table_lookup(flist_table_t *table, uint8_t *key);
+    int flist_table_insert(flist_table_t *table, uint8_t *key, uint8_t *value);
+    int flist_table_merge(char *filename, flist_table_t *table);
+    void flist_table_free(flist_table_t *table);
+#endif
@@ -5,10 +5,13 @@
 #include <unistd.h>
 #include <blake2.h>
 #include <libgen.h>
+#include <pthread.h>
 #include "libflist.h"
 #include "verbose.h"
 #include "flist_serial.h"
 #include "flist_dirnode.h"
+#include "zero_chunk.h"
+#include "zero_memo.h"
 
 //
 // flist helpers
@@ -44,6 +47,34 @@ char *flist_clean_path(char *path) {
     return strndup(path + offset, length);
 }
 
+// content-defined sizes set to zero are replaced by defaults
+// based on the average size (fixed chunks size by default)
+flist_ctx_t *flist_context_set_chunking(flist_ctx_t *ctx, flist_chunking_t mode, size_t minsize, size_t avgsize, size_t maxsize) {
+    if(avgsize == 0)
+        avgsize = ZEROCHUNK_CHUNK_SIZE;
+
+    if(minsize == 0 || minsize >= avgsize)
+        minsize = avgsize / 4;
+
+    if(maxsize == 0 || maxsize <= avgsize)
+        maxsize = avgsize * 4;
+
+    ctx->chunker.mode = mode;
+    ctx->chunker.minsize = minsize;
+    ctx->chunker.avgsize = avgsize;
+    ctx->chunker.maxsize = maxsize;
+
+    return ctx;
+}
+
+flist_ctx_t *flist_context_set_codec(flist_ctx_t *ctx, flist_compression_t compression, int level, flist_encryption_t encryption) {
+    ctx->codec.compression = compression;
+    ctx->codec.level = level;
+    ctx->codec.encryption = encryption;
+
+    return ctx;
+}
+
 flist_ctx_t *flist_context_create(flist_db_t *db, flist_backend_t *backend) {
     flist_ctx_t *ctx;
 
@@ -60,6 +91,25 @@ flist_ctx_t *flist_context_create(flist_db_t *db, flist_backend_t *backend) {
     ctx->userptr = NULL;
     ctx->progress_cb = NULL;
 
+    // process chunks sequentially by default
+    ctx->workers = 1;
+    ctx->downloads = 1;
+
+    // no chunks memo by default
+    ctx->memo = NULL;
+
+    // always process files by default
+    ctx->incremental = FLIST_INCREMENTAL_DISABLED;
+
+    // read files with pread by default
+    ctx->reader = FLIST_READER_PREAD;
+
+    // legacy chunks encoding by default (readable by any reader)
+    flist_context_set_codec(ctx, FLIST_COMPRESSION_SNAPPY, 0, FLIST_ENCRYPTION_XXTEA);
+
+    // fixed size chunks by default
+    flist_context_set_chunking(ctx, FLIST_CHUNKING_FIXED, 0, 0, 0);
+
     return ctx;
 }
 
@@ -70,7 +120,30 @@ flist_ctx_t *flist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*c
     return ctx;
 }
 
+flist_ctx_t *flist_context_set_workers(flist_ctx_t *ctx, size_t workers) {
+    ctx->workers = (workers > 0) ? workers : 1;
+    return ctx;
+}
+
+flist_ctx_t *flist_context_set_downloads(flist_ctx_t *ctx, size_t downloads) {
+    ctx->downloads = (downloads > 0) ? downloads : 1;
+    return ctx;
+}
+
+flist_ctx_t *flist_context_set_incremental(flist_ctx_t *ctx, flist_incremental_t mode) {
+    ctx->incremental = mode;
+    return ctx;
+}
+
+flist_ctx_t *flist_context_set_reader(flist_ctx_t *ctx, flist_reader_t reader) {
+    ctx->reader = reader;
+    return ctx;
+}
+
 void flist_context_free(flist_ctx_t *ctx) {
+    if(ctx->memo)
+        zero_memo_free(ctx->memo);
+
     free(ctx);
 }
 
@@ -113,3 +186,27 @@ void libflist_context_free(flist_ctx_t *ctx) {
 flist_ctx_t *libflist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*cb)(void *, flist_progress_t *)) {
     return flist_context_set_progress(ctx, userptr, cb);
 }
+
+flist_ctx_t *libflist_context_set_workers(flist_ctx_t *ctx, size_t workers) {
+    return flist_context_set_workers(ctx, workers);
+}
+
+flist_ctx_t *libflist_context_set_downloads(flist_ctx_t *ctx, size_t downloads) {
+    return flist_context_set_downloads(ctx, downloads);
+}
+
+flist_ctx_t *libflist_context_set_chunking(flist_ctx_t *ctx, flist_chunking_t mode, size_t minsize, size_t avgsize, size_t maxsize) {
+    return flist_context_set_chunking(ctx, mode, minsize, avgsize, maxsize);
+}
+
+flist_ctx_t *libflist_context_set_incremental(flist_ctx_t *ctx, flist_incremental_t mode) {
+    return flist_context_set_incremental(ctx, mode);
+}
+
+flist_ctx_t *libflist_context_set_reader(flist_ctx_t *ctx, flist_reader_t reader) {
+    return flist_context_set_reader(ctx, reader);
+}
+
+flist_ctx_t *libflist_context_set_codec(flist_ctx_t *ctx, flist_compression_t compression, int level, flist_encryption_t encryption) {
+    return flist_context_set_codec(ctx, compression, level, encryption);
+}
@@ -12,7 +12,9 @@
     //
 
     #include <stdint.h>
+    #include <sys/types.h>
     #include <time.h>
+    #include <pthread.h>
     #include <jansson.h>
 
     typedef struct acl_t {
@@ -49,6 +51,8 @@
         uint8_t entrylen;      // length of the identifier
         uint8_t *decipher;     // decipher key to uncrypt the payload
         uint8_t decipherlen;   // length of the decipher key
+        uint32_t size;         // plain payload length (0 if unknown)
+        uint16_t codec;        // payload codec (0: snappy and xxtea)
 
     } inode_chunk_t;
 
@@ -121,15 +125,26 @@
     typedef struct flist_db_t {
         void *handler;
         char *type;
+        int concurrent;     // handler can be used by multiple threads
 
         struct flist_db_t* (*open)(struct flist_db_t *db);
         struct flist_db_t* (*create)(struct flist_db_t *db);
-        void (*close)(struct flist_db_t *db);
+        int (*close)(struct flist_db_t *db);   // returns 0 if changes are saved
 
         value_t* (*get)(struct flist_db_t *db, uint8_t *key, size_t keylen);
         int (*set)(struct flist_db_t *db, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen);
+        int (*pset)(struct flist_db_t *db, uint8_t *key, size_t keylen, uint8_t *data, size_t datalen);
+        size_t (*flush)(struct flist_db_t *db);
         int (*del)(struct flist_db_t *db, uint8_t *key, size_t keylen);
         int (*exists)(struct flist_db_t *db, uint8_t *key, size_t keylen);
+        int (*mexists)(struct flist_db_t *db, uint8_t **keys, size_t *keylens, size_t count, int *exists);
+
+        // batch operations, 'count' keys at once, returns 0 on success
+        // mget fills 'values' (data is NULL if key doesn't exists), each
+        // value needs to be released with 'clean'
+        int (*mget)(struct flist_db_t *db, uint8_t **keys, size_t *keylens, size_t count, value_t **values);
+        int (*mset)(struct flist_db_t *db, uint8_t **keys, size_t *keylens, uint8_t **data, size_t *datalens, size_t count);
+        int (*mdel)(struct flist_db_t *db, uint8_t **keys, size_t *keylens, size_t count);
 
         value_t* (*sget)(struct flist_db_t *db, char *key);
         int (*sset)(struct flist_db_t *db, char *key, uint8_t *data, size_t datalen);
@@ -151,9 +166,28 @@
 
     } flist_db_type_t;
 
+    // sqlite database workload (see database_sqlite.c)
+    typedef enum flist_db_profile_t {
+        FLIST_DB_DEFAULT,       // sqlite default settings, one transaction
+        FLIST_DB_BUILD,         // bulk insertion (no journal, no sync, large cache)
+        FLIST_DB_READONLY,      // read-mostly (read-only, mapped, query only)
+        FLIST_DB_MEMORY,        // in-memory copy, saved back to the file on close
+
+    } flist_db_profile_t;
+
+    typedef enum flist_known_policy_t {
+        FLIST_KNOWN_TRUST,      // chunks known from previous runs are not checked again
+        FLIST_KNOWN_VERIFY,     // chunks known from previous runs are still checked
+
+    } flist_known_policy_t;
+
     typedef struct flist_backend_t {
         flist_db_t *database;
         char *rootpath;
+        pthread_mutex_t lock;   // serialize database access between workers
+        int skipexists;         // zdb: upload without checking existence first
+        struct flist_backend_cache_t *cache;  // decrypted chunks cache (optional)
+        struct flist_backend_known_t *known;  // chunks known on the backend (optional)
 
     } flist_backend_t;
 
@@ -187,6 +221,7 @@
         flist_buffer_t cipher;
         flist_buffer_t plain;
         flist_buffer_t encrypted;
+        uint16_t codec;        // codec of the encrypted payload
 
     } flist_chunk_t;
 
@@ -197,6 +232,72 @@
 
     } flist_chunks_t;
 
+    // chunking mode, used to split files
+    typedef enum flist_chunking_t {
+        FLIST_CHUNKING_FIXED,   // fixed size chunks (default)
+        FLIST_CHUNKING_CDC,     // content-defined chunks (fastcdc)
+
+    } flist_chunking_t;
+
+    typedef struct flist_chunker_t {
+        flist_chunking_t mode;
+        size_t minsize;   // content-defined: minimum chunk size
+        size_t avgsize;   // content-defined: expected chunk size
+        size_t maxsize;   // content-defined: maximum chunk size
+
+    } flist_chunker_t;
+
+    // chunks compression, the compression used is saved on each
+    // block, chunks can be compressed differently on the same flist
+    typedef enum flist_compression_t {
+        FLIST_COMPRESSION_SNAPPY,   // snappy (default)
+        FLIST_COMPRESSION_STORE,    // not compressed
+        FLIST_COMPRESSION_LZ4,      // lz4 (fast)
+        FLIST_COMPRESSION_ZSTD,     // zstd (compression level can be set)
+
+    } flist_compression_t;
+
+    typedef enum flist_encryption_t {
+        FLIST_ENCRYPTION_XXTEA,     // xxtea, key is the plain payload hash (default)
+        FLIST_ENCRYPTION_NONE,      // not encrypted
+
+    } flist_encryption_t;
+
+    // how chunks are encoded, default (snappy and xxtea) is
+    // the only encoding supported by older readers
+    typedef struct flist_codec_t {
+        flist_compression_t compression;
+        int level;                  // compression level (0: library default)
+        flist_encryption_t encryption;
+
+    } flist_codec_t;
+
+    // compression of an flist archive (tar)
+    typedef enum flist_archive_format_t {
+        FLIST_ARCHIVE_GZIP,     // tar.gz (default, readable by any reader)
+        FLIST_ARCHIVE_ZSTD,     // seekable zstd (independent frames and seek table)
+
+    } flist_archive_format_t;
+
+    // seekable archive reader (see archive_seekable.c)
+    typedef struct flist_archive_t flist_archive_t;
+
+    // how files contents are read to be chunked
+    typedef enum flist_reader_t {
+        FLIST_READER_PREAD,     // chunks read into workers buffers (default)
+        FLIST_READER_MMAP,      // file mapped, chunks used in place
+
+    } flist_reader_t;
+
+    // incremental mode, regular files already on the flist are
+    // not processed again (chunks are reused) if they didn't change
+    typedef enum flist_incremental_t {
+        FLIST_INCREMENTAL_DISABLED,  // always process files (default)
+        FLIST_INCREMENTAL_MTIME,     // same size and modification time
+        FLIST_INCREMENTAL_STRICT,    // same size, modification and change time
+
+    } flist_incremental_t;
+
     // progression information
     typedef struct flist_progress_t {
         char *message;
@@ -213,6 +314,14 @@
         void *userptr;
         int (*progress_cb)(void *userptr, flist_progress_t *progress);
 
+        size_t workers;           // amount of threads used to process chunks
+        size_t downloads;         // amount of chunks downloaded in parallel
+        flist_chunker_t chunker;  // how files are splitted into chunks
+        struct flist_chunks_memo_t *memo;  // plaintext to encrypted chunk memo (optional)
+        flist_incremental_t incremental;   // reuse chunks of unchanged files
+        flist_reader_t reader;             // how files are read
+        flist_codec_t codec;               // how new chunks are encoded
+
     } flist_ctx_t;
 
     #define FLIST_ENTRY_KEY_LENGTH  16
@@ -245,7 +354,15 @@
     //   which is the default base format of flist
     //
     char *libflist_archive_extract(char *filename, char *target);
+    int libflist_archive_extract_fd(int fd, char *target);
     char *libflist_archive_create(char *filename, char *source);
+    char *libflist_archive_create_parallel(char *filename, char *source, size_t workers);
+    char *libflist_archive_create_format(char *filename, char *source, flist_archive_format_t format, size_t workers);
+
+    flist_archive_t *libflist_archive_open(char *filename);
+    ssize_t libflist_archive_pread(flist_archive_t *archive, void *buffer, size_t length, off_t offset);
+    int libflist_archive_member(flist_archive_t *archive, char *name, off_t *offset, size_t *length);
+    void libflist_archive_close(flist_archive_t *archive);
 
     //
     // backend.c
@@ -255,14 +372,38 @@
     //
     flist_backend_t *libflist_backend_init(flist_db_t *database, char *rootpath);
     int libflist_backend_exists(flist_backend_t *context, flist_chunk_t *chunk);
+    ssize_t libflist_backend_chunks_exists(flist_backend_t *backend, inode_chunks_t *chunks, int *exists);
     void libflist_backend_free(flist_backend_t *backend);
 
     flist_chunks_t *libflist_backend_upload_file(flist_backend_t *context, char *filename);
     flist_chunks_t *libflist_backend_upload_inode(flist_backend_t *backend, char *path, char *filename);
     int libflist_backend_upload_chunk(flist_backend_t *context, flist_chunk_t *chunk);
+    int libflist_backend_chunk_present(flist_backend_t *context, flist_chunk_t *chunk);
     int libflist_backend_chunk_commit(flist_backend_t *context, flist_chunk_t *chunk);
+    int libflist_backend_chunks_commit(flist_backend_t *context, flist_chunk_t **chunks, size_t count);
+    size_t libflist_backend_flush(flist_backend_t *backend);
+    flist_backend_t *libflist_backend_skip_exists(flist_backend_t *backend, int enabled);
 
     flist_chunk_t *libflist_backend_download_chunk(flist_backend_t *backend, flist_chunk_t *chunk);
+    ssize_t libflist_backend_download_chunk_into(flist_backend_t *backend, flist_chunk_t *chunk, void *target, size_t length);
+
+    //
+    // backend_cache.c
+    //
+    //   in-memory cache of decrypted chunks, chunks are borrowed
+    //   (acquire) and needs to be released after use
+    //
+    flist_backend_t *libflist_backend_cache(flist_backend_t *backend, size_t maxsize);
+    flist_chunk_t *libflist_backend_chunk_acquire(flist_backend_t *backend, uint8_t *id, uint8_t *cipher, uint16_t codec);
+    void libflist_backend_chunk_release(flist_backend_t *backend, flist_chunk_t *chunk);
+
+    //
+    // backend_known.c
+    //
+    //   persistent index of chunks known to be on a backend, to avoid
+    //   checking their existence for each upload
+    //
+    flist_backend_t *libflist_backend_known_chunks(flist_backend_t *backend, char *directory, char *identity, flist_known_policy_t policy);
 
     void libflist_backend_chunks_free(flist_chunks_t *chunks);
 
@@ -282,6 +423,24 @@
     //   flist metadata and entries
     //
     flist_db_t *libflist_db_sqlite_init(char *rootpath);
+    flist_db_t *libflist_db_sqlite_init_profile(char *rootpath, flist_db_profile_t profile);
+    flist_db_t *libflist_db_sqlite_init_archive(char *filename);
+    int libflist_db_sqlite_vacuum(char *rootpath);
+
+    //
+    // database_pool.c
+    //
+    //   pool of multiple connections to the same database, which
+    //   can be shared between threads (eg: a multi-connection backend)
+    //
+    flist_db_t *libflist_db_pool_init(flist_db_t **databases, size_t length);
+
+    //
+    // database_cache.c
+    //
+    //   local disk cache in front of another database (eg: remote backend)
+    //
+    flist_db_t *libflist_db_cache_init(flist_db_t *source, char *root, size_t maxsize);
 
     //
     // zero_chunk.c
@@ -291,12 +450,16 @@
     //
     inode_chunks_t *libflist_chunks_compute(char *localfile);
     inode_chunks_t *libflist_chunks_proceed(char *localfile, flist_ctx_t *ctx);
+    int libflist_chunks_download(flist_ctx_t *ctx, inode_t *inode, int fd);
+    int libflist_chunks_download_file(flist_ctx_t *ctx, inode_t *inode, int fd);
+    ssize_t libflist_file_pread(flist_ctx_t *ctx, inode_t *inode, void *buffer, size_t length, off_t offset);
 
     uint8_t *libflist_chunk_hash(const void *buffer, size_t length);
 
     flist_chunk_t *libflist_chunk_new(uint8_t *hash, uint8_t *key, void *data, size_t length);
     flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize);
     flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk);
+    ssize_t libflist_chunk_decrypt_into(flist_chunk_t *chunk, void *target, size_t length);
 
     void libflist_chunk_free(flist_chunk_t *chunk);
 
@@ -305,6 +468,13 @@
     //
     flist_ctx_t *libflist_context_create(flist_db_t *db, flist_backend_t *backend);
     flist_ctx_t *libflist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*cb)(void *, flist_progress_t *));
+    flist_ctx_t *libflist_context_set_workers(flist_ctx_t *ctx, size_t workers);
+    flist_ctx_t *libflist_context_set_downloads(flist_ctx_t *ctx, size_t downloads);
+    flist_ctx_t *libflist_context_set_chunking(flist_ctx_t *ctx, flist_chunking_t mode, size_t minsize, size_t avgsize, size_t maxsize);
+    flist_ctx_t *libflist_context_set_chunks_memo(flist_ctx_t *ctx, char *filename);
+    flist_ctx_t *libflist_context_set_incremental(flist_ctx_t *ctx, flist_incremental_t mode);
+    flist_ctx_t *libflist_context_set_reader(flist_ctx_t *ctx, flist_reader_t reader);
+    flist_ctx_t *libflist_context_set_codec(flist_ctx_t *ctx, flist_compression_t compression, int level, flist_encryption_t encryption);
     void libflist_context_free(flist_ctx_t *ctx);
 
     char *libflist_path_key(char *path);
@@ -374,6 +544,8 @@
     slist_t libflist_metadata_list(flist_db_t *database);
     void libflist_metadata_list_free(slist_t *list);
     flist_db_t *libflist_metadata_backend_database(flist_db_t *database);
+    flist_db_t *libflist_metadata_backend_database_pool(flist_db_t *database, size_t connections);
+    char *libflist_metadata_backend_identity(char *input);
     flist_db_t *libflist_metadata_backend_database_json(char *input);
 
     //
@@ -383,7 +555,7 @@
     //   since capnp can be really a mess, you won't have to deal with this in other place
     //   than this file, where you can set/read object and use internal struct to deal
     //   with information (and not with capnp object which are difficult to use)
-    void libflist_serial_dirnode_commit(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent);
+    int libflist_serial_dirnode_commit(dirnode_t *root, flist_ctx_t *ctx, dirnode_t *parent);
     acl_t *libflist_serial_acl_get(flist_db_t *database, const char *aclkey);
 
     //
@@ -55,8 +55,15 @@ void libflist_metadata_list_free(slist_t *list) {
         free(list->list[a]);
 }
 
-flist_db_t *libflist_metadata_backend_database_json(char *input) {
-    flist_db_t *backdb;
+// create backend database from json settings, a pool of connections
+// is created if more than one connection is requested, 'connections'
+// field in the json takes precedence over 'fallback'
+//
+// settings can come from the flist metadata (untrusted), local cache
+// is not part of them (see libflist_db_cache_init)
+static flist_db_t *metadata_backend_database_json(char *input, size_t fallback) {
+    flist_db_t *backdb = NULL;
+    flist_db_t **connections;
     json_error_t error;
     json_t *backend = json_loads(input, 0, &error);
 
@@ -70,22 +77,82 @@ flist_db_t *libflist_metadata_backend_database_json(char *input) {
     char *password = (char *) json_string_value(json_object_get(backend, "password"));
     char *token = (char *) json_string_value(json_object_get(backend, "token"));
     int port = json_integer_value(json_object_get(backend, "port"));
+    json_int_t length = fallback;
+
+    if(json_object_get(backend, "connections"))
+        length = json_integer_value(json_object_get(backend, "connections"));
 
     debug("[+] libflist: backend: %s, %d (ns: %s)\n", host, port, namespace);
     debug("[+] libflist: backend: password: %s, token: %s\n", password ? "yes" : "no", token ? "yes" : "no");
 
-    if(!(backdb = libflist_db_redis_init_tcp(host, port, namespace, password, token))) {
+    // single connection (default)
+    if(length <= 1) {
+        backdb = libflist_db_redis_init_tcp(host, port, namespace, password, token);
         json_decref(backend);
-        return NULL;
+        return backdb;
+    }
+
+    debug("[+] libflist: backend: pool of %lld connections\n", length);
+
+    if(!(connections = calloc(sizeof(flist_db_t *), length))) {
+        json_decref(backend);
+        return libflist_errp("backend: connections: calloc");
     }
 
+    for(json_int_t i = 0; i < length; i++) {
+        if(!(connections[i] = libflist_db_redis_init_tcp(host, port, namespace, password, token)))
+            goto cleanup;
+    }
+
+    if(!(backdb = libflist_db_pool_init(connections, length)))
+        goto cleanup;
+
+    free(connections);
     json_decref(backend);
 
     return backdb;
+
+cleanup:
+    for(json_int_t i = 0; i < length && connections[i]; i++)
+        connections[i]->close(connections[i]);
+
+    free(connections);
+    json_decref(backend);
+
+    return NULL;
 }
 
-flist_db_t *libflist_metadata_backend_database(flist_db_t *database) {
-    // fetching backend from metadata
+// identity of a backend (same database), from json settings
+// this can be used to name persistent data related to a backend
+char *libflist_metadata_backend_identity(char *input) {
+    json_error_t error;
+    json_t *backend = json_loads(input, 0, &error);
+    char *identity;
+
+    if(!backend) {
+        libflist_set_error("backend json could not be parsed");
+        return NULL;
+    }
+
+    char *host = (char *) json_string_value(json_object_get(backend, "host"));
+    char *namespace = (char *) json_string_value(json_object_get(backend, "namespace"));
+    int port = json_integer_value(json_object_get(backend, "port"));
+
+    if(asprintf(&identity, "%s:%d/%s", host ? host : "", port, namespace ? namespace : "default") < 0)
+        identity = NULL;
+
+    json_decref(backend);
+
+    return identity;
+}
+
+flist_db_t *libflist_metadata_backend_database_json(char *input) {
+    return metadata_backend_database_json(input, 1);
+}
+
+// fetching backend from metadata, using 'connections' connections
+// (unless specified by the metadata itself)
+flist_db_t *libflist_metadata_backend_database_pool(flist_db_t *database, size_t connections) {
     char *value;
 
     if(!(value = libflist_metadata_get(database, "backend"))) {
@@ -96,5 +163,9 @@ flist_db_t *libflist_metadata_backend_database(flist_db_t *database) {
 
     debug("[+] libflist: metadata: raw backend: %s\n", value);
 
-    return libflist_metadata_backend_database_json(value);
+    return metadata_backend_database_json(value, connections);
+}
+
+flist_db_t *libflist_metadata_backend_database(flist_db_t *database) {
+    return libflist_metadata_backend_database_pool(database, 1);
 }
@@ -6,7 +6,9 @@
 #include "libflist.h"
 #include "verbose.h"
 
-char libflist_internal_error[1024] = "Success";
+// last error, per thread (a library user can run independent
+// contexts on different threads)
+__thread char libflist_internal_error[1024] = "Success";
 
 // library version support
 char *libflist_version() {
@@ -29,8 +31,8 @@ void libflist_debug_enable(int enable) {
 // error handling
 //
 // here are defined how error handling works
-// basicly we keep a static string buffer in memory
-// which will contains the last string error
+// basicly we keep a static string buffer in memory (one
+// per thread) which will contains the last string error
 //
 // this error can be retrived via 'libflist_strerror'
 const char *libflist_strerror() {
@@ -1,7 +1,7 @@
 #ifndef LIBFLIST_DEBUG_H
     #define LIBFLIST_DEBUG_H
 
-    extern char libflist_internal_error[1024];
+    extern __thread char libflist_internal_error[1024];
 
     #define diep   libflist_diep
     #define dies   libflist_dies
@@ -249,6 +249,87 @@ static uint8_t * xxtea_ubyte_decrypt(const uint8_t * data, size_t len, const uin
     return out;
 }
 
+// in-place encryption, the buffer is used directly as uint32_t array
+// (no conversion needed on little endian), words are converted from
+// and to little endian on other platforms
+
+static void xxtea_words_swap(uint32_t * data, size_t len) {
+#if defined(BYTE_ORDER) && (BYTE_ORDER == LITTLE_ENDIAN)
+    (void) data;
+    (void) len;
+#else
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        uint8_t *b = (uint8_t *)&data[i];
+        data[i] = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+#endif
+}
+
+static void xxtea_key_words(const uint8_t * key, uint32_t * out) {
+    size_t i;
+
+    for (i = 0; i < 4; ++i) {
+        out[i] = (uint32_t)key[i * 4] | ((uint32_t)key[i * 4 + 1] << 8) |
+                 ((uint32_t)key[i * 4 + 2] << 16) | ((uint32_t)key[i * 4 + 3] << 24);
+    }
+}
+
+size_t xxtea_encrypt_length(size_t len) {
+    return (((len + 3) >> 2) + 1) << 2;
+}
+
+int xxtea_encrypt_inplace(void * data, size_t len, size_t capacity, const void * key, size_t key_len, size_t * out_len) {
+    uint32_t *words = (uint32_t *)data;
+    uint32_t key_array[4];
+    size_t n;
+
+    if (!len || key_len % 8 || ((uintptr_t)data & 3)) return -1;
+    if (capacity < xxtea_encrypt_length(len)) return -1;
+
+    n = (len + 3) >> 2;
+
+    // zero padding, then original length on the last word
+    memset((uint8_t *)data + len, 0, (n << 2) - len);
+    xxtea_words_swap(words, n);
+    words[n] = (uint32_t)len;
+
+    xxtea_key_words((const uint8_t *)key, key_array);
+    xxtea_uint_encrypt(words, n + 1, key_array);
+    xxtea_words_swap(words, n + 1);
+
+    *out_len = (n + 1) << 2;
+
+    return 0;
+}
+
+int xxtea_decrypt_inplace(void * data, size_t len, const void * key, size_t key_len, size_t * out_len) {
+    uint32_t *words = (uint32_t *)data;
+    uint32_t key_array[4];
+    size_t n, m;
+
+    if (!len || key_len % 8 || ((uintptr_t)data & 3)) return -1;
+
+    // encrypted data is always a list of words, with the length
+    if ((len & 3) || len < 8) return -1;
+
+    n = len >> 2;
+
+    xxtea_words_swap(words, n);
+    xxtea_key_words((const uint8_t *)key, key_array);
+    xxtea_uint_decrypt(words, n, key_array);
+
+    m = words[n - 1];
+    xxtea_words_swap(words, n - 1);
+
+    if ((m + 3 < ((n - 1) << 2)) || (m > ((n - 1) << 2))) return -1;
+
+    *out_len = m;
+
+    return 0;
+}
+
 // public functions
 
 void * xxtea_encrypt(const void * data, size_t len, const void * key, size_t * out_len) {
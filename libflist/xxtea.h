@@ -53,6 +53,40 @@ void * xxtea_decrypt(const void * data, size_t len, const void * key, size_t * o
 
 void * xxtea_decrypt_bkey(const void * data, size_t len, const void * key, size_t key_len, size_t * out_len);
 
+/**
+ * Function: xxtea_encrypt_length
+ * @len:     Length of the data to be encrypted
+ * Returns:  Length of the encrypted data
+ */
+size_t xxtea_encrypt_length(size_t len);
+
+/**
+ * Function: xxtea_encrypt_inplace
+ * @data:     Data to be encrypted, 4 bytes aligned, replaced by encrypted data
+ * @len:      Length of the data to be encrypted
+ * @capacity: Size of @data buffer, at least xxtea_encrypt_length(@len)
+ * @key:      Symmetric key
+ * @key_len:  Length of the key
+ * @out_len:  Pointer to output length variable
+ * Returns:   0 on success, -1 on failure
+ *
+ * Output is the same as xxtea_encrypt_bkey, without allocation.
+ */
+int xxtea_encrypt_inplace(void * data, size_t len, size_t capacity, const void * key, size_t key_len, size_t * out_len);
+
+/**
+ * Function: xxtea_decrypt_inplace
+ * @data:     Data to be decrypted, 4 bytes aligned, replaced by decrypted data
+ * @len:      Length of the data to be decrypted
+ * @key:      Symmetric key
+ * @key_len:  Length of the key
+ * @out_len:  Pointer to output length variable
+ * Returns:   0 on success, -1 on failure
+ *
+ * Output is the same as xxtea_decrypt_bkey, without allocation.
+ */
+int xxtea_decrypt_inplace(void * data, size_t len, const void * key, size_t key_len, size_t * out_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <blake2.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+#include "zero_blake2.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    #include <immintrin.h>
+    #define ZERO_BLAKE2_AVX2
+#endif
+
+//
+// multi-lane blake2b
+//
+// chunks are hashed twice (plaintext and encrypted payload), one buffer
+// at a time, blake2b is the main cpu consumer when adding files
+//
+// blake2b rounds are sequential for one buffer, but independent between
+// buffers: with avx2, four buffers are hashed at the same time, each
+// 64 bits lane of the 256 bits registers holds the state of one buffer,
+// the output is byte-identical to the scalar implementation
+//
+// buffers can have different lengths, lanes without more blocks to
+// compress keep their state unchanged (masked), which only wastes some
+// work when lengths are really different (last chunk of a file, ...)
+//
+// the avx2 code is compiled with a target attribute, and only used
+// when the cpu supports it (runtime check), otherwise libb2 is used
+// for each buffer, one by one
+//
+
+#ifdef ZERO_BLAKE2_AVX2
+
+#define BLAKE2B_BLOCKBYTES  128
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+};
+
+// state of the four lanes
+typedef struct blake2b_lanes_t {
+    __m256i h[8];       // chaining value, one lane per buffer
+    __m256i t0;         // bytes counter (low), per lane
+    __m256i t1;         // bytes counter (high), per lane
+
+} blake2b_lanes_t;
+
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 inline __m256i lanes_rotr32(__m256i x) {
+    return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static AVX2 inline __m256i lanes_rotr24(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+        3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+        3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10
+    );
+
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+static AVX2 inline __m256i lanes_rotr16(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+        2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+        2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9
+    );
+
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+static AVX2 inline __m256i lanes_rotr63(__m256i x) {
+    return _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x));
+}
+
+#define LANES_G(a, b, c, d, x, y) do { \
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), x); \
+    d = lanes_rotr32(_mm256_xor_si256(d, a)); \
+    c = _mm256_add_epi64(c, d); \
+    b = lanes_rotr24(_mm256_xor_si256(b, c)); \
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), y); \
+    d = lanes_rotr16(_mm256_xor_si256(d, a)); \
+    c = _mm256_add_epi64(c, d); \
+    b = lanes_rotr63(_mm256_xor_si256(b, c)); \
+} while(0)
+
+// load one block of each lane, transposed: m[i] contains
+// the word 'i' of the four blocks
+static AVX2 void lanes_load(__m256i m[16], const uint8_t *blocks[4]) {
+    for(int q = 0; q < 4; q++) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (blocks[0] + q * 32));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (blocks[1] + q * 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (blocks[2] + q * 32));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (blocks[3] + q * 32));
+
+        __m256i t0 = _mm256_unpacklo_epi64(a, b);
+        __m256i t1 = _mm256_unpackhi_epi64(a, b);
+        __m256i t2 = _mm256_unpacklo_epi64(c, d);
+        __m256i t3 = _mm256_unpackhi_epi64(c, d);
+
+        m[q * 4 + 0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+        m[q * 4 + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+        m[q * 4 + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+        m[q * 4 + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+    }
+}
+
+// compress one block on each lane, 'increment' is the amount of bytes
+// added to the counter, 'final' is all ones on lanes compressing their
+// last block and 'active' is all ones on lanes which have a block
+static AVX2 void lanes_compress(blake2b_lanes_t *state, const uint8_t *blocks[4], __m256i increment, __m256i final, __m256i active) {
+    __m256i m[16], v[16];
+
+    lanes_load(m, blocks);
+
+    // 128 bits counter, with carry
+    __m256i t0 = _mm256_add_epi64(state->t0, increment);
+    __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+    __m256i carry = _mm256_cmpgt_epi64(
+        _mm256_xor_si256(state->t0, sign),
+        _mm256_xor_si256(t0, sign)
+    );
+    __m256i t1 = _mm256_sub_epi64(state->t1, carry);
+
+    for(int i = 0; i < 8; i++)
+        v[i] = state->h[i];
+
+    v[8] = _mm256_set1_epi64x(blake2b_iv[0]);
+    v[9] = _mm256_set1_epi64x(blake2b_iv[1]);
+    v[10] = _mm256_set1_epi64x(blake2b_iv[2]);
+    v[11] = _mm256_set1_epi64x(blake2b_iv[3]);
+    v[12] = _mm256_xor_si256(_mm256_set1_epi64x(blake2b_iv[4]), t0);
+    v[13] = _mm256_xor_si256(_mm256_set1_epi64x(blake2b_iv[5]), t1);
+    v[14] = _mm256_xor_si256(_mm256_set1_epi64x(blake2b_iv[6]), final);
+    v[15] = _mm256_set1_epi64x(blake2b_iv[7]);
+
+    for(int r = 0; r < 12; r++) {
+        const uint8_t *s = blake2b_sigma[r];
+
+        LANES_G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        LANES_G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        LANES_G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        LANES_G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        LANES_G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        LANES_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        LANES_G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        LANES_G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+    // only lanes with a block are updated
+    for(int i = 0; i < 8; i++) {
+        __m256i updated = _mm256_xor_si256(state->h[i], _mm256_xor_si256(v[i], v[i + 8]));
+        state->h[i] = _mm256_blendv_epi8(state->h[i], updated, active);
+    }
+
+    state->t0 = _mm256_blendv_epi8(state->t0, t0, active);
+    state->t1 = _mm256_blendv_epi8(state->t1, t1, active);
+}
+
+// hash up to four buffers, unused lanes have a zero length
+static AVX2 void lanes_hash(uint8_t *hashes[4], const uint8_t *buffers[4], size_t lengths[4], size_t count) {
+    uint8_t last[4][BLAKE2B_BLOCKBYTES];
+    size_t blocks[4], maxblocks = 0;
+    blake2b_lanes_t state;
+
+    // parameter block: digest length, no key, fanout and depth 1
+    state.h[0] = _mm256_set1_epi64x(blake2b_iv[0] ^ 0x01010000ULL ^ ZEROCHUNK_HASH_LENGTH);
+
+    for(int i = 1; i < 8; i++)
+        state.h[i] = _mm256_set1_epi64x(blake2b_iv[i]);
+
+    state.t0 = _mm256_setzero_si256();
+    state.t1 = _mm256_setzero_si256();
+
+    for(size_t lane = 0; lane < 4; lane++) {
+        size_t length = (lane < count) ? lengths[lane] : 0;
+
+        // an empty buffer is still one (empty) final block
+        blocks[lane] = (length + BLAKE2B_BLOCKBYTES - 1) / BLAKE2B_BLOCKBYTES;
+        if(blocks[lane] == 0)
+            blocks[lane] = 1;
+
+        // last block is copied and padded with zero
+        memset(last[lane], 0, BLAKE2B_BLOCKBYTES);
+
+        if(lane < count && length > 0) {
+            size_t offset = (blocks[lane] - 1) * BLAKE2B_BLOCKBYTES;
+            memcpy(last[lane], buffers[lane] + offset, length - offset);
+        }
+
+        if(lane < count && blocks[lane] > maxblocks)
+            maxblocks = blocks[lane];
+    }
+
+    for(size_t block = 0; block < maxblocks; block++) {
+        const uint8_t *source[4];
+        uint64_t increment[4], final[4], active[4];
+
+        for(size_t lane = 0; lane < 4; lane++) {
+            increment[lane] = final[lane] = active[lane] = 0;
+            source[lane] = last[lane];
+
+            if(lane >= count || block >= blocks[lane])
+                continue;
+
+            active[lane] = ~0ULL;
+
+            if(block + 1 < blocks[lane]) {
+                source[lane] = buffers[lane] + block * BLAKE2B_BLOCKBYTES;
+                increment[lane] = BLAKE2B_BLOCKBYTES;
+                continue;
+            }
+
+            // last block of this lane
+            increment[lane] = lengths[lane] - block * BLAKE2B_BLOCKBYTES;
+            final[lane] = ~0ULL;
+        }
+
+        lanes_compress(&state, source,
+            _mm256_setr_epi64x(increment[0], increment[1], increment[2], increment[3]),
+            _mm256_setr_epi64x(final[0], final[1], final[2], final[3]),
+            _mm256_setr_epi64x(active[0], active[1], active[2], active[3])
+        );
+    }
+
+    // digest is the first bytes of the chaining value (little endian)
+    uint64_t words[4][4];
+
+    for(int i = 0; i < 4; i++) {
+        uint64_t column[4];
+        _mm256_storeu_si256((__m256i *) column, state.h[i]);
+
+        for(size_t lane = 0; lane < 4; lane++)
+            words[lane][i] = column[lane];
+    }
+
+    for(size_t lane = 0; lane < count; lane++)
+        memcpy(hashes[lane], words[lane], ZEROCHUNK_HASH_LENGTH);
+}
+
+static int zero_blake2_avx2 = -1;
+
+static int zero_blake2_supported() {
+    if(zero_blake2_avx2 < 0) {
+        __builtin_cpu_init();
+        zero_blake2_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return zero_blake2_avx2;
+}
+#endif
+
+// amount of buffers worth to be hashed together
+size_t zero_blake2_lanes() {
+#ifdef ZERO_BLAKE2_AVX2
+    if(zero_blake2_supported())
+        return ZERO_BLAKE2_MAX_LANES;
+#endif
+
+    return 1;
+}
+
+// hash 'count' buffers, each hash is ZEROCHUNK_HASH_LENGTH bytes
+// and written into already allocated 'hashes' entries
+int zero_blake2_multi(uint8_t **hashes, const uint8_t **buffers, size_t *lengths, size_t count) {
+    size_t done = 0;
+
+#ifdef ZERO_BLAKE2_AVX2
+    if(count > 1 && zero_blake2_supported()) {
+        while(count - done > 1) {
+            size_t lanes = count - done;
+
+            if(lanes > ZERO_BLAKE2_MAX_LANES)
+                lanes = ZERO_BLAKE2_MAX_LANES;
+
+            lanes_hash(hashes + done, buffers + done, lengths + done, lanes);
+            done += lanes;
+        }
+    }
+#endif
+
+    // scalar fallback (and single remaining buffer)
+    for(; done < count; done++) {
+        if(blake2b(hashes[done], buffers[done], "", ZEROCHUNK_HASH_LENGTH, lengths[done], 0)) {
+            libflist_set_error("blake2 failed");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef LIBFLIST_ZERO_BLAKE2_H
+    #define LIBFLIST_ZERO_BLAKE2_H
+
+    // maximum amount of buffers hashed at the same time
+    #define ZERO_BLAKE2_MAX_LANES  4
+
+    size_t zero_blake2_lanes();
+    int zero_blake2_multi(uint8_t **hashes, const uint8_t **buffers, size_t *lengths, size_t count);
+#endif
@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+#include "zero_cdc.h"
+
+//
+// content-defined chunking
+//
+// chunks boundaries are found using a gear rolling hash (fastcdc),
+// inserting or removing some bytes in a file only changes the chunks
+// around the modification, all the others chunks (and their id) stay
+// the same, which keeps deduplication working on the backend
+//
+// boundaries are never shorter than 'minsize' (cut-point skipping) and
+// never longer than 'maxsize', a stricter mask is used before reaching
+// 'avgsize' and a looser one after, to normalize chunks size around
+// the average size
+//
+
+// gear table, 256 random 64 bits values (splitmix64, fixed seed)
+// this table must never change, otherwise all boundaries changes
+static const uint64_t gear[256] = {
+    0xe58c3ba1faf79d8aULL, 0x93aa659fd0d2675aULL, 0x3a90098db46ce34bULL, 0xf75a71504e5308ccULL,
+    0x4df180c4fdaf7b70ULL, 0xbf45c7336da07e96ULL, 0x1dd4126b47f118a8ULL, 0xd13b4d5975c89200ULL,
+    0xab90fa7b70d580f4ULL, 0x7ed560ede5496485ULL, 0x3eee90cbd58b57edULL, 0xf73cb5ff0ea67ee4ULL,
+    0xe18677ca4c891d28ULL, 0xfc873b0005982edaULL, 0x4e6f8c277a4da74eULL, 0x896eea03a55161f8ULL,
+    0x5912ec69a4400173ULL, 0x8929eaa097baa621ULL, 0xcc4a83ee7602dbb1ULL, 0x0c3bf5601fdc23ceULL,
+    0x6b1a9113c5dd9059ULL, 0xb553c0819fd89456ULL, 0xd21d7e46456f116dULL, 0x033be22c7f964cf4ULL,
+    0x91ef18325563da66ULL, 0xea095b257ba47c2eULL, 0x1997d8de86f22000ULL, 0x54f7530e30f0345fULL,
+    0x2b05adf478174281ULL, 0xbf24c2e25158773eULL, 0xef84e0efae713146ULL, 0xbb1e2deb6bd6b188ULL,
+    0x93a7eda7ba5f1c50ULL, 0x7870c05aa12c736cULL, 0xc192426ed732b257ULL, 0x57748a6015d0832dULL,
+    0x3e2363fbd18e5c89ULL, 0x9b35093991de1b15ULL, 0xb8d5cc47e3a0e3d3ULL, 0x71824ac61d3a02d4ULL,
+    0x611ecd2a9da963e1ULL, 0xb1f6c4c28ebc9a69ULL, 0xeceea88d4037886bULL, 0x08c420e130cb97beULL,
+    0xe5ef322c03964e31ULL, 0xe4a42fcc6db3de15ULL, 0xbb5bc36234550368ULL, 0x9cd244a708d286bfULL,
+    0x78b7255cf8081703ULL, 0x075195b9c92d0c41ULL, 0xd6db84e531572b24ULL, 0xfa33a38a953567feULL,
+    0x2b01f8b2f1438006ULL, 0x40fd675ea8bd18f0ULL, 0x3a56bf4b2ff580faULL, 0x4300ca6d1b1e6709ULL,
+    0x4941bfdc2a821062ULL, 0xae3dad064ad72de3ULL, 0xc52b00b370ec5cb8ULL, 0x05b5f6f06918150dULL,
+    0x248fc1ed9b685605ULL, 0x3ddb54094da10462ULL, 0xdad71ae0322a3b6eULL, 0xb1416d39636b186fULL,
+    0x502e25c07301831cULL, 0x7f2cdcc22b2388d3ULL, 0x1f139b124cd15e4dULL, 0xeb17f4fb9b73e81aULL,
+    0x56a01163bd1c1b60ULL, 0x6e746e79e4b1d8d4ULL, 0x8d57efe7bd0d41cfULL, 0x96ae8d0b422aea24ULL,
+    0xaa96d40822b24c02ULL, 0x6132ae276c1ceccfULL, 0x956d34cf8a1200d3ULL, 0xb619d1cb05ce118eULL,
+    0x777302008f10f723ULL, 0xecddae0a5175e6b0ULL, 0x49147f6d3ef85c36ULL, 0xf2ad58d03d948296ULL,
+    0x724dd84a03d85f99ULL, 0x368ef9635761680aULL, 0xd6c9e72a8d181e2dULL, 0xefcda204c40346e9ULL,
+    0x610dc4d0c57a8ffcULL, 0x825b8ac5261932ebULL, 0x6b501329621a9569ULL, 0xe036e8231c6131fdULL,
+    0x7b3222751a9c5ff6ULL, 0x0a3e62cd6eb6f118ULL, 0x053f46cfe4b262b4ULL, 0x0669d850ce103e75ULL,
+    0x4910755b23c577cdULL, 0x668f193b977f0c6eULL, 0x8259c147cd3268edULL, 0xfdb9ce76896d3b02ULL,
+    0x7632ffb8ad94fda6ULL, 0xbe4be8a2c5fbee11ULL, 0xd604ff23c5cc7b7aULL, 0xbf1abc2687c2f1acULL,
+    0xb8782573cff12eeeULL, 0x6dc7e7d92ac6171eULL, 0x437769a595de3634ULL, 0x05ef5c2194faaff4ULL,
+    0xeaee930eaff99196ULL, 0x892f49747ef04ff1ULL, 0xa4700e7368b09342ULL, 0xe4f6269d960032eaULL,
+    0x8f55238275fa21b3ULL, 0x6369dee3d7d7cc7fULL, 0x9b85a39c16be1d01ULL, 0x5410dc50440cbd41ULL,
+    0xdf1b0229a228fad2ULL, 0x5f18c33f05852112ULL, 0x525f840e712179a3ULL, 0xa7e7c358caa0ed80ULL,
+    0xb3925c331c859e2aULL, 0x2eee1429a09960f8ULL, 0xb30ae815644ec4ddULL, 0x9a8117bb55776b4bULL,
+    0x9e31a61caf056da1ULL, 0x801719fc28132d02ULL, 0xe001893a151184cbULL, 0xa160febba0d61f28ULL,
+    0xa582e2be3dee71d0ULL, 0x57d7f682d176edaeULL, 0x5d8b4f419ad51f11ULL, 0x67b69efd7980c3dbULL,
+    0x57d93f9d91e3c1acULL, 0x3d40e63d8b8b94c4ULL, 0xe38b35397861e622ULL, 0xc5e58253cdfd68faULL,
+    0x8c839544909a08a6ULL, 0xadf3cddacf7984b1ULL, 0x95effd84ab5d9637ULL, 0x9700bf4a547894a7ULL,
+    0x80f46d7ec37f1ab6ULL, 0x8e40d8f3434b62adULL, 0xbb562d29cbf68d90ULL, 0xaff1c4045b0dcb5aULL,
+    0x41c6cee03fb82178ULL, 0x9be91bde2a331eb0ULL, 0x2306c7d3d241fbb6ULL, 0x822b04cba0ad7718ULL,
+    0xbe494907f4c7b5faULL, 0xc36f0c942def8f43ULL, 0x287ecb4d00bc2dc1ULL, 0x835b140347690947ULL,
+    0x012c710f9414b208ULL, 0x84515a4586679f0cULL, 0x565e5fb4a888cf41ULL, 0x50183f8e1b826808ULL,
+    0x3d21f568943e68d0ULL, 0xd0812f9e35ec1d8eULL, 0x2c91a2f7209e8e28ULL, 0x18441b809d4bf2bfULL,
+    0x8713e7124bbdd916ULL, 0x1f74c30b1bb7739dULL, 0x5e2fa1cbc9ec2031ULL, 0xf67e90776673410cULL,
+    0x2147be33a269bfb4ULL, 0x9f472a68390fb4ebULL, 0x0120f31598b4db93ULL, 0xee37b4fa530ba174ULL,
+    0xc177e02c7880be86ULL, 0x1f7aae29c6677c17ULL, 0x2ab8e6e731256550ULL, 0x389a2baea832304cULL,
+    0xd5e378432744b19eULL, 0x1ced1eb34db65013ULL, 0x91ff095a29e86799ULL, 0x7d070854998cf73eULL,
+    0x779e2fe02ad0af87ULL, 0xb867d2b3d518be45ULL, 0x8208d611c2a79791ULL, 0xa84e48f616e6d94bULL,
+    0xe97199b1da9dc535ULL, 0x2a34f0ddaebd4a37ULL, 0x9c024f5ccfbc6018ULL, 0x78123e1c2caff9edULL,
+    0x3e1a5c8b808d6a58ULL, 0x621e85ecfdf30206ULL, 0x0608d719ca89b9a4ULL, 0xf8134b5b0e1738cdULL,
+    0xa6a7c398b38d8d8aULL, 0x65987c6cef4e4043ULL, 0xac7de715092f01caULL, 0x298037585b595307ULL,
+    0x7b4ecd45f6ab6842ULL, 0x4b82bd495686d73aULL, 0x2cd4a3de20665bceULL, 0xff47e7751c61b8a9ULL,
+    0x152a9a9308cec9e5ULL, 0x6832c26ce5d8a63aULL, 0xd5dc46b17252a838ULL, 0x261caec25c77815cULL,
+    0x30b1989966d33af6ULL, 0x0aeb268a29285f1bULL, 0x40a3083734e49a22ULL, 0x11234b7b7a854bb3ULL,
+    0x2a540834534f347aULL, 0x58c1ceab4631529dULL, 0x4dbfc2a1233b2b12ULL, 0x838fd68bbfb73c9dULL,
+    0xd7926e310b07d449ULL, 0xd7d7676ae04574e6ULL, 0xa3499ea649dfd41eULL, 0xece68957ca950f76ULL,
+    0x99bad8f8d46674f8ULL, 0x59f67657859e7f25ULL, 0x39150fab622670bcULL, 0xecf0e1a4cc1d4576ULL,
+    0x833aa83392eadaf5ULL, 0x5b761c93bebb9ed5ULL, 0xbbbfef46ee95f56fULL, 0xa8cc161007139afbULL,
+    0x5575d1cfe89dd663ULL, 0x80a4d156e3e159faULL, 0x6129949663592fedULL, 0x8b7a61ce3696a5c7ULL,
+    0xfde0b42e1522a251ULL, 0x3b4d0b35e8d1dd3fULL, 0x1942bf3b12e10d1eULL, 0xd4a07b48fcaab72eULL,
+    0x1bf67eba65df7f28ULL, 0x5762f96a65706a6cULL, 0xe909f79273af8910ULL, 0x194b190e84dee56eULL,
+    0x2f30efa47beff9dbULL, 0x8b3101af884fe586ULL, 0x701b0e1817ab8617ULL, 0xeddc910c4a687e3dULL,
+    0x0545f97f61133fb4ULL, 0x9771210bffa14c13ULL, 0x232b5049b5ac1113ULL, 0xabb2a9a6c9a12109ULL,
+    0x83f50e64fbe549cbULL, 0xa3693eba538db373ULL, 0x4df0a5c2d6e6daa9ULL, 0x0815a558caa741ffULL,
+    0x7a02c7c0e673cad3ULL, 0x6df720b2239ff087ULL, 0x02bf4530f3044bb7ULL, 0x4bbbbe767732edf2ULL,
+    0x6564b86b767ac8bfULL, 0xde578787a05c211eULL, 0x453bba440fee6945ULL, 0xeba9d0a46f536878ULL,
+    0x4f719536d9eecff8ULL, 0x3c05594fdae7ae72ULL, 0x6f145c9801349a2cULL, 0x12575ad2f69faef7ULL,
+    0x4e04c1dc1f6b8a0dULL, 0x0685458657bccc06ULL, 0x254b61b47a9dca6eULL, 0x1f1b554208e1535aULL,
+};
+
+// mask with 'bits' most significant bits set, the most significant
+// bits of the fingerprint are the ones mixed by the whole window
+static uint64_t zero_cdc_mask(int bits) {
+    if(bits <= 0)
+        return 0;
+
+    if(bits >= 64)
+        return ~0ULL;
+
+    return ~0ULL << (64 - bits);
+}
+
+static int zero_cdc_bits(size_t value) {
+    int bits = 0;
+
+    while(value > 1) {
+        value >>= 1;
+        bits += 1;
+    }
+
+    return bits;
+}
+
+// returns the length of the first chunk found on data
+size_t zero_cdc_boundary(const uint8_t *data, size_t length, flist_chunker_t *chunker) {
+    int bits = zero_cdc_bits(chunker->avgsize);
+    uint64_t masks = zero_cdc_mask(bits + 1);
+    uint64_t maskl = zero_cdc_mask(bits - 1);
+    size_t normal = chunker->avgsize;
+    uint64_t fp = 0;
+    size_t i;
+
+    if(length <= chunker->minsize)
+        return length;
+
+    if(length > chunker->maxsize)
+        length = chunker->maxsize;
+
+    if(normal > length)
+        normal = length;
+
+    for(i = chunker->minsize; i < normal; i++) {
+        fp = (fp << 1) + gear[data[i]];
+
+        if(!(fp & masks))
+            return i + 1;
+    }
+
+    for(; i < length; i++) {
+        fp = (fp << 1) + gear[data[i]];
+
+        if(!(fp & maskl))
+            return i + 1;
+    }
+
+    return length;
+}
+
+static ssize_t zero_cdc_read(int fd, uint8_t *data, size_t length, off_t offset) {
+    size_t done = 0;
+
+    while(done < length) {
+        ssize_t value = pread(fd, data + done, length - done, offset + done);
+
+        if(value < 0 && errno == EINTR)
+            continue;
+
+        if(value <= 0)
+            return -1;
+
+        done += value;
+    }
+
+    return done;
+}
+
+// scan a whole file, 'callback' is called for each chunk found (in
+// order), with the chunk contents: the file is only read once, chunks
+// can be processed while the rest of the file is scanned
+//
+// scanning stops if the callback returns non-zero
+int zero_cdc_scan(int fd, size_t length, flist_chunker_t *chunker, zero_cdc_callback_t callback, void *userptr) {
+    uint8_t *buffer;
+    size_t bufsize = chunker->maxsize * 4;
+    size_t available = 0;   // amount of bytes loaded in the buffer
+    size_t position = 0;    // position of the scanner in the buffer
+    off_t loaded = 0;       // file offset of the end of the buffer
+    off_t offset = 0;       // file offset of the next chunk
+
+    if(!(buffer = malloc(bufsize))) {
+        libflist_errp("cdc: buffer: malloc");
+        return 1;
+    }
+
+    while((size_t) offset < length) {
+        // not enough data to find the next boundary, refill
+        if(available - position < chunker->maxsize && (size_t) loaded < length) {
+            memmove(buffer, buffer + position, available - position);
+            available -= position;
+            position = 0;
+
+            size_t toread = bufsize - available;
+            if(toread > length - loaded)
+                toread = length - loaded;
+
+            if(zero_cdc_read(fd, buffer + available, toread, loaded) < 0) {
+                libflist_errp("cdc: read");
+                free(buffer);
+                return 1;
+            }
+
+            available += toread;
+            loaded += toread;
+        }
+
+        size_t chunklen = zero_cdc_boundary(buffer + position, available - position, chunker);
+
+        if(callback(userptr, buffer + position, offset, chunklen)) {
+            free(buffer);
+            return 1;
+        }
+
+        position += chunklen;
+        offset += chunklen;
+    }
+
+    free(buffer);
+
+    return 0;
+}
+
+static int zero_cdc_cut(void *userptr, const uint8_t *data, off_t offset, size_t length) {
+    (void) data;
+
+    if(zero_cuts_append((chunk_cuts_t *) userptr, offset, length)) {
+        libflist_errp("cdc: cuts: realloc");
+        return 1;
+    }
+
+    return 0;
+}
+
+// scan a whole file and compute all chunks boundaries
+chunk_cuts_t *zero_cdc_cuts(int fd, size_t length, flist_chunker_t *chunker) {
+    chunk_cuts_t *cuts;
+
+    if(!(cuts = calloc(sizeof(chunk_cuts_t), 1)))
+        return libflist_errp("cdc: cuts: calloc");
+
+    if(zero_cdc_scan(fd, length, chunker, zero_cdc_cut, cuts)) {
+        zero_cuts_free(cuts);
+        return NULL;
+    }
+
+    debug("[+] libflist: cdc: %lu chunks found (largest: %lu bytes)\n", cuts->length, cuts->maxsize);
+
+    return cuts;
+}
+
+// same as zero_cdc_cuts, on a file already mapped in memory,
+// boundaries are searched directly on the mapping
+chunk_cuts_t *zero_cdc_cuts_mapped(const uint8_t *data, size_t length, flist_chunker_t *chunker) {
+    chunk_cuts_t *cuts;
+    size_t offset = 0;
+
+    if(!(cuts = calloc(sizeof(chunk_cuts_t), 1)))
+        return libflist_errp("cdc: cuts: calloc");
+
+    while(offset < length) {
+        size_t chunklen = zero_cdc_boundary(data + offset, length - offset, chunker);
+
+        if(zero_cuts_append(cuts, offset, chunklen)) {
+            libflist_errp("cdc: cuts: realloc");
+            zero_cuts_free(cuts);
+            return NULL;
+        }
+
+        offset += chunklen;
+    }
+
+    debug("[+] libflist: cdc: %lu chunks found (largest: %lu bytes)\n", cuts->length, cuts->maxsize);
+
+    return cuts;
+}
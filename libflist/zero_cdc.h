@@ -0,0 +1,11 @@
+#ifndef LIBFLIST_ZERO_CDC_H
+    #define LIBFLIST_ZERO_CDC_H
+
+    // called for each chunk found by the scanner
+    typedef int (*zero_cdc_callback_t)(void *userptr, const uint8_t *data, off_t offset, size_t length);
+
+    size_t zero_cdc_boundary(const uint8_t *data, size_t length, flist_chunker_t *chunker);
+    int zero_cdc_scan(int fd, size_t length, flist_chunker_t *chunker, zero_cdc_callback_t callback, void *userptr);
+    chunk_cuts_t *zero_cdc_cuts(int fd, size_t length, flist_chunker_t *chunker);
+    chunk_cuts_t *zero_cdc_cuts_mapped(const uint8_t *data, size_t length, flist_chunker_t *chunker);
+#endif
@@ -1,8 +1,14 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <snappy-c.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <zlib.h>
 #include <math.h>
 #include <time.h>
@@ -12,8 +18,12 @@
 #include "xxtea.h"
 #include "flist_tools.h"
 #include "zero_chunk.h"
+#include "zero_cdc.h"
+#include "zero_memo.h"
+#include "zero_blake2.h"
+#include "zero_codec.h"
 
-#define CHUNK_SIZE    1024 * 512    // 512 KB
+#define CHUNK_SIZE    ZEROCHUNK_CHUNK_SIZE
 
 //
 // buffer manager
@@ -112,11 +122,130 @@ const unsigned char *buffer_next(buffer_t *buffer) {
 }
 
 void buffer_free(buffer_t *buffer) {
+    if(buffer->map)
+        munmap(buffer->map, buffer->length);
+
     fclose(buffer->fp);
     free(buffer->data);
     free(buffer);
 }
 
+// map the whole file in memory (read-only), chunks can then be used
+// directly from the mapping, without being copied
+//
+// file is read sequentially (aggressive read-ahead), by all the workers
+// around the same place, pages are released behind them
+//
+// note: if the file is truncated while mapped, reading the missing
+// part is fatal (SIGBUS), this is why this is not the default
+int buffer_map(buffer_t *buffer) {
+    void *map;
+
+    if(buffer->length == 0)
+        return 1;
+
+    if((map = mmap(NULL, buffer->length, PROT_READ, MAP_SHARED, fileno(buffer->fp), 0)) == MAP_FAILED) {
+        debug("[-] libflist: chunks: mmap: %s, reading file\n", strerror(errno));
+        return 1;
+    }
+
+    if(madvise(map, buffer->length, MADV_SEQUENTIAL) < 0)
+        debug("[-] libflist: chunks: madvise: %s\n", strerror(errno));
+
+    buffer->map = map;
+
+    return 0;
+}
+
+// range of the mapping not needed anymore, dropping pages fully
+// inside the range from memory and from the page cache, files larger
+// than memory don't push everything else out of the cache
+void buffer_release(buffer_t *buffer, off_t offset, size_t length) {
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t start = ((offset + pagesize - 1) / pagesize) * pagesize;
+    size_t end = ((offset + length) / pagesize) * pagesize;
+
+    // last chunk, the end of the last page can be released
+    if(offset + length == buffer->length)
+        end = ((offset + length + pagesize - 1) / pagesize) * pagesize;
+
+    if(!buffer->map || end <= start)
+        return;
+
+    madvise(buffer->map + start, end - start, MADV_DONTNEED);
+    posix_fadvise(fileno(buffer->fp), start, end - start, POSIX_FADV_DONTNEED);
+}
+
+//
+// chunks boundaries
+//
+chunk_cuts_t *zero_fixed_cuts(size_t length, size_t chunksize) {
+    chunk_cuts_t *cuts;
+
+    if(!(cuts = calloc(sizeof(chunk_cuts_t), 1)))
+        return libflist_errp("cuts: calloc");
+
+    cuts->length = (length + chunksize - 1) / chunksize;
+    cuts->allocated = cuts->length;
+    cuts->maxsize = (length < chunksize) ? length : chunksize;
+
+    if(!(cuts->list = malloc(sizeof(chunk_cut_t) * (cuts->length + 1)))) {
+        free(cuts);
+        return libflist_errp("cuts: list: malloc");
+    }
+
+    for(size_t i = 0; i < cuts->length; i++) {
+        cuts->list[i].offset = (off_t) i * chunksize;
+        cuts->list[i].length = chunksize;
+    }
+
+    // last chunk is probably smaller
+    if(cuts->length)
+        cuts->list[cuts->length - 1].length = length - cuts->list[cuts->length - 1].offset;
+
+    return cuts;
+}
+
+int zero_cuts_append(chunk_cuts_t *cuts, off_t offset, size_t length) {
+    if(cuts->length == cuts->allocated) {
+        size_t allocated = cuts->allocated ? cuts->allocated * 2 : 64;
+        chunk_cut_t *list;
+
+        if(!(list = realloc(cuts->list, sizeof(chunk_cut_t) * allocated)))
+            return 1;
+
+        cuts->list = list;
+        cuts->allocated = allocated;
+    }
+
+    cuts->list[cuts->length].offset = offset;
+    cuts->list[cuts->length].length = length;
+    cuts->length += 1;
+
+    if(length > cuts->maxsize)
+        cuts->maxsize = length;
+
+    return 0;
+}
+
+void zero_cuts_free(chunk_cuts_t *cuts) {
+    free(cuts->list);
+    free(cuts);
+}
+
+// compute chunks boundaries of a file, according to the chunking
+// mode of the context, fixed chunks are used without context
+static chunk_cuts_t *zero_chunks_cuts(buffer_t *buffer, flist_ctx_t *ctx) {
+    if(ctx && ctx->chunker.mode == FLIST_CHUNKING_CDC) {
+        if(buffer->map)
+            return zero_cdc_cuts_mapped(buffer->map, buffer->length, &ctx->chunker);
+
+        return zero_cdc_cuts(fileno(buffer->fp), buffer->length, &ctx->chunker);
+    }
+
+    return zero_fixed_cuts(buffer->length, CHUNK_SIZE);
+}
+
 //
 // hashing
 //
@@ -179,11 +308,21 @@ void libflist_chunk_free(flist_chunk_t *chunk) {
 //
 // encryption and decryption
 //
-// encrypt a buffer
-// returns a chunk with key, cipher, data and it's length
-flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
-    // hashing this chunk
-    unsigned char *hashkey = libflist_chunk_hash(chunk, chunksize);
+// payload is compressed (according to the codec) then encrypted with
+// it's key (hash of the plain payload), unless encryption is disabled,
+// the codec really used is saved on the chunk (and on the block)
+//
+static flist_codec_t chunk_codec_default = {
+    .compression = FLIST_COMPRESSION_SNAPPY,
+    .level = 0,
+    .encryption = FLIST_ENCRYPTION_XXTEA,
+};
+
+// compress and encrypt a buffer with it's key (hash of the buffer)
+// returns the encrypted payload, it's length and codec tag
+static uint8_t *chunk_seal(const uint8_t *chunk, size_t chunksize, uint8_t *hashkey, flist_codec_t *codec, size_t *length, uint16_t *tag) {
+    flist_compression_t compression = codec->compression;
+    zero_codec_t *compressor;
 
     if(libflist_debug_flag) {
         char *inhash = libflist_hashhex(hashkey, ZEROCHUNK_HASH_LENGTH);
@@ -191,26 +330,70 @@ flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
         free(inhash);
     }
 
+    if(!(compressor = zero_codec_get(compression))) {
+        libflist_set_error("chunk: encrypt: unsupported compression: %d", compression);
+        return NULL;
+    }
+
     //
     // compress
     //
-    size_t output_length = snappy_max_compressed_length(chunksize);
-    char *compressed = (char *) malloc(output_length);
+    // the compression buffer is large enough to be encrypted in place
+    // (padding and length added by xxtea), no other copy is needed
+    size_t capacity = compressor->bound(chunksize);
+    size_t output_length;
+    uint8_t *compressed;
+
+    // large enough to store the chunk uncompressed
+    if(capacity < chunksize)
+        capacity = chunksize;
+
+    if(codec->encryption == FLIST_ENCRYPTION_XXTEA)
+        capacity = xxtea_encrypt_length(capacity);
+
+    if(!(compressed = malloc(capacity)))
+        return libflist_errp("chunk: encrypt: malloc");
 
-    if(snappy_compress((char *) chunk, chunksize, compressed, &output_length) != SNAPPY_OK) {
-        libflist_set_error("snappy compression error");
+    if(!(output_length = compressor->compress(chunk, chunksize, compressed, capacity, codec->level))) {
+        free(compressed);
         return NULL;
     }
 
-    // printf("Compressed size: %lu\n", output_length);
+    // compression didn't help (data already compressed), payload is
+    // stored as-is, the legacy codec can't do that (older readers)
+    if(ZERO_CODEC_TAG(compression, codec->encryption) != ZERO_CODEC_LEGACY) {
+        if(compression != FLIST_COMPRESSION_STORE && output_length >= chunksize) {
+            debug("[+] libflist: chunk: %s didn't reduce the size, storing chunk\n", compressor->name);
+
+            memcpy(compressed, chunk, chunksize);
+            output_length = chunksize;
+            compression = FLIST_COMPRESSION_STORE;
+        }
+    }
+
+    *tag = ZERO_CODEC_TAG(compression, codec->encryption);
+
+    if(codec->encryption == FLIST_ENCRYPTION_NONE) {
+        *length = output_length;
+        return compressed;
+    }
 
     //
     // encrypt
     //
-    size_t encrypt_length;
-    unsigned char *encrypt_data = xxtea_encrypt_bkey(compressed, output_length, hashkey, ZEROCHUNK_HASH_LENGTH, &encrypt_length);
+    if(xxtea_encrypt_inplace(compressed, output_length, capacity, hashkey, ZEROCHUNK_HASH_LENGTH, length)) {
+        libflist_set_error("xxtea encryption error");
+        free(compressed);
+        return NULL;
+    }
+
+    return compressed;
+}
 
-    unsigned char *hashcrypt = libflist_chunk_hash(encrypt_data, encrypt_length);
+// build the chunk object of an encrypted payload (payload is
+// attached to the chunk, not copied)
+static flist_chunk_t *chunk_sealed(uint8_t *hashcrypt, uint8_t *hashkey, uint8_t *data, size_t length, uint16_t tag) {
+    flist_chunk_t *response;
 
     if(libflist_debug_flag) {
         char *inhash = libflist_hashhex(hashcrypt, ZEROCHUNK_HASH_LENGTH);
@@ -218,67 +401,154 @@ flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
         free(inhash);
     }
 
-    // cleaning
-    free(compressed);
+    if(!(response = libflist_chunk_new(hashcrypt, hashkey, NULL, 0))) {
+        free(data);
+        return NULL;
+    }
 
-    flist_chunk_t *response = libflist_chunk_new(hashcrypt, hashkey, NULL, 0);
-    response->encrypted.data = encrypt_data;
-    response->encrypted.length = encrypt_length;
+    response->encrypted.data = data;
+    response->encrypted.length = length;
+    response->codec = tag;
+
+    return response;
+}
+
+// encrypt a buffer
+// returns a chunk with key, cipher, data and it's length
+flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
+    flist_chunk_t *response = NULL;
+    uint8_t *hashkey, *hashcrypt, *encrypt_data;
+    size_t encrypt_length;
+    uint16_t tag;
+
+    // hashing this chunk
+    if(!(hashkey = libflist_chunk_hash(chunk, chunksize)))
+        return NULL;
+
+    if(!(encrypt_data = chunk_seal(chunk, chunksize, hashkey, &chunk_codec_default, &encrypt_length, &tag))) {
+        free(hashkey);
+        return NULL;
+    }
+
+    if((hashcrypt = libflist_chunk_hash(encrypt_data, encrypt_length))) {
+        response = chunk_sealed(hashcrypt, hashkey, encrypt_data, encrypt_length, tag);
+        free(hashcrypt);
+
+    } else {
+        free(encrypt_data);
+    }
 
     // memory duplicated on chunk object
-    free(hashcrypt);
     free(hashkey);
 
     return response;
 }
 
-// uncrypt a chunk
-// it takes a chunk as parameter
-// returns a chunk (without key and cipher) with payload data and length
-flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk) {
-    char *uncipherdata = NULL;
-    size_t uncipherlength;
+// decrypt the encrypted payload of a chunk into a new buffer,
+// returns the (still compressed) payload and it's length, a payload
+// not encrypted is returned as-is ('allocated' is not set)
+static uint8_t *chunk_unseal(flist_chunk_t *chunk, size_t *length, int *allocated) {
+    uint8_t *uncipherdata = NULL;
 
-    //
-    // uncrypt payload
-    //
-    char *key = libflist_hashhex(chunk->cipher.data, chunk->cipher.length);
-    debug("[+] libflist: chunk: uncrypt %lu buffer, with key: %s\n", chunk->encrypted.length, key);
-    free(key);
+    *allocated = 0;
+
+    if(ZERO_CODEC_ENCRYPTION(chunk->codec) == FLIST_ENCRYPTION_NONE) {
+        *length = chunk->encrypted.length;
+        return chunk->encrypted.data;
+    }
 
-    if(!(uncipherdata = xxtea_decrypt_bkey(chunk->encrypted.data, chunk->encrypted.length, chunk->cipher.data, chunk->cipher.length, &uncipherlength))) {
+    if(libflist_debug_flag) {
+        char *key = libflist_hashhex(chunk->cipher.data, chunk->cipher.length);
+        debug("[+] libflist: chunk: uncrypt %lu buffer, with key: %s\n", chunk->encrypted.length, key);
+        free(key);
+    }
+
+    // encrypted payload can be owned by the database (read-only),
+    // it's copied once and decrypted in place
+    if(!(uncipherdata = malloc(chunk->encrypted.length + 1)))
+        return libflist_errp("chunk: decrypt: malloc");
+
+    memcpy(uncipherdata, chunk->encrypted.data, chunk->encrypted.length);
+
+    if(xxtea_decrypt_inplace(uncipherdata, chunk->encrypted.length, chunk->cipher.data, chunk->cipher.length, length)) {
         libflist_set_error("cannot decrypt data, invalid key or payload");
+        free(uncipherdata);
         return NULL;
     }
 
-    //
-    // decompress
-    //
-    size_t uncompressed_length = 0;
-    snappy_status status;
+    *allocated = 1;
 
-    debug("[+] libflist: chunk: uncompressing %lu bytes\n", uncipherlength);
+    return uncipherdata;
+}
 
-    if((status = snappy_uncompressed_length(uncipherdata, uncipherlength, &uncompressed_length)) != SNAPPY_OK) {
-        libflist_set_error("snappy uncompression length error: %d", status);
+// decrypt and uncompress the payload of a chunk into 'target' (which
+// can hold 'capacity' bytes), or into a new buffer if 'target' is NULL
+// returns the plain payload and set it's length
+static uint8_t *chunk_open(flist_chunk_t *chunk, uint8_t *target, size_t capacity, size_t *plainlen) {
+    flist_encryption_t encryption = ZERO_CODEC_ENCRYPTION(chunk->codec);
+    uint8_t *payload, *plain = NULL;
+    zero_codec_t *codec;
+    size_t payloadlen;
+    ssize_t length;
+    int allocated;
+
+    if(encryption != FLIST_ENCRYPTION_XXTEA && encryption != FLIST_ENCRYPTION_NONE) {
+        libflist_set_error("chunk: unsupported codec: 0x%04x", chunk->codec);
         return NULL;
     }
 
-    char *uncompress = (char *) malloc(uncompressed_length);
-    if((status = snappy_uncompress(uncipherdata, uncipherlength, uncompress, &uncompressed_length)) != SNAPPY_OK) {
-        libflist_set_error("snappy uncompression error: %d", status);
+    if(!(codec = zero_codec_get(ZERO_CODEC_COMPRESSION(chunk->codec)))) {
+        libflist_set_error("chunk: unsupported codec: 0x%04x", chunk->codec);
         return NULL;
     }
 
-    chunk->plain.data = (uint8_t *) uncompress;
-    chunk->plain.length = uncompressed_length;
+    //
+    // uncrypt payload
+    //
+    if(!(payload = chunk_unseal(chunk, &payloadlen, &allocated)))
+        return NULL;
 
     //
-    // testing integrity
+    // decompress
     //
-    unsigned char *integrity = libflist_chunk_hash((unsigned char *) uncompress, uncompressed_length);
-    // printf("[+] integrity: %s\n", integrity);
+    debug("[+] libflist: chunk: uncompressing %lu bytes (%s)\n", payloadlen, codec->name);
 
+    if((length = codec->length(payload, payloadlen)) < 0)
+        goto cleanup;
+
+    if(target && (size_t) length > capacity) {
+        libflist_set_error("chunk: decrypt: target too small (%lu bytes needed)", length);
+        goto cleanup;
+    }
+
+    if(!(plain = target) && !(plain = malloc(length + 1))) {
+        libflist_errp("chunk: decrypt: malloc");
+        goto cleanup;
+    }
+
+    if(codec->uncompress(payload, payloadlen, plain, length)) {
+        if(plain != target)
+            free(plain);
+
+        plain = NULL;
+        goto cleanup;
+    }
+
+    *plainlen = length;
+
+cleanup:
+    if(allocated)
+        free(payload);
+
+    return plain;
+}
+
+// testing integrity, the key is the hash of the plain payload
+static int chunk_verify(flist_chunk_t *chunk, const uint8_t *data, size_t length) {
+    unsigned char *integrity;
+
+    if(!(integrity = libflist_chunk_hash(data, length)))
+        return 1;
 
     if(memcmp(integrity, chunk->cipher.data, chunk->cipher.length)) {
         char *inhash = libflist_hashhex(integrity, ZEROCHUNK_HASH_LENGTH);
@@ -290,88 +560,1087 @@ flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk) {
 
         free(inhash);
         free(outhash);
+        free(integrity);
 
-        return NULL;
+        return 1;
     }
 
     free(integrity);
-    free(uncipherdata);
+
+    return 0;
+}
+
+// uncrypt a chunk
+// it takes a chunk as parameter
+// returns a chunk (without key and cipher) with payload data and length
+flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk) {
+    size_t length;
+    uint8_t *plain;
+
+    if(!(plain = chunk_open(chunk, NULL, 0, &length)))
+        return NULL;
+
+    chunk->plain.data = plain;
+    chunk->plain.length = length;
+
+    //
+    // testing integrity
+    //
+    if(chunk_verify(chunk, chunk->plain.data, chunk->plain.length))
+        return NULL;
 
     return chunk;
 }
 
-static uint8_t *buffer_duplicate(flist_buffer_t *input) {
-    uint8_t *copy;
+// uncrypt a chunk directly into 'target' (which can hold 'length' bytes),
+// no plain buffer is allocated on the chunk
+// returns the plain length, -1 on error
+ssize_t libflist_chunk_decrypt_into(flist_chunk_t *chunk, void *target, size_t length) {
+    size_t plainlen;
+
+    if(!chunk_open(chunk, target, length, &plainlen))
+        return -1;
+
+    if(chunk_verify(chunk, target, plainlen))
+        return -1;
+
+    return plainlen;
+}
+
+//
+// chunks pipeline
+//
+// each worker claims the next chunks indexes, reads these chunks at their
+// offset, encrypts them and commits them to the backend, the result is
+// stored at the same index on the chunks list, which keeps the
+// original order whatever the completion order is
+//
+// with fixed size chunks (or a mapped file), boundaries are known before
+// starting workers, each worker reads its own chunks; with content-defined
+// chunks, the caller thread scans the file (see zero_cdc_scan) and hands
+// each chunk contents to the workers as soon as the boundary is found, the
+// file is only read once
+//
+// chunks are claimed by batch when blake2b can hash multiple buffers at
+// the same time (see zero_blake2.c), as long as there are enough chunks
+// to keep all the workers busy
+//
+// each worker only owns one batch at a time and the scanner doesn't go
+// further than 'window' chunks ahead of the workers, in-flight memory is
+// bounded by the amount of workers (and batch size)
+//
+typedef struct chunks_pipeline_t {
+    flist_ctx_t *ctx;
+    buffer_t *buffer;          // source file (read with pread, shared)
+    chunk_cuts_t *cuts;        // chunks boundaries on the source file
+    inode_chunks_t *chunks;    // target list, filled by index
+    size_t allocated;          // allocated entries on the chunks list
+
+    size_t next;               // next chunk index to claim
+    size_t available;          // amount of chunks which can be claimed
+    int complete;              // no more chunks will be available
+    size_t batch;              // amount of chunks claimed at once
+    size_t totalsize;          // encrypted size (statistics)
+    int error;                 // set when one worker failed
+    char errstr[1024];         // error message of the failing worker
+
+    int stream;                // chunks contents are provided by the scanner
+    uint8_t **payloads;        // scanned contents, indexed by (chunk % window)
+    size_t window;             // amount of payloads slots
+    size_t started;            // amount of workers threads running
+
+    pthread_mutex_t lock;
+    pthread_cond_t update;
+
+} chunks_pipeline_t;
+
+static void chunks_pipeline_fail(chunks_pipeline_t *pipeline, const char *message) {
+    pthread_mutex_lock(&pipeline->lock);
+
+    // only keep the first error
+    if(!pipeline->error) {
+        pipeline->error = 1;
+        snprintf(pipeline->errstr, sizeof(pipeline->errstr), "%s", message);
+    }
 
-    if(!(copy = malloc(input->length)))
-        diep("libflist: buffer: duplicate: malloc");
+    // waking up scanner and workers waiting
+    pthread_cond_broadcast(&pipeline->update);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+static ssize_t chunks_pipeline_read(buffer_t *buffer, uint8_t *data, size_t length, off_t offset) {
+    int fd = fileno(buffer->fp);
+    size_t done = 0;
+
+    while(done < length) {
+        ssize_t value = pread(fd, data + done, length - done, offset + done);
+
+        if(value < 0 && errno == EINTR)
+            continue;
+
+        if(value <= 0)
+            return -1;
+
+        done += value;
+    }
 
-    memcpy(copy, input->data, input->length);
-    return copy;
+    return done;
+}
+
+// plaintext already seen, the encrypted chunk is known from the memo,
+// it can be used as-is if there is nothing to upload
+// returns 1 if the chunk was resolved, 0 if it needs to be encrypted
+static int chunks_pipeline_memo(chunks_pipeline_t *pipeline, inode_chunk_t *ichunk, uint8_t *hashkey, size_t length) {
+    flist_ctx_t *ctx = pipeline->ctx;
+    zero_memo_record_t record;
+    flist_chunk_t *chunk;
+    int present = 1;
+
+    if(!zero_memo_lookup(ctx->memo, hashkey, &record))
+        return 0;
+
+    // encoded with another codec, not what's requested
+    if(record.requested != ZERO_CODEC_TAG(ctx->codec.compression, ctx->codec.encryption))
+        return 0;
+
+    if(!(chunk = libflist_chunk_new(record.id, hashkey, NULL, 0)))
+        return 0;
+
+    // encrypted payload is not available, the chunk needs to be
+    // on the backend already, otherwise it's encrypted again
+    if(ctx->backend)
+        present = libflist_backend_chunk_present(ctx->backend, chunk);
+
+    libflist_chunk_free(chunk);
+
+    if(!present)
+        return 0;
+
+    debug("[+] libflist: chunks: plaintext known from memo, skipping encryption\n");
+
+    ichunk->entryid = flist_memdup(record.id, ZEROCHUNK_HASH_LENGTH);
+    ichunk->entrylen = ZEROCHUNK_HASH_LENGTH;
+    ichunk->decipher = flist_memdup(hashkey, ZEROCHUNK_HASH_LENGTH);
+    ichunk->decipherlen = ZEROCHUNK_HASH_LENGTH;
+    ichunk->size = length;
+    ichunk->codec = record.codec;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->totalsize += record.length;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return 1;
+}
+
+// chunk encrypted, keeping track of it (upload is done
+// for the whole batch, see chunks_pipeline_process)
+static void chunks_pipeline_track(chunks_pipeline_t *pipeline, inode_chunk_t *ichunk, flist_chunk_t *chunk, size_t length) {
+    flist_ctx_t *ctx = pipeline->ctx;
+
+    if(ctx && ctx->memo) {
+        zero_memo_record_t record;
+
+        memcpy(record.id, chunk->id.data, ZEROCHUNK_HASH_LENGTH);
+        record.length = chunk->encrypted.length;
+        record.codec = chunk->codec;
+        record.requested = ZERO_CODEC_TAG(ctx->codec.compression, ctx->codec.encryption);
+
+        zero_memo_add(ctx->memo, chunk->cipher.data, &record);
+    }
+
+    ichunk->entryid = flist_memdup(chunk->id.data, chunk->id.length);
+    ichunk->entrylen = chunk->id.length;
+    ichunk->decipher = flist_memdup(chunk->cipher.data, chunk->cipher.length);
+    ichunk->decipherlen = chunk->cipher.length;
+    ichunk->size = length;
+    ichunk->codec = chunk->codec;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->totalsize += chunk->encrypted.length;
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// process a batch of consecutive chunks, plaintexts (then encrypted
+// payloads) of the whole batch are hashed together (multi-lane blake2b)
+// and encrypted chunks are committed together (one existence check)
+static int chunks_pipeline_process(chunks_pipeline_t *pipeline, inode_chunk_t *results, size_t count, uint8_t **data, size_t *lengths) {
+    flist_ctx_t *ctx = pipeline->ctx;
+    flist_codec_t *codec = ctx ? &ctx->codec : &chunk_codec_default;
+    uint8_t keys[ZERO_BLAKE2_MAX_LANES][ZEROCHUNK_HASH_LENGTH];
+    uint8_t ids[ZERO_BLAKE2_MAX_LANES][ZEROCHUNK_HASH_LENGTH];
+    uint8_t *keysptr[ZERO_BLAKE2_MAX_LANES], *idsptr[ZERO_BLAKE2_MAX_LANES];
+    uint8_t *sealed[ZERO_BLAKE2_MAX_LANES];
+    flist_chunk_t *chunks[ZERO_BLAKE2_MAX_LANES];
+    size_t sealedlen[ZERO_BLAKE2_MAX_LANES];
+    size_t owner[ZERO_BLAKE2_MAX_LANES];
+    uint16_t tags[ZERO_BLAKE2_MAX_LANES];
+    size_t pending = 0, sealedcount = 0;
+    int value = 1;
+
+    for(size_t i = 0; i < count; i++)
+        keysptr[i] = keys[i];
+
+    // hashing plaintexts (encryption keys)
+    if(zero_blake2_multi(keysptr, (const uint8_t **) data, lengths, count))
+        return 1;
+
+    for(size_t i = 0; i < count; i++) {
+        if(ctx && ctx->memo && chunks_pipeline_memo(pipeline, &results[i], keys[i], lengths[i]))
+            continue;
+
+        // encrypting chunk
+        if(!(sealed[pending] = chunk_seal(data[i], lengths[i], keys[i], codec, &sealedlen[pending], &tags[pending])))
+            goto cleanup;
+
+        idsptr[pending] = ids[pending];
+        owner[pending] = i;
+        pending += 1;
+    }
+
+    // hashing encrypted payloads (chunks id)
+    if(zero_blake2_multi(idsptr, (const uint8_t **) sealed, sealedlen, pending))
+        goto cleanup;
+
+    for(size_t j = 0; j < pending; j++) {
+        size_t i = owner[j];
+
+        // payload is now owned by the chunk
+        chunks[j] = chunk_sealed(ids[j], keys[i], sealed[j], sealedlen[j], tags[j]);
+        sealed[j] = NULL;
+        sealedcount = j + 1;
+
+        if(!chunks[j])
+            goto cleanup;
+
+        chunks_pipeline_track(pipeline, &results[i], chunks[j], lengths[i]);
+    }
+
+    // if context is provided
+    // uploading these chunks
+    if(ctx && ctx->backend && pending) {
+        if(libflist_backend_chunks_commit(ctx->backend, chunks, pending) < 0)
+            goto cleanup;
+    }
+
+    value = 0;
+
+cleanup:
+    for(size_t j = 0; j < pending; j++)
+        free(sealed[j]);
+
+    for(size_t j = 0; j < sealedcount; j++)
+        if(chunks[j])
+            libflist_chunk_free(chunks[j]);
+
+    return value;
+}
+
+// process claimable chunks until there is nothing left, if 'wait' is not
+// set, returns as soon as a full batch is not available (instead of waiting
+// for the scanner), this is used when no worker threads are running
+static void chunks_pipeline_work(chunks_pipeline_t *pipeline, int wait) {
+    buffer_t *buffer = pipeline->buffer;
+    uint8_t *data[ZERO_BLAKE2_MAX_LANES] = {NULL};
+    size_t lengths[ZERO_BLAKE2_MAX_LANES];
+    off_t offsets[ZERO_BLAKE2_MAX_LANES];
+    inode_chunk_t results[ZERO_BLAKE2_MAX_LANES];
+    size_t lanes = pipeline->batch;
+    int mapped = (buffer->map != NULL);
+    int reader = (!mapped && !pipeline->stream);
+
+    // one buffer per chunk of a batch, chunks are used directly
+    // from the mapping if the file is mapped, or from the scanner
+    for(size_t i = 0; i < lanes && reader; i++) {
+        if(!(data[i] = malloc(pipeline->cuts->maxsize + 1))) {
+            chunks_pipeline_fail(pipeline, "chunks: worker: malloc failed");
+            goto cleanup;
+        }
+    }
+
+    while(1) {
+        size_t first, count;
+
+        // claiming next chunks
+        pthread_mutex_lock(&pipeline->lock);
+
+        while(1) {
+            size_t claimable = pipeline->available - pipeline->next;
+
+            if(pipeline->error || (pipeline->complete && claimable == 0)) {
+                pthread_mutex_unlock(&pipeline->lock);
+                goto cleanup;
+            }
+
+            if(claimable >= lanes || (pipeline->complete && claimable > 0))
+                break;
+
+            if(!wait) {
+                pthread_mutex_unlock(&pipeline->lock);
+                goto cleanup;
+            }
+
+            pthread_cond_wait(&pipeline->update, &pipeline->lock);
+        }
+
+        first = pipeline->next;
+        count = pipeline->available - first;
+
+        if(count > lanes)
+            count = lanes;
+
+        // cuts list can be reallocated by the scanner
+        for(size_t i = 0; i < count; i++) {
+            offsets[i] = pipeline->cuts->list[first + i].offset;
+            lengths[i] = pipeline->cuts->list[first + i].length;
+
+            if(pipeline->stream) {
+                data[i] = pipeline->payloads[(first + i) % pipeline->window];
+                pipeline->payloads[(first + i) % pipeline->window] = NULL;
+            }
+        }
+
+        pipeline->next += count;
+
+        // slots released, scanner can go ahead
+        pthread_cond_broadcast(&pipeline->update);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        memset(results, 0, sizeof(results));
+
+        for(size_t i = 0; i < count && !pipeline->stream; i++) {
+            if(mapped) {
+                data[i] = buffer->map + offsets[i];
+                continue;
+            }
+
+            if(chunks_pipeline_read(buffer, data[i], lengths[i], offsets[i]) < 0) {
+                chunks_pipeline_fail(pipeline, "chunks: could not read source file");
+                goto cleanup;
+            }
+        }
+
+        int failed = chunks_pipeline_process(pipeline, results, count, data, lengths);
+
+        // chunks list can be reallocated by the scanner
+        pthread_mutex_lock(&pipeline->lock);
+        memcpy(&pipeline->chunks->list[first], results, sizeof(inode_chunk_t) * count);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        for(size_t i = 0; i < count && pipeline->stream; i++) {
+            free(data[i]);
+            data[i] = NULL;
+        }
+
+        if(failed) {
+            chunks_pipeline_fail(pipeline, libflist_strerror());
+            break;
+        }
+
+        for(size_t i = 0; i < count && mapped; i++)
+            buffer_release(buffer, offsets[i], lengths[i]);
+    }
+
+cleanup:
+    for(size_t i = 0; i < lanes && reader; i++)
+        free(data[i]);
+}
+
+static void *chunks_pipeline_worker(void *userptr) {
+    chunks_pipeline_work((chunks_pipeline_t *) userptr, 1);
+    return NULL;
+}
+
+// scanner callback, one chunk found, contents are copied
+// and made available to the workers
+static int chunks_pipeline_push(void *userptr, const uint8_t *data, off_t offset, size_t length) {
+    chunks_pipeline_t *pipeline = (chunks_pipeline_t *) userptr;
+    uint8_t *payload;
+
+    if(!(payload = malloc(length + 1))) {
+        libflist_errp("chunks: scanner: malloc");
+        return 1;
+    }
+
+    memcpy(payload, data, length);
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    // waiting for workers to catch up
+    while(!pipeline->error && pipeline->started && pipeline->available - pipeline->next >= pipeline->window)
+        pthread_cond_wait(&pipeline->update, &pipeline->lock);
+
+    if(pipeline->error)
+        goto failure;
+
+    if(pipeline->available == pipeline->allocated) {
+        size_t allocated = pipeline->allocated * 2;
+        inode_chunk_t *list;
+
+        if(!(list = realloc(pipeline->chunks->list, sizeof(inode_chunk_t) * allocated))) {
+            libflist_errp("chunks: list: realloc");
+            goto failure;
+        }
+
+        memset(list + pipeline->allocated, 0, sizeof(inode_chunk_t) * (allocated - pipeline->allocated));
+        pipeline->chunks->list = list;
+        pipeline->allocated = allocated;
+    }
+
+    if(zero_cuts_append(pipeline->cuts, offset, length)) {
+        libflist_errp("chunks: cuts: realloc");
+        goto failure;
+    }
+
+    pipeline->payloads[pipeline->available % pipeline->window] = payload;
+    pipeline->available += 1;
+
+    pthread_cond_broadcast(&pipeline->update);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    // no workers, processing on the caller thread
+    if(!pipeline->started)
+        chunks_pipeline_work(pipeline, 0);
+
+    return 0;
+
+failure:
+    pthread_mutex_unlock(&pipeline->lock);
+    free(payload);
+    return 1;
+}
+
+static int chunks_pipeline_run(chunks_pipeline_t *pipeline, size_t workers, size_t expected) {
+    pthread_t *threads;
+    size_t started = 0;
+
+    // no need to spawn more threads than chunks
+    if(workers > expected)
+        workers = expected;
+
+    // batch size, without starving workers
+    pipeline->batch = zero_blake2_lanes();
+
+    if(pipeline->batch > expected / (workers ? workers : 1))
+        pipeline->batch = expected / (workers ? workers : 1);
+
+    if(pipeline->batch < 1)
+        pipeline->batch = 1;
+
+    // single worker, processing everything on the caller thread,
+    // when scanning, one worker still runs alongside the scanner
+    if(workers <= 1 && !pipeline->stream) {
+        chunks_pipeline_work(pipeline, 1);
+        return pipeline->error;
+    }
+
+    if(workers < 1)
+        workers = 1;
+
+    if(pipeline->stream) {
+        pipeline->window = workers * pipeline->batch * 2;
+
+        if(!(pipeline->payloads = calloc(sizeof(uint8_t *), pipeline->window))) {
+            libflist_errp("chunks: pipeline: calloc");
+            return 1;
+        }
+    }
+
+    debug("[+] libflist: chunks: starting %lu workers\n", workers);
+
+    if(!(threads = malloc(sizeof(pthread_t) * workers))) {
+        libflist_errp("chunks: pipeline: malloc");
+        free(pipeline->payloads);
+        return 1;
+    }
+
+    for(started = 0; started < workers; started++)
+        if(pthread_create(&threads[started], NULL, chunks_pipeline_worker, pipeline))
+            break;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->started = started;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    if(pipeline->stream) {
+        buffer_t *buffer = pipeline->buffer;
+
+        if(zero_cdc_scan(fileno(buffer->fp), buffer->length, &pipeline->ctx->chunker, chunks_pipeline_push, pipeline))
+            chunks_pipeline_fail(pipeline, libflist_strerror());
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->complete = 1;
+        pthread_cond_broadcast(&pipeline->update);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    // could not start any thread, fallback to caller thread
+    if(started == 0)
+        chunks_pipeline_work(pipeline, 1);
+
+    for(size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+
+    // contents not processed (error)
+    for(size_t i = 0; i < pipeline->window; i++)
+        free(pipeline->payloads[i]);
+
+    free(pipeline->payloads);
+
+    return pipeline->error;
+}
+
+static void chunks_list_free(inode_chunks_t *chunks) {
+    for(size_t i = 0; i < chunks->size; i++) {
+        free(chunks->list[i].entryid);
+        free(chunks->list[i].decipher);
+    }
+
+    free(chunks->list);
+    free(chunks);
 }
 
 // compute file chunks, if context backend is specified (not NULL), committing
 // the chunk into the backend
+//
+// chunks are processed by 'ctx->workers' threads in parallel
 inode_chunks_t *libflist_chunks_proceed(char *localfile, flist_ctx_t *ctx) {
     buffer_t *buffer;
+    chunk_cuts_t *cuts;
     inode_chunks_t *chunks;
-    size_t totalsize = 0;
+    size_t expected;
+    int stream;
 
     // initialize buffer
     if(!(buffer = bufferize(localfile)))
         return NULL;
 
-    if(!(chunks = (inode_chunks_t *) calloc(sizeof(inode_chunks_t), 1)))
+    // chunks are read from a mapping, if enabled
+    if(ctx && ctx->reader == FLIST_READER_MMAP)
+        buffer_map(buffer);
+
+    // content-defined boundaries are found while processing chunks
+    stream = (ctx && ctx->chunker.mode == FLIST_CHUNKING_CDC && !buffer->map);
+
+    // compute chunks boundaries
+    cuts = stream ? calloc(sizeof(chunk_cuts_t), 1) : zero_chunks_cuts(buffer, ctx);
+
+    if(!cuts) {
+        if(stream)
+            libflist_errp("chunks: cuts: calloc");
+
+        buffer_free(buffer);
+        return NULL;
+    }
+
+    if(!(chunks = (inode_chunks_t *) calloc(sizeof(inode_chunks_t), 1))) {
+        zero_cuts_free(cuts);
+        buffer_free(buffer);
         return libflist_errp("chunks: compute: calloc");
+    }
 
-    // setting number of expected chunks
-    chunks->size = buffer->chunks;
+    // setting number of expected chunks, when scanning, the
+    // list grows as chunks are found
+    expected = stream ? buffer->length / ctx->chunker.avgsize + 1 : cuts->length;
     chunks->blocksize = 512; // ignored
 
-    if(!(chunks->list = (inode_chunk_t *) malloc(sizeof(inode_chunk_t) * chunks->size)))
-        diep("libflist: chunks: malloc");
+    if(!(chunks->list = (inode_chunk_t *) calloc(sizeof(inode_chunk_t), expected + 1))) {
+        zero_cuts_free(cuts);
+        buffer_free(buffer);
+        free(chunks);
+        return libflist_errp("chunks: list: calloc");
+    }
 
     // processing each chunks
-    debug("[+] libflist: chunks: processing %d chunks\n", buffer->chunks);
+    debug("[+] libflist: chunks: processing %lu chunks%s\n", expected, stream ? " (expected)" : "");
+
+    chunks_pipeline_t pipeline = {
+        .ctx = ctx,
+        .buffer = buffer,
+        .cuts = cuts,
+        .chunks = chunks,
+        .allocated = expected + 1,
+        .next = 0,
+        .available = stream ? 0 : cuts->length,
+        .complete = !stream,
+        .batch = 1,
+        .totalsize = 0,
+        .error = 0,
+        .stream = stream,
+    };
+
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.update, NULL);
+
+    int failed = chunks_pipeline_run(&pipeline, ctx ? ctx->workers : 1, expected);
+
+    // only chunks made available were processed
+    chunks->size = pipeline.available;
+
+    pthread_cond_destroy(&pipeline.update);
+    pthread_mutex_destroy(&pipeline.lock);
+    zero_cuts_free(cuts);
+    buffer_free(buffer);
 
-    for(int i = 0; i < buffer->chunks; i++) {
-        const unsigned char *data = buffer_next(buffer);
+    if(failed) {
+        // propagate worker error to the caller thread
+        if(pipeline.error)
+            libflist_set_error("%s", pipeline.errstr);
 
-        // encrypting chunk
+        fprintf(stderr, "[-] libflist: chunk: %s\n", libflist_strerror());
+        chunks_list_free(chunks);
+        return NULL;
+    }
+
+    debug("[+] libflist: chunks: %lu bytes\n", pipeline.totalsize);
+
+    return chunks;
+}
+
+//
+// chunks downloader
+//
+// a window of chunks are fetched (and decrypted) in parallel by
+// 'ctx->downloads' workers, the caller thread writes them in order
+// into the destination, as soon as they are available
+//
+// workers don't go further than 'window' chunks ahead of the writer,
+// which keep memory usage bounded
+//
+typedef struct chunks_download_t {
+    flist_ctx_t *ctx;
+    inode_chunks_t *chunks;
+
+    flist_chunk_t **slots;  // downloaded chunks, indexed by (chunk % window)
+    size_t window;          // amount of slots
+    size_t next;            // next chunk to fetch
+    size_t written;         // amount of chunks already written
+
+    uint8_t *map;           // mapped destination (chunks decrypted in place)
+    off_t *offsets;         // offset of each chunk on the mapped destination
+
+    int error;
+    char errstr[1024];
+
+    pthread_mutex_t lock;
+    pthread_cond_t update;
+
+} chunks_download_t;
+
+static void chunks_download_fail(chunks_download_t *download, const char *message) {
+    pthread_mutex_lock(&download->lock);
+
+    // only keep the first error
+    if(!download->error) {
+        download->error = 1;
+        snprintf(download->errstr, sizeof(download->errstr), "%s", message);
+    }
+
+    pthread_cond_broadcast(&download->update);
+    pthread_mutex_unlock(&download->lock);
+}
+
+static void *chunks_download_worker(void *userptr) {
+    chunks_download_t *download = (chunks_download_t *) userptr;
+
+    while(1) {
+        size_t index;
+
+        // claiming next chunk, if it fits in the window
+        // (mapped destination doesn't need any window)
+        pthread_mutex_lock(&download->lock);
+
+        while(!download->map && !download->error && download->next < download->chunks->size && download->next >= download->written + download->window)
+            pthread_cond_wait(&download->update, &download->lock);
+
+        if(download->error || download->next >= download->chunks->size) {
+            pthread_mutex_unlock(&download->lock);
+            break;
+        }
+
+        index = download->next++;
+        pthread_mutex_unlock(&download->lock);
+
+        inode_chunk_t *ichunk = &download->chunks->list[index];
         flist_chunk_t *chunk;
-        inode_chunk_t *ichunk = &chunks->list[i];
 
-        if(!(chunk = libflist_chunk_encrypt(data, buffer->chunksize))) {
-            // FIXME: memory leak
-            return NULL;
+        if(!(chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0))) {
+            chunks_download_fail(download, libflist_strerror());
+            break;
         }
 
-        ichunk->entryid = buffer_duplicate(&chunk->id);
-        ichunk->entrylen = chunk->id.length;
-        ichunk->decipher = buffer_duplicate(&chunk->cipher);
-        ichunk->decipherlen = chunk->cipher.length;
-
-        // if context is provided
-        // uploading this chunk
-        if(ctx && ctx->backend) {
-            if(libflist_backend_chunk_commit(ctx->backend, chunk) < 0) {
-                // FIXME: memory leak
-                fprintf(stderr, "[-] libflist: chunk: %s\n", libflist_strerror());
-                return NULL;
+        chunk->codec = ichunk->codec;
+
+        if(download->map) {
+            uint8_t *target = download->map + download->offsets[index];
+            ssize_t length = libflist_backend_download_chunk_into(download->ctx->backend, chunk, target, ichunk->size);
+
+            libflist_chunk_free(chunk);
+
+            if(length != (ssize_t) ichunk->size) {
+                chunks_download_fail(download, length < 0 ? libflist_strerror() : "chunks: download: unexpected chunk length");
+                break;
             }
+
+            pthread_mutex_lock(&download->lock);
+            download->written += 1;
+            pthread_cond_broadcast(&download->update);
+            pthread_mutex_unlock(&download->lock);
+
+            continue;
+        }
+
+        if(!libflist_backend_download_chunk(download->ctx->backend, chunk)) {
+            chunks_download_fail(download, libflist_strerror());
+            libflist_chunk_free(chunk);
+            break;
+        }
+
+        pthread_mutex_lock(&download->lock);
+        download->slots[index % download->window] = chunk;
+        pthread_cond_broadcast(&download->update);
+        pthread_mutex_unlock(&download->lock);
+    }
+
+    return NULL;
+}
+
+static int chunks_download_write(int fd, int seekable, uint8_t *data, size_t length, off_t offset) {
+    size_t done = 0;
+
+    while(done < length) {
+        ssize_t value;
+
+        if(seekable)
+            value = pwrite(fd, data + done, length - done, offset + done);
+        else
+            value = write(fd, data + done, length - done);
+
+        if(value < 0 && errno == EINTR)
+            continue;
+
+        if(value <= 0)
+            return 1;
+
+        done += value;
+    }
+
+    return 0;
+}
+
+// writer, running on the caller thread
+static int chunks_download_writer(chunks_download_t *download, int fd, int seekable) {
+    off_t offset = 0;
+
+    for(size_t i = 0; i < download->chunks->size; i++) {
+        flist_chunk_t *chunk;
+
+        pthread_mutex_lock(&download->lock);
+
+        while(!download->error && !download->slots[i % download->window])
+            pthread_cond_wait(&download->update, &download->lock);
+
+        if(download->error) {
+            pthread_mutex_unlock(&download->lock);
+            return 1;
         }
 
-        totalsize += chunk->encrypted.length;
+        chunk = download->slots[i % download->window];
+        download->slots[i % download->window] = NULL;
+
+        // releasing one slot in the window
+        download->written = i + 1;
+        pthread_cond_broadcast(&download->update);
+        pthread_mutex_unlock(&download->lock);
+
+        if(chunks_download_write(fd, seekable, chunk->plain.data, chunk->plain.length, offset)) {
+            libflist_chunk_free(chunk);
+            chunks_download_fail(download, "chunks: download: could not write destination");
+            return 1;
+        }
 
+        offset += chunk->plain.length;
         libflist_chunk_free(chunk);
+
+        libflist_progress(download->ctx, "downloading chunks", i + 1, download->chunks->size);
     }
 
-    debug("[+] libflist: chunks: %lu bytes\n", totalsize);
+    // file could be preallocated larger than real contents
+    if(seekable && ftruncate(fd, offset) < 0)
+        debug("[-] libflist: chunks: download: ftruncate: %s\n", strerror(errno));
 
-    // cleaning
-    buffer_free(buffer);
+    return 0;
+}
 
-    return chunks;
+// mapped destination, chunks are written by the workers
+// directly, only progression is reported on the caller thread
+static int chunks_download_mapped(chunks_download_t *download) {
+    size_t written = 0;
+
+    while(1) {
+        pthread_mutex_lock(&download->lock);
+
+        while(!download->error && download->written == written)
+            pthread_cond_wait(&download->update, &download->lock);
+
+        written = download->written;
+        int error = download->error;
+
+        pthread_mutex_unlock(&download->lock);
+
+        if(error)
+            return 1;
+
+        libflist_progress(download->ctx, "downloading chunks", written, download->chunks->size);
+
+        if(written == download->chunks->size)
+            return 0;
+    }
+}
+
+// map the destination file, when all chunks length are known (not the
+// case on old flist), each chunk is then uncompressed in place
+static uint8_t *chunks_download_map(chunks_download_t *download, int fd, size_t *maplen) {
+    inode_chunks_t *chunks = download->chunks;
+    size_t total = 0;
+    uint8_t *map;
+
+    for(size_t i = 0; i < chunks->size; i++) {
+        if(chunks->list[i].size == 0)
+            return NULL;
+
+        total += chunks->list[i].size;
+    }
+
+    if(!(download->offsets = malloc(sizeof(off_t) * chunks->size)))
+        return NULL;
+
+    for(size_t i = 0, offset = 0; i < chunks->size; i++) {
+        download->offsets[i] = offset;
+        offset += chunks->list[i].size;
+    }
+
+    // file needs to be opened read-write to be mapped
+    if(ftruncate(fd, total) < 0 || (map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        debug("[-] libflist: chunks: download: map: %s, writing sequentially\n", strerror(errno));
+        free(download->offsets);
+        download->offsets = NULL;
+        return NULL;
+    }
+
+    *maplen = total;
+
+    return map;
+}
+
+// download file contents from context backend, and write them
+// into file descriptor 'fd'
+//
+// when 'owned' is set, 'fd' is a file created by the caller for this
+// contents: if it's a regular file, it's preallocated, contents is
+// written at their offset and the file is truncated to the contents
+// length, a file opened read-write is mapped and chunks are then
+// uncompressed directly into the file, without intermediate copy
+//
+// otherwise contents is written sequentially, from the current
+// position (eg: stdout, which can be a file opened by the user)
+static int chunks_download(flist_ctx_t *ctx, inode_t *inode, int fd, int owned) {
+    inode_chunks_t *chunks = inode->chunks;
+    size_t workers = ctx->downloads;
+    pthread_t *threads;
+    size_t started;
+    size_t maplen = 0;
+    struct stat st;
+    int seekable = 0;
+
+    if(!ctx->backend) {
+        libflist_set_error("chunks: download: no backend set");
+        return 1;
+    }
+
+    if(!chunks || chunks->size == 0)
+        return 0;
+
+    if(owned && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        seekable = 1;
+
+    // preallocate destination, this is just an optimization
+    if(seekable && inode->size > 0 && fallocate(fd, 0, 0, inode->size) < 0)
+        debug("[-] libflist: chunks: download: fallocate: %s\n", strerror(errno));
+
+    if(workers > chunks->size)
+        workers = chunks->size;
+
+    chunks_download_t download = {
+        .ctx = ctx,
+        .chunks = chunks,
+        .window = workers * 2,
+        .next = 0,
+        .written = 0,
+        .map = NULL,
+        .offsets = NULL,
+        .error = 0,
+    };
+
+    if(seekable)
+        download.map = chunks_download_map(&download, fd, &maplen);
+
+    if(!(download.slots = calloc(sizeof(flist_chunk_t *), download.window))) {
+        libflist_errp("chunks: download: calloc");
+        goto unmap;
+    }
+
+    if(!(threads = malloc(sizeof(pthread_t) * workers))) {
+        free(download.slots);
+        libflist_errp("chunks: download: malloc");
+        goto unmap;
+    }
+
+    pthread_mutex_init(&download.lock, NULL);
+    pthread_cond_init(&download.update, NULL);
+
+    debug("[+] libflist: chunks: downloading %lu chunks, %lu workers\n", chunks->size, workers);
+
+    for(started = 0; started < workers; started++)
+        if(pthread_create(&threads[started], NULL, chunks_download_worker, &download))
+            break;
+
+    if(started == 0) {
+        chunks_download_fail(&download, "chunks: download: could not start any worker");
+
+    } else if(download.map) {
+        chunks_download_mapped(&download);
+
+    } else {
+        chunks_download_writer(&download, fd, seekable);
+    }
+
+    for(size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // cleaning chunks not written (in case of error)
+    for(size_t i = 0; i < download.window; i++)
+        if(download.slots[i])
+            libflist_chunk_free(download.slots[i]);
+
+    pthread_cond_destroy(&download.update);
+    pthread_mutex_destroy(&download.lock);
+    free(download.slots);
+    free(threads);
+
+    if(download.map) {
+        munmap(download.map, maplen);
+        free(download.offsets);
+    }
+
+    if(download.error) {
+        // propagate worker error to the caller thread
+        libflist_set_error("%s", download.errstr);
+        return 1;
+    }
+
+    return 0;
+
+unmap:
+    if(download.map) {
+        munmap(download.map, maplen);
+        free(download.offsets);
+    }
+
+    return 1;
+}
+
+// download into a stream, written sequentially
+int libflist_chunks_download(flist_ctx_t *ctx, inode_t *inode, int fd) {
+    return chunks_download(ctx, inode, fd, 0);
+}
+
+// download into a file created (and owned) by the caller
+int libflist_chunks_download_file(flist_ctx_t *ctx, inode_t *inode, int fd) {
+    return chunks_download(ctx, inode, fd, 1);
+}
+
+//
+// random access
+//
+
+// plain length of a chunk, flist created before chunks length was
+// stored always used fixed size chunks, only the last one can be smaller
+static size_t chunks_plain_length(inode_t *inode, size_t index, off_t offset) {
+    inode_chunk_t *ichunk = &inode->chunks->list[index];
+
+    if(ichunk->size)
+        return ichunk->size;
+
+    if(index == inode->chunks->size - 1)
+        return inode->size - offset;
+
+    return ZEROCHUNK_CHUNK_SIZE;
+}
+
+// read 'length' bytes of file contents, starting at 'offset', into
+// 'buffer', only chunks covering the requested range are downloaded
+//
+// returns amount of bytes read (could be less than requested if end
+// of file is reached), -1 on error
+ssize_t libflist_file_pread(flist_ctx_t *ctx, inode_t *inode, void *buffer, size_t length, off_t offset) {
+    inode_chunks_t *chunks = inode->chunks;
+    uint8_t *target = (uint8_t *) buffer;
+    off_t chunkoff = 0;
+    size_t done = 0;
+
+    if(!ctx->backend) {
+        libflist_set_error("file: pread: no backend set");
+        return -1;
+    }
+
+    if(offset < 0 || (size_t) offset >= inode->size || !chunks)
+        return 0;
+
+    if(length > inode->size - offset)
+        length = inode->size - offset;
+
+    for(size_t i = 0; i < chunks->size && done < length; i++) {
+        size_t chunklen = chunks_plain_length(inode, i, chunkoff);
+        off_t current = offset + done;
+
+        // chunk before requested range
+        if(chunkoff + (off_t) chunklen <= current) {
+            chunkoff += chunklen;
+            continue;
+        }
+
+        inode_chunk_t *ichunk = &chunks->list[i];
+        flist_chunk_t *chunk;
+
+        debug("[+] libflist: file: pread: fetching chunk %lu (offset %ld)\n", i, chunkoff);
+
+        // borrowed from backend cache if enabled
+        if(!(chunk = libflist_backend_chunk_acquire(ctx->backend, ichunk->entryid, ichunk->decipher, ichunk->codec)))
+            return -1;
+
+        if(chunk->plain.length != chunklen) {
+            libflist_set_error("file: pread: chunk %lu: unexpected length", i);
+            libflist_backend_chunk_release(ctx->backend, chunk);
+            return -1;
+        }
+
+        // copy the part of this chunk within requested range
+        size_t inside = current - chunkoff;
+        size_t copy = chunklen - inside;
+
+        if(copy > length - done)
+            copy = length - done;
+
+        memcpy(target + done, chunk->plain.data + inside, copy);
+        libflist_backend_chunk_release(ctx->backend, chunk);
+
+        done += copy;
+        chunkoff += chunklen;
+    }
+
+    return done;
 }
 
 inode_chunks_t *flist_chunks_duplicate(inode_chunks_t *source) {
@@ -402,6 +1671,9 @@ inode_chunks_t *flist_chunks_duplicate(inode_chunks_t *source) {
 
         item->decipher = flist_memdup(src->decipher, src->decipherlen);
         item->decipherlen = src->decipherlen;
+
+        item->size = src->size;
+        item->codec = src->codec;
     }
 
     return chunks;
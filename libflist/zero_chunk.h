@@ -2,8 +2,10 @@
     #define LIBFLIST_ZERO_CHUNK_H
 
     #include <stdint.h>
+    #include <sys/types.h>
 
     #define ZEROCHUNK_HASH_LENGTH   16
+    #define ZEROCHUNK_CHUNK_SIZE    (1024 * 512)    // 512 KB
 
     typedef struct buffer_t {
         FILE *fp;
@@ -13,14 +15,37 @@
         size_t chunksize;
         size_t finalsize;
         int chunks;
+        uint8_t *map;       // file mapped in memory (optional)
 
     } buffer_t;
 
+    // one chunk location on the source file
+    typedef struct chunk_cut_t {
+        off_t offset;
+        size_t length;
+
+    } chunk_cut_t;
+
+    typedef struct chunk_cuts_t {
+        chunk_cut_t *list;
+        size_t length;      // amount of chunks
+        size_t allocated;   // allocated entries on the list
+        size_t maxsize;     // largest chunk on the list
+
+    } chunk_cuts_t;
+
     // file buffer
     buffer_t *bufferize(char *filename);
     buffer_t *buffer_writer(char *filename);
     const uint8_t *buffer_next(buffer_t *buffer);
     void buffer_free(buffer_t *buffer);
+    int buffer_map(buffer_t *buffer);
+    void buffer_release(buffer_t *buffer, off_t offset, size_t length);
+
+    // chunks boundaries
+    chunk_cuts_t *zero_fixed_cuts(size_t length, size_t chunksize);
+    int zero_cuts_append(chunk_cuts_t *cuts, off_t offset, size_t length);
+    void zero_cuts_free(chunk_cuts_t *cuts);
 
     // chunk
     inode_chunks_t *flist_chunks_duplicate(inode_chunks_t *source);
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <snappy-c.h>
+#include <lz4.h>
+#include <zstd.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_codec.h"
+
+//
+// chunks compression codecs
+//
+// each block of a file saves the codec used to encode its payload,
+// a reader only needs to know the codec tag to decode any chunk,
+// whatever the settings used when the flist was created
+//
+// a codec only handles compression, encryption (or not) is done
+// on the compressed payload (see zero_chunk.c)
+//
+
+//
+// snappy (original format)
+//
+static size_t codec_snappy_bound(size_t length) {
+    return snappy_max_compressed_length(length);
+}
+
+static size_t codec_snappy_compress(const uint8_t *source, size_t length, uint8_t *target, size_t capacity, int level) {
+    (void) level;
+
+    if(snappy_compress((char *) source, length, (char *) target, &capacity) != SNAPPY_OK) {
+        libflist_set_error("snappy compression error");
+        return 0;
+    }
+
+    return capacity;
+}
+
+static ssize_t codec_snappy_length(const uint8_t *source, size_t length) {
+    size_t plainlen = 0;
+    snappy_status status;
+
+    if((status = snappy_uncompressed_length((char *) source, length, &plainlen)) != SNAPPY_OK) {
+        libflist_set_error("snappy uncompression length error: %d", status);
+        return -1;
+    }
+
+    return plainlen;
+}
+
+static int codec_snappy_uncompress(const uint8_t *source, size_t length, uint8_t *target, size_t plainlen) {
+    snappy_status status;
+
+    if((status = snappy_uncompress((char *) source, length, (char *) target, &plainlen)) != SNAPPY_OK) {
+        libflist_set_error("snappy uncompression error: %d", status);
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// store (payload not compressed)
+//
+static size_t codec_store_bound(size_t length) {
+    return length;
+}
+
+static size_t codec_store_compress(const uint8_t *source, size_t length, uint8_t *target, size_t capacity, int level) {
+    (void) level;
+
+    if(length > capacity) {
+        libflist_set_error("store: target too small");
+        return 0;
+    }
+
+    memcpy(target, source, length);
+
+    return length;
+}
+
+static ssize_t codec_store_length(const uint8_t *source, size_t length) {
+    (void) source;
+    return length;
+}
+
+static int codec_store_uncompress(const uint8_t *source, size_t length, uint8_t *target, size_t plainlen) {
+    if(length != plainlen) {
+        libflist_set_error("store: unexpected payload length");
+        return 1;
+    }
+
+    memcpy(target, source, length);
+
+    return 0;
+}
+
+//
+// lz4
+//
+// lz4 block format doesn't contains the plain length, the payload
+// starts with the plain length (32 bits, little endian)
+//
+#define CODEC_LZ4_HEADER  4
+
+static size_t codec_lz4_bound(size_t length) {
+    return CODEC_LZ4_HEADER + LZ4_compressBound(length);
+}
+
+static size_t codec_lz4_compress(const uint8_t *source, size_t length, uint8_t *target, size_t capacity, int level) {
+    int compressed;
+
+    (void) level;
+
+    if(length > LZ4_MAX_INPUT_SIZE || capacity < CODEC_LZ4_HEADER) {
+        libflist_set_error("lz4 compression error: input too large");
+        return 0;
+    }
+
+    for(int i = 0; i < CODEC_LZ4_HEADER; i++)
+        target[i] = (length >> (i * 8)) & 0xff;
+
+    compressed = LZ4_compress_default((char *) source, (char *) target + CODEC_LZ4_HEADER, length, capacity - CODEC_LZ4_HEADER);
+
+    if(compressed <= 0) {
+        libflist_set_error("lz4 compression error");
+        return 0;
+    }
+
+    return CODEC_LZ4_HEADER + compressed;
+}
+
+static ssize_t codec_lz4_length(const uint8_t *source, size_t length) {
+    size_t plainlen = 0;
+
+    if(length < CODEC_LZ4_HEADER) {
+        libflist_set_error("lz4 uncompression length error: payload too short");
+        return -1;
+    }
+
+    for(int i = 0; i < CODEC_LZ4_HEADER; i++)
+        plainlen |= (size_t) source[i] << (i * 8);
+
+    return plainlen;
+}
+
+static int codec_lz4_uncompress(const uint8_t *source, size_t length, uint8_t *target, size_t plainlen) {
+    int value;
+
+    value = LZ4_decompress_safe((char *) source + CODEC_LZ4_HEADER, (char *) target, length - CODEC_LZ4_HEADER, plainlen);
+
+    if(value < 0 || (size_t) value != plainlen) {
+        libflist_set_error("lz4 uncompression error: %d", value);
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// zstd
+//
+// zstd frames contains the plain length, level 0 is the
+// library default level
+//
+static size_t codec_zstd_bound(size_t length) {
+    return ZSTD_compressBound(length);
+}
+
+static size_t codec_zstd_compress(const uint8_t *source, size_t length, uint8_t *target, size_t capacity, int level) {
+    size_t value;
+
+    value = ZSTD_compress(target, capacity, source, length, level);
+
+    if(ZSTD_isError(value)) {
+        libflist_set_error("zstd compression error: %s", ZSTD_getErrorName(value));
+        return 0;
+    }
+
+    return value;
+}
+
+static ssize_t codec_zstd_length(const uint8_t *source, size_t length) {
+    unsigned long long plainlen;
+
+    plainlen = ZSTD_getFrameContentSize(source, length);
+
+    if(plainlen == ZSTD_CONTENTSIZE_UNKNOWN || plainlen == ZSTD_CONTENTSIZE_ERROR) {
+        libflist_set_error("zstd uncompression length error");
+        return -1;
+    }
+
+    return plainlen;
+}
+
+static int codec_zstd_uncompress(const uint8_t *source, size_t length, uint8_t *target, size_t plainlen) {
+    size_t value;
+
+    value = ZSTD_decompress(target, plainlen, source, length);
+
+    if(ZSTD_isError(value)) {
+        libflist_set_error("zstd uncompression error: %s", ZSTD_getErrorName(value));
+        return 1;
+    }
+
+    if(value != plainlen) {
+        libflist_set_error("zstd uncompression error: unexpected length");
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// registry
+//
+static zero_codec_t codecs[] = {
+    {
+        .compression = FLIST_COMPRESSION_SNAPPY,
+        .name = "snappy",
+        .bound = codec_snappy_bound,
+        .compress = codec_snappy_compress,
+        .length = codec_snappy_length,
+        .uncompress = codec_snappy_uncompress,
+    },
+    {
+        .compression = FLIST_COMPRESSION_STORE,
+        .name = "store",
+        .bound = codec_store_bound,
+        .compress = codec_store_compress,
+        .length = codec_store_length,
+        .uncompress = codec_store_uncompress,
+    },
+    {
+        .compression = FLIST_COMPRESSION_LZ4,
+        .name = "lz4",
+        .bound = codec_lz4_bound,
+        .compress = codec_lz4_compress,
+        .length = codec_lz4_length,
+        .uncompress = codec_lz4_uncompress,
+    },
+    {
+        .compression = FLIST_COMPRESSION_ZSTD,
+        .name = "zstd",
+        .bound = codec_zstd_bound,
+        .compress = codec_zstd_compress,
+        .length = codec_zstd_length,
+        .uncompress = codec_zstd_uncompress,
+    },
+};
+
+zero_codec_t *zero_codec_get(flist_compression_t compression) {
+    for(size_t i = 0; i < sizeof(codecs) / sizeof(zero_codec_t); i++)
+        if(codecs[i].compression == compression)
+            return &codecs[i];
+
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef LIBFLIST_ZERO_CODEC_H
+    #define LIBFLIST_ZERO_CODEC_H
+
+    // codec tag saved on each block: compression on the low byte,
+    // encryption on the high byte, 0 is the original format
+    // (snappy and xxtea), which is what older flists contains
+    #define ZERO_CODEC_TAG(compression, encryption)  ((uint16_t) ((compression) | ((encryption) << 8)))
+    #define ZERO_CODEC_COMPRESSION(tag)              ((flist_compression_t) ((tag) & 0xff))
+    #define ZERO_CODEC_ENCRYPTION(tag)               ((flist_encryption_t) ((tag) >> 8))
+    #define ZERO_CODEC_LEGACY                        0
+
+    typedef struct zero_codec_t {
+        flist_compression_t compression;
+        char *name;
+
+        // maximum compressed length of 'length' bytes
+        size_t (*bound)(size_t length);
+
+        // compress 'length' bytes of 'source' into 'target' (which can hold
+        // 'capacity' bytes), returns the compressed length, 0 on error
+        size_t (*compress)(const uint8_t *source, size_t length, uint8_t *target, size_t capacity, int level);
+
+        // plain length of a compressed payload, -1 if payload is invalid
+        ssize_t (*length)(const uint8_t *source, size_t length);
+
+        // uncompress a payload into 'target', which can hold exactly
+        // the plain length, returns 0 on success
+        int (*uncompress)(const uint8_t *source, size_t length, uint8_t *target, size_t plainlen);
+
+    } zero_codec_t;
+
+    zero_codec_t *zero_codec_get(flist_compression_t compression);
+#endif
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+#include "zero_memo.h"
+
+//
+// chunks memo
+//
+// encryption is convergent: the key is the hash of the plaintext and the
+// id is the hash of the encrypted payload, for a given plaintext the
+// resulting (id, key) pair is always the same
+//
+// the memo maps the plaintext hash (the key) to the encrypted id, a chunk
+// already seen only needs to be hashed, compression and encryption are
+// skipped (as long as the chunk is confirmed present on the backend)
+//
+// records are deterministic, they are always valid whatever happens
+// on the backend, the memo is saved when the context is released
+//
+
+// returns 1 and fill 'record' if the plaintext is known
+int zero_memo_lookup(flist_chunks_memo_t *memo, uint8_t *hashkey, zero_memo_record_t *record) {
+    uint8_t *found = NULL;
+
+    pthread_mutex_lock(&memo->lock);
+
+    if(!(found = flist_table_lookup(memo->session, hashkey)) && memo->persistent)
+        found = flist_table_lookup(memo->persistent, hashkey);
+
+    if(found)
+        memcpy(record, found, sizeof(zero_memo_record_t));
+
+    pthread_mutex_unlock(&memo->lock);
+
+    return (found != NULL);
+}
+
+void zero_memo_add(flist_chunks_memo_t *memo, uint8_t *hashkey, zero_memo_record_t *record) {
+    pthread_mutex_lock(&memo->lock);
+
+    if(flist_table_insert(memo->session, hashkey, (uint8_t *) record))
+        debug("[-] libflist: memo: could not record chunk\n");
+
+    pthread_mutex_unlock(&memo->lock);
+}
+
+void zero_memo_free(flist_chunks_memo_t *memo) {
+    if(memo->session->count > 0) {
+        debug("[+] libflist: memo: saving %lu chunks\n", memo->session->count);
+
+        if(flist_table_merge(memo->filename, memo->session))
+            debug("[-] libflist: memo: could not update %s\n", memo->filename);
+    }
+
+    if(memo->persistent)
+        flist_table_free(memo->persistent);
+
+    flist_table_free(memo->session);
+    pthread_mutex_destroy(&memo->lock);
+
+    free(memo->filename);
+    free(memo);
+}
+
+//
+// public interface
+//
+
+// remember plaintext to encrypted chunk mapping, persistent memo is
+// stored on 'filename' and can be shared by any backend
+flist_ctx_t *libflist_context_set_chunks_memo(flist_ctx_t *ctx, char *filename) {
+    flist_chunks_memo_t *memo;
+
+    if(!(memo = calloc(sizeof(flist_chunks_memo_t), 1)))
+        return libflist_errp("memo: calloc");
+
+    if(!(memo->filename = strdup(filename))) {
+        free(memo);
+        return libflist_errp("memo: strdup");
+    }
+
+    if(!(memo->session = flist_table_new(ZEROCHUNK_HASH_LENGTH, sizeof(zero_memo_record_t)))) {
+        free(memo->filename);
+        free(memo);
+        return NULL;
+    }
+
+    memo->persistent = flist_table_open(filename, ZEROCHUNK_HASH_LENGTH, sizeof(zero_memo_record_t));
+    pthread_mutex_init(&memo->lock, NULL);
+
+    debug("[+] libflist: memo: %s, %lu chunks\n", filename, memo->persistent ? memo->persistent->count : 0);
+
+    if(ctx->memo)
+        zero_memo_free(ctx->memo);
+
+    ctx->memo = memo;
+
+    return ctx;
+}
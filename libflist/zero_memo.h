@@ -0,0 +1,27 @@
+#ifndef LIBFLIST_ZERO_MEMO_H
+    #define LIBFLIST_ZERO_MEMO_H
+
+    #include "flist_table.h"
+
+    // one memo record: encrypted chunk produced by a plaintext
+    typedef struct zero_memo_record_t {
+        uint8_t id[ZEROCHUNK_HASH_LENGTH];  // encrypted chunk id
+        uint32_t length;                    // encrypted length (statistics)
+        uint16_t codec;                     // codec of the encrypted chunk
+        uint16_t requested;                 // codec requested when encrypted
+
+    } __attribute__((packed)) zero_memo_record_t;
+
+    typedef struct flist_chunks_memo_t {
+        char *filename;             // persistent memo file
+        flist_table_t *persistent;  // records from previous runs (can be NULL)
+        flist_table_t *session;     // records added during this run
+
+        pthread_mutex_t lock;
+
+    } flist_chunks_memo_t;
+
+    int zero_memo_lookup(flist_chunks_memo_t *memo, uint8_t *hashkey, zero_memo_record_t *record);
+    void zero_memo_add(flist_chunks_memo_t *memo, uint8_t *hashkey, zero_memo_record_t *record);
+    void zero_memo_free(flist_chunks_memo_t *memo);
+#endif
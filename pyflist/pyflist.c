@@ -376,6 +376,9 @@ reply:
         // removing possible already existing db
         unlink(targetfile);
 
+        if(libflist_db_sqlite_vacuum(root.workspace))
+            debug("[-] could not compact database: %s\n", libflist_strerror());
+
         if(!(libflist_archive_create(targetfile, root.workspace)))
             PyErr_SetString(PyExc_RuntimeError, libflist_strerror());
     }
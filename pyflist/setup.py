@@ -3,7 +3,7 @@ from distutils.core import setup, Extension
 flist = Extension(
     'pyflist',
     include_dirs=['../libflist/'],
-    libraries=['snappy', 'z', 'm', 'b2', 'sqlite3', 'tar', 'capnp_c', 'hiredis'],
+    libraries=['snappy', 'lz4', 'zstd', 'z', 'm', 'b2', 'sqlite3', 'tar', 'capnp_c', 'hiredis'],
     sources=['pyflist.c'],
     extra_compile_args=['-std=c99', '-fopenmp'],
     extra_link_args=['-fopenmp', '../libflist/libflist.a'],
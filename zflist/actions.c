@@ -68,13 +68,23 @@ int zf_init(zf_callback_t *cb) {
 
     // initialize root directory
     dirnode_t *root = libflist_dirnode_create("", "");
-    libflist_serial_dirnode_commit(root, ctx, root);
+    int value = libflist_serial_dirnode_commit(root, ctx, root);
     libflist_dirnode_free(root);
 
+    if(value)
+        zf_error(cb, "init", "%s", libflist_strerror());
+
     // commit changes
-    database->close(database);
+    if(database->close(database) && !value) {
+        zf_error(cb, "init", "could not save changes: %s", libflist_strerror());
+        value = 1;
+    }
+
     libflist_context_free(ctx);
 
+    if(value)
+        return 1;
+
     debug("[+] action: init: flist initialized\n");
     return 0;
 }
@@ -95,8 +105,16 @@ int zf_commit(zf_callback_t *cb) {
     // removing possible already existing db
     unlink(filename);
 
+    // compacting database, only once, before archiving
+    if(libflist_db_sqlite_vacuum(cb->settings->mnt)) {
+        zf_error(cb, "commit", "could not compact database: %s", libflist_strerror());
+        return 1;
+    }
+
     // create flist
-    if(!libflist_archive_create(filename, cb->settings->mnt)) {
+    flist_archive_format_t format = zf_internal_archive_format();
+
+    if(!libflist_archive_create_format(filename, cb->settings->mnt, format, zf_internal_workers_count())) {
         zf_error(cb, "commit", "could not create flist");
         return 1;
     }
@@ -129,9 +147,14 @@ static int zf_chmod_root(zf_callback_t *cb, int newmode) {
     dirnode->acl->mode = newmode;
     libflist_acl_commit(dirnode->acl);
 
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, dirnode);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, dirnode);
     libflist_dirnode_free(dirnode);
 
+    if(value) {
+        zf_error(cb, "chmod", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -176,11 +199,16 @@ int zf_chmod(zf_callback_t *cb) {
     debug("[+] action: chmod: new mode: 0o%o\n", inode->acl->mode);
 
     dirnode_t *parent = libflist_dirnode_get_parent(cb->ctx->db, dirnode);
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
 
     libflist_dirnode_free(parent);
     libflist_dirnode_free(dirnode);
 
+    if(value) {
+        zf_error(cb, "chmod", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -226,11 +254,16 @@ int zf_rm(zf_callback_t *cb) {
     debug("[+] action: rm: files in the directory: %lu\n", dirnode->inode_length);
 
     dirnode_t *parent = libflist_dirnode_get_parent(cb->ctx->db, dirnode);
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
 
     libflist_dirnode_free(parent);
     libflist_dirnode_free(dirnode);
 
+    if(value) {
+        zf_error(cb, "rm", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -285,12 +318,17 @@ int zf_rmdir(zf_callback_t *cb) {
 
     // commit changes in the parent (and parent of the parent)
     dirnode_t *pparent = libflist_dirnode_get_parent(cb->ctx->db, parent);
-    libflist_serial_dirnode_commit(parent, cb->ctx, pparent);
+    int value = libflist_serial_dirnode_commit(parent, cb->ctx, pparent);
 
     libflist_dirnode_free(parent);
     libflist_dirnode_free(pparent);
     libflist_dirnode_free_recursive(dirnode);
 
+    if(value) {
+        zf_error(cb, "rmdir", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -330,11 +368,16 @@ int zf_mkdir(zf_callback_t *cb) {
 
     // commit changes in the parent
     dirnode_t *dparent = libflist_dirnode_get_parent(cb->ctx->db, dirnode);
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, dparent);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, dparent);
 
     libflist_dirnode_free(dirnode);
     libflist_dirnode_free(dparent);
 
+    if(value) {
+        zf_error(cb, "mkdir", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -435,7 +478,8 @@ int zf_chunks(zf_callback_t *cb) {
 int zf_check(zf_callback_t *cb) {
     dirnode_t *dirnode;
 
-    if(!(zf_public_backend_extract(cb->ctx))) {
+    // only checking chunks existence
+    if(!(zf_public_backend_extract(cb, 1))) {
         zf_error(cb, "check", "backend: %s", libflist_strerror());
         return 1;
     }
@@ -535,7 +579,8 @@ int zf_cat(zf_callback_t *cb) {
         return 1;
     }
 
-    if(!(zf_public_backend_extract(cb->ctx))) {
+    // one connection per parallel download
+    if(!(zf_public_backend_extract(cb, cb->ctx->downloads))) {
         zf_error(cb, "cat", "backend: %s", libflist_strerror());
         return 1;
     }
@@ -567,17 +612,9 @@ int zf_cat(zf_callback_t *cb) {
         return 1;
     }
 
-    for(size_t i = 0; i < inode->chunks->size; i++) {
-        inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
-
-        if(!libflist_backend_download_chunk(cb->ctx->backend, chunk)) {
-            zf_error(cb, "cat", "could not download file: %s", libflist_strerror());
-            return 1;
-        }
-
-        printf("%.*s\n", (int) chunk->plain.length, chunk->plain.data);
-        libflist_chunk_free(chunk);
+    if(libflist_chunks_download(cb->ctx, inode, STDOUT_FILENO)) {
+        zf_error(cb, "cat", "could not download file: %s", libflist_strerror());
+        return 1;
     }
 
     libflist_dirnode_free(dirnode);
@@ -594,7 +631,8 @@ int zf_get(zf_callback_t *cb) {
         return 1;
     }
 
-    if(!(zf_public_backend_extract(cb->ctx))) {
+    // one connection per parallel download
+    if(!(zf_public_backend_extract(cb, cb->ctx->downloads))) {
         zf_error(cb, "get", "backend: %s", libflist_strerror());
         return 1;
     }
@@ -630,27 +668,20 @@ int zf_get(zf_callback_t *cb) {
         return 1;
     }
 
+    // opened read-write, file can be mapped to download
+    // chunks directly in place
     int fd;
-    if((fd = creat(destination, 0664)) < 0)
-        zf_diep(cb, destination);
+    if((fd = open(destination, O_RDWR | O_CREAT | O_TRUNC, 0664)) < 0) {
+        zf_warnp(cb, destination);
+        return 1;
+    }
 
     libflist_progress(cb->ctx, "fetching file", 0, 0);
 
-    for(size_t i = 0; i < inode->chunks->size; i++) {
-        inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
-
-        libflist_progress(cb->ctx, "downloading chunks", i + 1, inode->chunks->size);
-
-        if(!libflist_backend_download_chunk(cb->ctx->backend, chunk)) {
-            zf_error(cb, "get", "could not download file: %s", libflist_strerror());
-            return 1;
-        }
-
-        if(write(fd, chunk->plain.data, chunk->plain.length) != (int) chunk->plain.length)
-            zf_diep(cb, destination);
-
-        libflist_chunk_free(chunk);
+    if(libflist_chunks_download_file(cb->ctx, inode, fd)) {
+        zf_error(cb, "get", "could not download file: %s", libflist_strerror());
+        close(fd);
+        return 1;
     }
 
     libflist_progress(cb->ctx, "file downloaded", 0, 0);
@@ -673,7 +704,7 @@ int zf_put(zf_callback_t *cb) {
 
     // looking for backend
     if(zf_backend_detect())
-        if(!(zf_backend_extract(cb->ctx)))
+        if(!(zf_backend_extract(cb)))
             return 1;
 
     // building directories
@@ -722,6 +753,12 @@ int zf_put(zf_callback_t *cb) {
         return 1;
     }
 
+    // wait for pending uploads
+    if(cb->ctx->backend && libflist_backend_flush(cb->ctx->backend)) {
+        zf_error(cb, "put", "%s", libflist_strerror());
+        return 1;
+    }
+
     // rename inode to target file
     libflist_inode_rename(inode, targetname);
 
@@ -730,11 +767,16 @@ int zf_put(zf_callback_t *cb) {
 
     // commit
     dirnode_t *parent = libflist_dirnode_get_parent(cb->ctx->db, dirnode);
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, parent);
 
     libflist_dirnode_free(parent);
     libflist_dirnode_free(dirnode);
 
+    if(value) {
+        zf_error(cb, "put", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -749,7 +791,7 @@ int zf_putdir(zf_callback_t *cb) {
 
     // looking for backend
     if(zf_backend_detect())
-        if(!(zf_backend_extract(cb->ctx)))
+        if(!(zf_backend_extract(cb)))
             return 1;
 
     // set custom progression report
@@ -780,6 +822,12 @@ int zf_putdir(zf_callback_t *cb) {
         return 1;
     }
 
+    // wait for pending uploads
+    if(cb->ctx->backend && libflist_backend_flush(cb->ctx->backend)) {
+        zf_error(cb, "putdir", "%s", libflist_strerror());
+        return 1;
+    }
+
     zf_stats_dump(cb);
     libflist_dirnode_free(dirnode);
 
@@ -789,7 +837,47 @@ int zf_putdir(zf_callback_t *cb) {
 //
 // merge
 //
+
+// seekable archive: the database is read in place, nothing is extracted,
+// returns NULL if the flist can't be read that way (gzip archive, ...)
+static flist_ctx_t *zf_merge_archive(char *filename) {
+    flist_db_t *database;
+
+    if(!(database = libflist_db_sqlite_init_archive(filename)))
+        return NULL;
+
+    if(!database->open(database)) {
+        debug("[-] action: merge: not a seekable archive: %s\n", libflist_strerror());
+        database->close(database);
+        return NULL;
+    }
+
+    debug("[+] action: merge: reading database from the archive\n");
+
+    return libflist_context_create(database, NULL);
+}
+
+static int zf_merge_apply(zf_callback_t *cb, flist_ctx_t *ctx) {
+    dirnode_t *merged;
+    int value = 0;
+
+    if(!(merged = libflist_merge(cb->ctx, ctx))) {
+        zf_error(cb, "merge", "error: %s", libflist_strerror());
+        return 1;
+    }
+
+    if(libflist_serial_dirnode_commit(merged, cb->ctx, merged)) {
+        zf_error(cb, "merge", "error: %s", libflist_strerror());
+        value = 1;
+    }
+
+    libflist_dirnode_free_recursive(merged);
+
+    return value;
+}
+
 int zf_merge(zf_callback_t *cb) {
+    flist_ctx_t *ctx;
     int value = 0;
 
     if(cb->argc < 2) {
@@ -797,14 +885,23 @@ int zf_merge(zf_callback_t *cb) {
         return 1;
     }
 
+    if((ctx = zf_merge_archive(cb->argv[1]))) {
+        value = zf_merge_apply(cb, ctx);
+        zf_internal_cleanup(ctx);
+
+        return value;
+    }
+
     // create temporary workspace for the merging flist
     char dname[2048];
 
     snprintf(dname, sizeof(dname), "%s/mergeXXXXXX", cb->settings->mnt);
     debug("[+] action: merge: creating temporary directory\n");
 
-    if(!mkdtemp(dname))
-        zf_diep(cb, "dname");
+    if(!mkdtemp(dname)) {
+        zf_warnp(cb, dname);
+        return 1;
+    }
 
     debug("[+] action: merge: temporary directory: %s\n", dname);
 
@@ -815,23 +912,15 @@ int zf_merge(zf_callback_t *cb) {
     }
 
     // merging the flist with the current database
-    flist_ctx_t *ctx = zf_internal_init(dname);
-
-    // do the merge
-    dirnode_t *merged;
-
-    if((merged = libflist_merge(cb->ctx, ctx))) {
-        libflist_serial_dirnode_commit(merged, cb->ctx, merged);
-        libflist_dirnode_free_recursive(merged);
+    if(!(ctx = zf_internal_init(dname, FLIST_DB_READONLY))) {
+        zf_error(cb, "merge", "could not open merging flist");
+        value = 1;
 
     } else {
-        zf_error(cb, "merge", "error: %s", libflist_strerror());
-        value = 1;
+        value = zf_merge_apply(cb, ctx);
+        zf_internal_cleanup(ctx);
     }
 
-    // cleanup target context
-    zf_internal_cleanup(ctx);
-
     // cleaning workspace
     if(zf_remove_database(cb, dname)) {
         zf_error(cb, "merge", "could not remove database file");
@@ -839,8 +928,10 @@ int zf_merge(zf_callback_t *cb) {
     }
 
     debug("[+] action: merge: removing temporary directory: %s\n", dname);
-    if(rmdir(dname) < 0)
-        zf_diep(cb, "dname");
+    if(rmdir(dname) < 0) {
+        zf_warnp(cb, dname);
+        return 1;
+    }
 
     return value;
 }
@@ -943,10 +1034,15 @@ int zf_debug(zf_callback_t *cb) {
     // dirnode->acl->mode = 040755;
     // libflist_acl_commit(dirnode->acl);
 
-    libflist_serial_dirnode_commit(dirnode, cb->ctx, dirnode);
+    int value = libflist_serial_dirnode_commit(dirnode, cb->ctx, dirnode);
 
     libflist_dirnode_free(dirnode);
 
+    if(value) {
+        zf_error(cb, "debug", "%s", libflist_strerror());
+        return 1;
+    }
+
     return 0;
 }
 
@@ -25,4 +25,6 @@
     int zf_prefetch(zf_callback_t *cb);
 
     int zf_hub(zf_callback_t *cb);
+    int zf_batch(zf_callback_t *cb);
+    int zf_serve(zf_callback_t *cb);
 #endif
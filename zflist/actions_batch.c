@@ -0,0 +1,274 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include <getopt.h>
+#include "libflist.h"
+#include "zflist.h"
+#include "tools.h"
+#include "actions.h"
+
+//
+// batch
+//
+// commands are read from a file (or stdin), one per line, and applied
+// on the same workspace: database is opened once (one transaction,
+// committed at the end) and backends are connected by the first
+// command which needs them
+//
+// a line is either a command with its arguments (like command line,
+// single or double quotes can be used), or a json array of strings,
+// empty lines and lines starting with '#' are ignored
+//
+// each command produces one json result line on stdout
+//
+#define ZF_BATCH_MAXARGS  256
+
+typedef struct zf_batch_line_t {
+    char *argv[ZF_BATCH_MAXARGS];
+    int argc;
+    json_t *json;     // json line, arguments points inside it
+
+} zf_batch_line_t;
+
+// split a text line into arguments (in place), returns 1 on error
+static int zf_batch_split(zf_batch_line_t *line, char *input) {
+    char *src = input, *dst = input;
+
+    while(1) {
+        char quote = 0;
+
+        while(isspace((unsigned char) *src))
+            src += 1;
+
+        if(*src == '\0')
+            return 0;
+
+        if(line->argc == ZF_BATCH_MAXARGS)
+            return 1;
+
+        line->argv[line->argc++] = dst;
+
+        while(*src && (quote || !isspace((unsigned char) *src))) {
+            if(!quote && (*src == '"' || *src == '\'')) {
+                quote = *src++;
+                continue;
+            }
+
+            if(quote && *src == quote) {
+                quote = 0;
+                src += 1;
+                continue;
+            }
+
+            // escaped character (not within single quotes)
+            if(*src == '\\' && quote != '\'' && src[1])
+                src += 1;
+
+            *dst++ = *src++;
+        }
+
+        if(quote)
+            return 1;
+
+        if(*src)
+            src += 1;
+
+        *dst++ = '\0';
+    }
+}
+
+// json array of strings, returns 1 on error
+static int zf_batch_parse_json(zf_batch_line_t *line, char *input) {
+    json_error_t error;
+
+    if(!(line->json = json_loads(input, 0, &error)))
+        return 1;
+
+    if(!json_is_array(line->json) || json_array_size(line->json) > ZF_BATCH_MAXARGS)
+        return 1;
+
+    for(size_t index = 0; index < json_array_size(line->json); index++) {
+        json_t *value = json_array_get(line->json, index);
+
+        if(!json_is_string(value))
+            return 1;
+
+        line->argv[line->argc++] = (char *) json_string_value(value);
+    }
+
+    return 0;
+}
+
+static json_t *zf_batch_result(size_t lineno, char *command, char *message) {
+    json_t *result = json_object();
+    json_t *error = json_object();
+
+    json_object_set_new(error, "function", json_string("batch"));
+    json_object_set_new(error, "message", json_string(message));
+
+    json_object_set_new(result, "line", json_integer(lineno));
+    json_object_set_new(result, "command", command ? json_string(command) : json_null());
+    json_object_set_new(result, "success", json_false());
+    json_object_set_new(result, "error", error);
+    json_object_set_new(result, "response", json_null());
+
+    return result;
+}
+
+static void zf_batch_dump(json_t *result) {
+    char *json;
+
+    if(!(json = json_dumps(result, 0))) {
+        fprintf(stderr, "zflist: json: could not dumps message\n");
+        return;
+    }
+
+    puts(json);
+    free(json);
+}
+
+// run one command, returns 0 on success
+static int zf_batch_command(zf_callback_t *parent, size_t lineno, zf_batch_line_t *line) {
+    zf_cmds_t *cmd;
+    int value;
+
+    zf_callback_t cb = {
+        .argc = line->argc,
+        .argv = line->argv,
+        .settings = parent->settings,
+        .ctx = parent->ctx,
+        .jout = NULL,
+        .userptr = NULL,
+        .progress = 0,
+    };
+
+    if(!(cmd = zf_command_get(line->argv[0]))) {
+        json_t *result = zf_batch_result(lineno, line->argv[0], "unknown action");
+        zf_batch_dump(result);
+        json_decref(result);
+        return 1;
+    }
+
+    // workspace lifecycle (and nested batches) can't be changed
+    // while the database is opened
+    if(!cmd->db) {
+        json_t *result = zf_batch_result(lineno, cmd->name, "action not available in batch mode");
+        zf_batch_dump(result);
+        json_decref(result);
+        return 1;
+    }
+
+    zf_internal_json_init(&cb);
+    json_object_set_new(cb.jout, "line", json_integer(lineno));
+    json_object_set_new(cb.jout, "command", json_string(cmd->name));
+
+    debug("[+] batch: line %lu: command: %s\n", lineno, cmd->name);
+
+    // options parser (getopt) state is kept between calls
+    optind = 0;
+    value = cmd->callback(&cb);
+
+    // backend is kept (see zf_backend_extract), not owned by this command
+    cb.ctx->backend = NULL;
+
+    if(value)
+        json_object_set(cb.jout, "success", json_false());
+
+    zf_internal_json_finalize(&cb);
+    json_decref(cb.jout);
+
+    return value;
+}
+
+int zf_batch(zf_callback_t *cb) {
+    FILE *input = stdin;
+    char *buffer = NULL;
+    size_t length = 0;
+    size_t lineno = 0, commands = 0, failed = 0;
+
+    if(cb->argc > 1 && strcmp(cb->argv[1], "-") != 0) {
+        if(!(input = fopen(cb->argv[1], "r"))) {
+            zf_warnp(cb, cb->argv[1]);
+            return 1;
+        }
+    }
+
+    if(!(cb->ctx = zf_internal_init(cb->settings->mnt, zf_internal_db_profile()))) {
+        zf_error(cb, "batch", "could not initialize workspace");
+
+        if(input != stdin)
+            fclose(input);
+
+        return 1;
+    }
+
+    cb->settings->batch = 1;
+
+    while(getline(&buffer, &length, input) >= 0) {
+        zf_batch_line_t line = {.argc = 0, .json = NULL};
+        char *text = buffer;
+        int error;
+
+        lineno += 1;
+
+        while(isspace((unsigned char) *text))
+            text += 1;
+
+        if(*text == '\0' || *text == '#')
+            continue;
+
+        if(*text == '[')
+            error = zf_batch_parse_json(&line, text);
+        else
+            error = zf_batch_split(&line, text);
+
+        commands += 1;
+
+        if(error || line.argc == 0) {
+            json_t *result = zf_batch_result(lineno, NULL, "could not parse command line");
+            zf_batch_dump(result);
+            json_decref(result);
+            failed += 1;
+
+        } else if(zf_batch_command(cb, lineno, &line)) {
+            failed += 1;
+        }
+
+        if(line.json)
+            json_decref(line.json);
+
+        fflush(stdout);
+    }
+
+    if(input != stdin)
+        fclose(input);
+
+    free(buffer);
+
+    // flush pending uploads, persistent data and commit the database
+    int saved = zf_internal_batch_cleanup(cb->ctx, cb->settings);
+
+    cb->settings->batch = 0;
+    cb->ctx = NULL;
+
+    if(saved)
+        zf_error(cb, "batch", "could not save changes: %s", libflist_strerror());
+
+    debug("[+] batch: %lu commands, %lu failed\n", commands, failed);
+
+    if(cb->jout) {
+        json_t *response = json_object_get(cb->jout, "response");
+        json_object_set_new(response, "commands", json_integer(commands));
+        json_object_set_new(response, "failed", json_integer(failed));
+
+        if(failed)
+            json_object_set(cb->jout, "success", json_false());
+    }
+
+    return (failed || saved) ? 1 : 0;
+}
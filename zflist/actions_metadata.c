@@ -548,17 +548,26 @@ static char *zf_metadata_import_readme(zf_callback_t *cb, char *filename) {
     int fd;
     char *buffer;
 
-    if((fd = open(filename, O_RDONLY)) < 0)
-        zf_diep(cb, filename);
+    if((fd = open(filename, O_RDONLY)) < 0) {
+        zf_warnp(cb, filename);
+        return NULL;
+    }
 
     off_t size = lseek(fd, 0, SEEK_END);
     lseek(fd, 0, SEEK_SET);
 
-    if(!(buffer = malloc(sizeof(char) * size)))
-        zf_diep(cb, "malloc");
+    if(size < 0 || !(buffer = calloc(sizeof(char), size + 1))) {
+        zf_warnp(cb, filename);
+        close(fd);
+        return NULL;
+    }
 
-    if(read(fd, buffer, size) != size)
-        zf_diep(cb, "read");
+    if(read(fd, buffer, size) != size) {
+        zf_warnp(cb, filename);
+        free(buffer);
+        close(fd);
+        return NULL;
+    }
 
     close(fd);
 
@@ -622,7 +631,11 @@ int zf_metadata_set_readme(zf_callback_t *cb) {
     if(import) {
         debug("[+] action: metadata: importing readme from: %s\n", import);
 
-        newvalue = zf_metadata_import_readme(cb, import);
+        if(!(newvalue = zf_metadata_import_readme(cb, import))) {
+            json_decref(root);
+            return 1;
+        }
+
         json_object_set_new(root, "readme", json_string(newvalue));
         free(newvalue);
     }
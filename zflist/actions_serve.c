@@ -0,0 +1,598 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "libflist.h"
+#include "zflist.h"
+#include "tools.h"
+#include "actions.h"
+
+//
+// serve
+//
+// daemon listening on a unix socket, each request is one json line:
+//   {"workspace": "/tmp/ws", "command": ["put", "/tmp/file", "/"], "id": ...}
+//
+// and each response is one json line, same format as the command line
+// json output (with 'command' and 'id' fields added)
+//
+// workspaces are kept opened between requests (database transaction
+// and backends connections), requests on the same workspace are
+// serialized, different workspaces are handled in parallel by the
+// workers (one client connection per worker at a time), a client
+// idle for ZFLIST_SERVE_IDLE seconds is disconnected to free its worker
+//
+// workspace is released (changes committed) before any action which
+// works on the files directly (open, init, commit, close) and when the
+// daemon stops (SIGINT or SIGTERM)
+//
+#define ZF_SERVE_MAXARGS   256
+#define ZF_SERVE_WORKERS   8
+#define ZF_SERVE_IDLE      60
+
+typedef struct zf_serve_workspace_t {
+    char *path;                // mountpoint
+    zfe_settings_t settings;   // settings (and backends) of this workspace
+    flist_ctx_t *ctx;          // opened database, NULL if released
+    pthread_mutex_t lock;      // one request at a time
+
+    struct zf_serve_workspace_t *next;
+
+} zf_serve_workspace_t;
+
+struct zf_serve_t;
+
+typedef struct zf_serve_worker_t {
+    struct zf_serve_t *server;
+    pthread_t thread;
+    int client;                // client socket, -1 when waiting
+
+} zf_serve_worker_t;
+
+typedef struct zf_serve_t {
+    zfe_settings_t *settings;  // daemon settings (default workspace)
+    char *path;                // listening socket path
+    int fd;                    // listening socket
+    int stopping;
+
+    zf_serve_workspace_t *workspaces;
+    zf_serve_worker_t *workers;
+    size_t length;
+    long idle;                 // seconds before idle clients are dropped
+
+    pthread_mutex_t lock;      // workspaces list and clients
+    pthread_mutex_t options;   // options parser (getopt state is global)
+
+} zf_serve_t;
+
+// actions which can't be served (nested daemon or batch, not related
+// to a workspace, or writing on the daemon output: cat)
+static char *zf_serve_denied[] = {"serve", "batch", "hub", "prefetch", "cat"};
+
+// actions parsing options with getopt, which keeps its state in
+// process globals (optind, optarg): they run one at a time, across
+// all workspaces
+static char *zf_serve_options[] = {"metadata"};
+
+static size_t zf_serve_workers_count() {
+    long workers = ZF_SERVE_WORKERS;
+    char *envworkers;
+
+    if((envworkers = getenv("ZFLIST_SERVE_WORKERS")))
+        workers = strtol(envworkers, NULL, 10);
+
+    if(workers < 1)
+        workers = 1;
+
+    return workers;
+}
+
+// idle clients timeout, 0 keeps clients connected until they close
+static long zf_serve_idle() {
+    long idle = ZF_SERVE_IDLE;
+    char *envidle;
+
+    if((envidle = getenv("ZFLIST_SERVE_IDLE")))
+        idle = strtol(envidle, NULL, 10);
+
+    if(idle < 0)
+        idle = 0;
+
+    return idle;
+}
+
+//
+// workspaces
+//
+static zf_serve_workspace_t *zf_serve_workspace_get(zf_serve_t *server, const char *path) {
+    zf_serve_workspace_t *workspace;
+
+    pthread_mutex_lock(&server->lock);
+
+    for(workspace = server->workspaces; workspace; workspace = workspace->next)
+        if(strcmp(workspace->path, path) == 0)
+            break;
+
+    if(!workspace && (workspace = calloc(sizeof(zf_serve_workspace_t), 1))) {
+        workspace->path = strdup(path);
+        workspace->settings = *server->settings;
+        workspace->settings.mnt = workspace->path;
+        workspace->settings.batch = 1;
+        workspace->settings.upload = NULL;
+        workspace->settings.download = NULL;
+        workspace->settings.connections = 0;
+
+        pthread_mutex_init(&workspace->lock, NULL);
+
+        workspace->next = server->workspaces;
+        server->workspaces = workspace;
+
+        debug("[+] serve: new workspace: %s\n", path);
+    }
+
+    pthread_mutex_unlock(&server->lock);
+
+    return workspace;
+}
+
+// flush pending uploads and commit database changes
+// returns non-zero if workspace changes could not be saved
+static int zf_serve_workspace_release(zf_serve_workspace_t *workspace) {
+    if(!workspace->ctx)
+        return 0;
+
+    debug("[+] serve: releasing workspace: %s\n", workspace->path);
+
+    int value = zf_internal_batch_cleanup(workspace->ctx, &workspace->settings);
+    workspace->ctx = NULL;
+
+    if(value)
+        fprintf(stderr, "[-] serve: %s: could not save changes: %s\n", workspace->path, libflist_strerror());
+
+    return value;
+}
+
+static void zf_serve_workspaces_free(zf_serve_t *server) {
+    zf_serve_workspace_t *workspace = server->workspaces;
+
+    while(workspace) {
+        zf_serve_workspace_t *next = workspace->next;
+
+        zf_serve_workspace_release(workspace);
+        pthread_mutex_destroy(&workspace->lock);
+        free(workspace->path);
+        free(workspace);
+
+        workspace = next;
+    }
+
+    server->workspaces = NULL;
+}
+
+//
+// fatal errors
+//
+// libflist (diep, dies) and zflist (zf_diep, zf_dies) fatal errors
+// exit the process from the worker which hits them, the caller
+// doesn't expect them to return: before exiting, idle workspaces are
+// released (changes committed), only workspaces with a request in
+// progress (including the failing one) lose their pending changes
+//
+static zf_serve_t *zf_serve_running = NULL;
+
+static void zf_serve_fatal() {
+    zf_serve_t *server = zf_serve_running;
+
+    // clean shutdown, or already exiting
+    if(!server)
+        return;
+
+    zf_serve_running = NULL;
+
+    if(pthread_mutex_trylock(&server->lock) == 0) {
+        for(zf_serve_workspace_t *workspace = server->workspaces; workspace; workspace = workspace->next) {
+            if(pthread_mutex_trylock(&workspace->lock)) {
+                debug("[-] serve: workspace busy, not committed: %s\n", workspace->path);
+                continue;
+            }
+
+            zf_serve_workspace_release(workspace);
+        }
+    }
+
+    unlink(server->path);
+}
+
+//
+// requests
+//
+static int zf_serve_allowed(zf_cmds_t *cmd) {
+    for(size_t i = 0; i < sizeof(zf_serve_denied) / sizeof(char *); i++)
+        if(strcmp(zf_serve_denied[i], cmd->name) == 0)
+            return 0;
+
+    return 1;
+}
+
+static int zf_serve_parse_options(zf_cmds_t *cmd) {
+    for(size_t i = 0; i < sizeof(zf_serve_options) / sizeof(char *); i++)
+        if(strcmp(zf_serve_options[i], cmd->name) == 0)
+            return 1;
+
+    return 0;
+}
+
+// run one request on its workspace, response is always set
+static json_t *zf_serve_request(zf_serve_t *server, char *input) {
+    zf_serve_workspace_t *workspace;
+    char *argv[ZF_SERVE_MAXARGS];
+    json_t *request, *command;
+    json_error_t error;
+    const char *path;
+    char *resolved = NULL;
+    zf_cmds_t *cmd;
+
+    zf_callback_t cb = {
+        .argc = 0,
+        .argv = argv,
+        .settings = server->settings,
+        .ctx = NULL,
+        .jout = NULL,
+        .userptr = NULL,
+        .progress = 0,
+    };
+
+    zf_internal_json_init(&cb);
+
+    if(!(request = json_loads(input, 0, &error)) || !json_is_object(request)) {
+        zf_error(&cb, "serve", "could not parse request");
+        goto cleanup;
+    }
+
+    if(json_object_get(request, "id"))
+        json_object_set(cb.jout, "id", json_object_get(request, "id"));
+
+    command = json_object_get(request, "command");
+
+    if(!json_is_array(command) || json_array_size(command) == 0 || json_array_size(command) > ZF_SERVE_MAXARGS) {
+        zf_error(&cb, "serve", "missing or invalid command");
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < json_array_size(command); i++) {
+        json_t *value = json_array_get(command, i);
+
+        if(!json_is_string(value)) {
+            zf_error(&cb, "serve", "invalid command argument");
+            goto cleanup;
+        }
+
+        argv[cb.argc++] = (char *) json_string_value(value);
+    }
+
+    json_object_set_new(cb.jout, "command", json_string(argv[0]));
+
+    if(!(cmd = zf_command_get(argv[0]))) {
+        zf_error(&cb, "serve", "unknown action");
+        goto cleanup;
+    }
+
+    if(!zf_serve_allowed(cmd)) {
+        zf_error(&cb, "serve", "action not available in daemon mode");
+        goto cleanup;
+    }
+
+    path = json_string_value(json_object_get(request, "workspace"));
+
+    if(!path && !(path = server->settings->mnt)) {
+        zf_error(&cb, "serve", "missing workspace");
+        goto cleanup;
+    }
+
+    // the same workspace can be reached by different paths (trailing
+    // slash, relative path, symlink), it would be opened twice
+    if(!(resolved = realpath(path, NULL))) {
+        zf_error(&cb, "serve", "workspace: %s: %s", path, strerror(errno));
+        goto cleanup;
+    }
+
+    if(!(workspace = zf_serve_workspace_get(server, resolved))) {
+        zf_error(&cb, "serve", "could not allocate workspace");
+        goto cleanup;
+    }
+
+    pthread_mutex_lock(&workspace->lock);
+
+    cb.settings = &workspace->settings;
+
+    if(cmd->db) {
+        if(!workspace->ctx && !(workspace->ctx = zf_internal_init(workspace->path, zf_internal_db_profile()))) {
+            zf_error(&cb, "serve", "could not initialize workspace");
+            pthread_mutex_unlock(&workspace->lock);
+            goto cleanup;
+        }
+
+        cb.ctx = workspace->ctx;
+
+    } else if(zf_serve_workspace_release(workspace)) {
+        // action works on the workspace files, they
+        // can't be used if changes were not saved
+        zf_error(&cb, "serve", "could not save changes: %s", libflist_strerror());
+        pthread_mutex_unlock(&workspace->lock);
+        goto cleanup;
+    }
+
+    debug("[+] serve: %s: command: %s\n", workspace->path, cmd->name);
+
+    int options = zf_serve_parse_options(cmd);
+
+    if(options) {
+        pthread_mutex_lock(&server->options);
+        optind = 0;
+    }
+
+    if(cmd->callback(&cb))
+        json_object_set(cb.jout, "success", json_false());
+
+    if(options)
+        pthread_mutex_unlock(&server->options);
+
+    // backend is kept (see zf_backend_extract), not owned by this command
+    if(cb.ctx)
+        cb.ctx->backend = NULL;
+
+    pthread_mutex_unlock(&workspace->lock);
+
+cleanup:
+    if(request)
+        json_decref(request);
+
+    free(resolved);
+
+    return cb.jout;
+}
+
+static int zf_serve_send(int fd, json_t *response) {
+    char *json;
+    size_t length, sent = 0;
+
+    if(!(json = json_dumps(response, 0)))
+        return 1;
+
+    length = strlen(json);
+    json[length++] = '\n';  // replacing null terminator, not needed anymore
+
+    while(sent < length) {
+        ssize_t value = send(fd, json + sent, length - sent, MSG_NOSIGNAL);
+
+        if(value < 0 && errno == EINTR)
+            continue;
+
+        if(value < 0) {
+            free(json);
+            return 1;
+        }
+
+        sent += value;
+    }
+
+    free(json);
+
+    return 0;
+}
+
+//
+// workers
+//
+static void zf_serve_client(zf_serve_t *server, int fd) {
+    char *buffer = NULL;
+    size_t length = 0;
+    FILE *input;
+
+    // waiting for the next request is limited, a read timeout ends
+    // the connection (getline fails) and the worker accepts a new client
+    if(server->idle) {
+        struct timeval timeout = {.tv_sec = server->idle, .tv_usec = 0};
+
+        if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+            perror("serve: setsockopt");
+    }
+
+    if(!(input = fdopen(fd, "r"))) {
+        close(fd);
+        return;
+    }
+
+    while(getline(&buffer, &length, input) >= 0) {
+        json_t *response;
+
+        // empty line (keep-alive)
+        if(buffer[0] == '\n')
+            continue;
+
+        response = zf_serve_request(server, buffer);
+
+        int failed = zf_serve_send(fd, response);
+        json_decref(response);
+
+        if(failed)
+            break;
+    }
+
+    if(ferror(input) && (errno == EAGAIN || errno == EWOULDBLOCK))
+        debug("[+] serve: client idle, disconnecting\n");
+
+    free(buffer);
+    fclose(input);
+}
+
+static void *zf_serve_worker(void *userptr) {
+    zf_serve_worker_t *worker = (zf_serve_worker_t *) userptr;
+    zf_serve_t *server = worker->server;
+
+    while(1) {
+        int client = accept(server->fd, NULL, NULL);
+
+        pthread_mutex_lock(&server->lock);
+
+        if(server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+
+            if(client >= 0)
+                close(client);
+
+            break;
+        }
+
+        worker->client = client;
+        pthread_mutex_unlock(&server->lock);
+
+        if(client < 0) {
+            if(errno != EINTR && errno != ECONNABORTED)
+                perror("serve: accept");
+
+            continue;
+        }
+
+        debug("[+] serve: client connected\n");
+        zf_serve_client(server, client);
+
+        pthread_mutex_lock(&server->lock);
+        worker->client = -1;
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    return NULL;
+}
+
+static int zf_serve_listen(zf_callback_t *cb, char *socketpath) {
+    struct sockaddr_un address;
+    int fd;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(strlen(socketpath) >= sizeof(address.sun_path)) {
+        zf_error(cb, "serve", "socket path too long");
+        return -1;
+    }
+
+    strcpy(address.sun_path, socketpath);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        zf_warnp(cb, "socket");
+        return -1;
+    }
+
+    // stale socket of a previous daemon
+    unlink(socketpath);
+
+    if(bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(fd, 64) < 0) {
+        zf_warnp(cb, socketpath);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int zf_serve(zf_callback_t *cb) {
+    zf_serve_t server;
+    sigset_t signals;
+    size_t started = 0;
+    int signum;
+
+    if(cb->argc < 2) {
+        zf_error(cb, "serve", "missing socket path");
+        return 1;
+    }
+
+    memset(&server, 0, sizeof(zf_serve_t));
+    server.settings = cb->settings;
+    server.path = cb->argv[1];
+    server.length = zf_serve_workers_count();
+    server.idle = zf_serve_idle();
+
+    if((server.fd = zf_serve_listen(cb, cb->argv[1])) < 0)
+        return 1;
+
+    if(!(server.workers = calloc(sizeof(zf_serve_worker_t), server.length))) {
+        zf_warnp(cb, "serve: calloc");
+        close(server.fd);
+        return 1;
+    }
+
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_mutex_init(&server.options, NULL);
+
+    // stop signals are only handled by this thread (workers inherit the mask)
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    for(; started < server.length; started++) {
+        server.workers[started].server = &server;
+        server.workers[started].client = -1;
+
+        if(pthread_create(&server.workers[started].thread, NULL, zf_serve_worker, &server.workers[started]))
+            break;
+    }
+
+    if(started == 0) {
+        zf_error(cb, "serve", "could not start any worker");
+        close(server.fd);
+        unlink(cb->argv[1]);
+        free(server.workers);
+        return 1;
+    }
+
+    // serve is only called once per process
+    zf_serve_running = &server;
+    atexit(zf_serve_fatal);
+
+    debug("[+] serve: listening on %s, %lu workers\n", cb->argv[1], started);
+
+    sigwait(&signals, &signum);
+
+    debug("[+] serve: signal %d received, stopping\n", signum);
+
+    // waking up workers: waiting ones (accept) and connected ones (read)
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+
+    shutdown(server.fd, SHUT_RDWR);
+
+    for(size_t i = 0; i < started; i++)
+        if(server.workers[i].client >= 0)
+            shutdown(server.workers[i].client, SHUT_RD);
+
+    pthread_mutex_unlock(&server.lock);
+
+    for(size_t i = 0; i < started; i++)
+        pthread_join(server.workers[i].thread, NULL);
+
+    // committing all the workspaces still opened
+    zf_serve_running = NULL;
+    zf_serve_workspaces_free(&server);
+
+    close(server.fd);
+    unlink(cb->argv[1]);
+
+    pthread_mutex_destroy(&server.options);
+    pthread_mutex_destroy(&server.lock);
+    free(server.workers);
+
+    return 0;
+}
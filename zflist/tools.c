@@ -17,21 +17,256 @@ void __cleanup_free(void *p) {
     free(* (void **) p);
 }
 
-flist_ctx_t *zf_internal_init(char *mountpoint) {
+// use all the available cores to process chunks (and compress
+// archives) by default, this can be overridden by environment variable
+size_t zf_internal_workers_count() {
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    char *envworkers;
+
+    if((envworkers = getenv("ZFLIST_WORKERS")))
+        workers = strtol(envworkers, NULL, 10);
+
+    if(workers < 1)
+        workers = 1;
+
+    return workers;
+}
+
+// flist are gzip archives by default, a seekable zstd archive can
+// be requested by environment variable (newer readers only)
+flist_archive_format_t zf_internal_archive_format() {
+    char *envarchive;
+
+    if(!(envarchive = getenv("ZFLIST_ARCHIVE")))
+        return FLIST_ARCHIVE_GZIP;
+
+    if(strcmp(envarchive, "zstd") == 0) {
+        debug("[+] system: using seekable zstd archive\n");
+        return FLIST_ARCHIVE_ZSTD;
+    }
+
+    if(strcmp(envarchive, "gzip") != 0)
+        fprintf(stderr, "[-] unknown archive format '%s', using gzip\n", envarchive);
+
+    return FLIST_ARCHIVE_GZIP;
+}
+
+static void zf_internal_workers(flist_ctx_t *ctx) {
+    size_t workers = zf_internal_workers_count();
+
+    debug("[+] system: using %lu workers\n", workers);
+    libflist_context_set_workers(ctx, workers);
+}
+
+// chunks are downloaded in parallel, network latency is the
+// main bottleneck, this is not related to the amount of cores
+static void zf_internal_downloads(flist_ctx_t *ctx) {
+    long downloads = 8;
+    char *envdownloads;
+
+    if((envdownloads = getenv("ZFLIST_DOWNLOADS")))
+        downloads = strtol(envdownloads, NULL, 10);
+
+    if(downloads < 1)
+        downloads = 1;
+
+    debug("[+] system: using %ld parallel downloads\n", downloads);
+    libflist_context_set_downloads(ctx, downloads);
+}
+
+// content-defined chunking can be enabled by environment variable
+// this improves deduplication of files slightly modified
+static void zf_internal_chunking(flist_ctx_t *ctx) {
+    char *envchunking;
+
+    if(!(envchunking = getenv("ZFLIST_CHUNKING")))
+        return;
+
+    if(strcmp(envchunking, "cdc") == 0) {
+        debug("[+] system: using content-defined chunking\n");
+        libflist_context_set_chunking(ctx, FLIST_CHUNKING_CDC, 0, 0, 0);
+    }
+}
+
+// files can be mapped in memory to be chunked, instead of being read
+// into workers buffers (files must not be truncated while being added)
+static void zf_internal_reader(flist_ctx_t *ctx) {
+    char *envreader;
+
+    if(!(envreader = getenv("ZFLIST_READER")))
+        return;
+
+    if(strcmp(envreader, "mmap") == 0) {
+        debug("[+] system: mapping files to chunk them\n");
+        libflist_context_set_reader(ctx, FLIST_READER_MMAP);
+    }
+}
+
+// plaintext to encrypted chunk mapping can be remembered between
+// runs, unchanged chunks are then only hashed, not encrypted again
+static void zf_internal_memo(flist_ctx_t *ctx) {
+    char *envmemo;
+
+    if(!(envmemo = getenv("ZFLIST_CHUNKS_MEMO")))
+        return;
+
+    debug("[+] system: using chunks memo: %s\n", envmemo);
+
+    if(!libflist_context_set_chunks_memo(ctx, envmemo))
+        fprintf(stderr, "[-] init: chunks memo: %s\n", libflist_strerror());
+}
+
+// files already on the flist can be skipped when adding a directory
+// again, if they didn't change (same size and modification time)
+static void zf_internal_incremental(flist_ctx_t *ctx) {
+    char *envincremental;
+
+    if(!(envincremental = getenv("ZFLIST_INCREMENTAL")))
+        return;
+
+    if(strcmp(envincremental, "strict") == 0) {
+        debug("[+] system: incremental mode enabled (strict)\n");
+        libflist_context_set_incremental(ctx, FLIST_INCREMENTAL_STRICT);
+        return;
+    }
+
+    debug("[+] system: incremental mode enabled\n");
+    libflist_context_set_incremental(ctx, FLIST_INCREMENTAL_MTIME);
+}
+
+// new chunks encoding, default (snappy and xxtea) is readable by
+// any reader, other codecs needs an up-to-date reader, an unknown
+// codec is an error (chunks would be encoded with the wrong codec)
+static int zf_internal_codec(flist_ctx_t *ctx) {
+    flist_compression_t compression = FLIST_COMPRESSION_SNAPPY;
+    flist_encryption_t encryption = FLIST_ENCRYPTION_XXTEA;
+    char *envcompression, *envencryption;
+    int level = 0;
+
+    envcompression = getenv("ZFLIST_COMPRESSION");
+    envencryption = getenv("ZFLIST_ENCRYPTION");
+
+    if(!envcompression && !envencryption)
+        return 0;
+
+    if(envcompression) {
+        if(strcmp(envcompression, "store") == 0) {
+            compression = FLIST_COMPRESSION_STORE;
+
+        } else if(strcmp(envcompression, "lz4") == 0) {
+            compression = FLIST_COMPRESSION_LZ4;
+
+        } else if(strcmp(envcompression, "zstd") == 0) {
+            compression = FLIST_COMPRESSION_ZSTD;
+
+        } else if(strncmp(envcompression, "zstd:", 5) == 0) {
+            // zstd:level, the whole level needs to be a number
+            char *end = NULL;
+
+            compression = FLIST_COMPRESSION_ZSTD;
+            level = strtol(envcompression + 5, &end, 10);
+
+            if(end == envcompression + 5 || *end != '\0') {
+                fprintf(stderr, "[-] invalid compression level '%s'\n", envcompression);
+                return 1;
+            }
+
+        } else if(strcmp(envcompression, "snappy") != 0) {
+            fprintf(stderr, "[-] unknown compression '%s'\n", envcompression);
+            return 1;
+        }
+    }
+
+    if(envencryption) {
+        if(strcmp(envencryption, "none") == 0) {
+            encryption = FLIST_ENCRYPTION_NONE;
+
+        } else if(strcmp(envencryption, "xxtea") != 0) {
+            fprintf(stderr, "[-] unknown encryption '%s'\n", envencryption);
+            return 1;
+        }
+    }
+
+    debug("[+] system: chunks codec: %s (level %d), encryption: %s\n",
+          envcompression ? envcompression : "snappy", level,
+          encryption == FLIST_ENCRYPTION_NONE ? "none" : "xxtea");
+
+    libflist_context_set_codec(ctx, compression, level, encryption);
+
+    return 0;
+}
+
+// workspace database profile, commands changing the database use the
+// default sqlite settings, unless specified by environment variable
+flist_db_profile_t zf_internal_db_profile() {
+    char *envdatabase;
+
+    if(!(envdatabase = getenv("ZFLIST_DATABASE")))
+        return FLIST_DB_DEFAULT;
+
+    if(strcmp(envdatabase, "build") == 0)
+        return FLIST_DB_BUILD;
+
+    if(strcmp(envdatabase, "memory") == 0)
+        return FLIST_DB_MEMORY;
+
+    if(strcmp(envdatabase, "default") != 0)
+        fprintf(stderr, "[-] unknown database profile '%s', using default\n", envdatabase);
+
+    return FLIST_DB_DEFAULT;
+}
+
+flist_ctx_t *zf_internal_init(char *mountpoint, flist_db_profile_t profile) {
     flist_ctx_t *ctx;
-    flist_db_t *database = libflist_db_sqlite_init(mountpoint);
+    flist_db_t *database = libflist_db_sqlite_init_profile(mountpoint, profile);
 
     debug("[+] database: opening the flist database\n");
 
     ctx = libflist_context_create(database, NULL);
     ctx->db->open(ctx->db);
 
+    zf_internal_workers(ctx);
+    zf_internal_downloads(ctx);
+    zf_internal_chunking(ctx);
+    zf_internal_reader(ctx);
+    zf_internal_memo(ctx);
+    zf_internal_incremental(ctx);
+
+    if(zf_internal_codec(ctx)) {
+        zf_internal_cleanup(ctx);
+        return NULL;
+    }
+
     return ctx;
 }
 
-void zf_internal_cleanup(flist_ctx_t *ctx) {
-    ctx->db->close(ctx->db);
+// returns non-zero if database changes could not be saved
+int zf_internal_cleanup(flist_ctx_t *ctx) {
+    // flush pending uploads and persistent data
+    if(ctx->backend)
+        libflist_backend_free(ctx->backend);
+
+    int value = ctx->db->close(ctx->db);
     libflist_context_free(ctx);
+
+    return value;
+}
+
+// batch mode: backends were kept between commands, releasing
+// them with the workspace (pending uploads flushed, database
+// changes committed)
+int zf_internal_batch_cleanup(flist_ctx_t *ctx, zfe_settings_t *settings) {
+    if(settings->download)
+        libflist_backend_free(settings->download);
+
+    ctx->backend = settings->upload;
+    int value = zf_internal_cleanup(ctx);
+
+    settings->upload = NULL;
+    settings->download = NULL;
+    settings->connections = 0;
+
+    return value;
 }
 
 void zf_internal_json_init(zf_callback_t *cb) {
@@ -244,9 +479,39 @@ int zf_backend_detect() {
     return 1;
 }
 
-flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx) {
+// downloaded chunks can be kept on a local disk cache, shared between
+// runs, this is only set by the local user (never from flist metadata)
+static flist_db_t *zf_backend_cached(flist_db_t *backdb) {
+    char *envcache, *envsize;
+    size_t maxsize = 0;
+    flist_db_t *cached;
+
+    if(!(envcache = getenv("ZFLIST_CACHE")))
+        return backdb;
+
+    if((envsize = getenv("ZFLIST_CACHE_SIZE")))
+        maxsize = strtoull(envsize, NULL, 10);
+
+    debug("[+] backend: local cache: %s\n", envcache);
+
+    if(!(cached = libflist_db_cache_init(backdb, envcache, maxsize))) {
+        backdb->close(backdb);
+        return NULL;
+    }
+
+    return cached;
+}
+
+flist_ctx_t *zf_backend_extract(zf_callback_t *cb) {
+    flist_ctx_t *ctx = cb->ctx;
     flist_db_t *backdb = NULL;
-    char *envbackend;
+    char *envbackend, *envknown, *envskip;
+
+    // batch mode, already connected by a previous command
+    if(cb->settings->upload) {
+        ctx->backend = cb->settings->upload;
+        return ctx;
+    }
 
     debug("[+] backend: detecting backend settings\n");
 
@@ -258,26 +523,79 @@ flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx) {
         return NULL;
     }
 
+    if(!(backdb = zf_backend_cached(backdb))) {
+        fprintf(stderr, "[-] init: backend: cache: %s\n", libflist_strerror());
+        return NULL;
+    }
+
     // updating context
     ctx->backend = libflist_backend_init(backdb, "/");
 
+    // zero-db only: upload without checking existence first
+    if((envskip = getenv("ZFLIST_SKIP_EXISTS")) && strcmp(envskip, "1") == 0)
+        libflist_backend_skip_exists(ctx->backend, 1);
+
+    // keep track of chunks already on the backend between runs
+    if((envknown = getenv("ZFLIST_KNOWN_CHUNKS"))) {
+        flist_known_policy_t policy = FLIST_KNOWN_TRUST;
+        char *envpolicy = getenv("ZFLIST_KNOWN_POLICY");
+        char *identity;
+
+        if(envpolicy && strcmp(envpolicy, "verify") == 0)
+            policy = FLIST_KNOWN_VERIFY;
+
+        if(!(identity = libflist_metadata_backend_identity(envbackend)))
+            return NULL;
+
+        if(!libflist_backend_known_chunks(ctx->backend, envknown, identity, policy))
+            fprintf(stderr, "[-] init: known chunks: %s\n", libflist_strerror());
+
+        free(identity);
+    }
+
+    if(cb->settings->batch)
+        cb->settings->upload = ctx->backend;
+
     debug("[+] backend: connected and attached to context\n");
 
     return ctx;
 }
 
-flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx) {
+// only commands fetching chunks need one connection per parallel
+// download ('ctx->downloads'), others should request one connection
+flist_ctx_t *zf_public_backend_extract(zf_callback_t *cb, size_t connections) {
+    flist_ctx_t *ctx = cb->ctx;
     flist_db_t *backdb = NULL;
 
-    debug("[+] backend: detecting public backend settings\n");
+    // batch mode, already connected by a previous command
+    if(cb->settings->download) {
+        if(cb->settings->connections >= connections) {
+            ctx->backend = cb->settings->download;
+            return ctx;
+        }
+
+        // not enough connections for this command, reconnecting
+        libflist_backend_free(cb->settings->download);
+        cb->settings->download = NULL;
+    }
 
-    if(!(backdb = libflist_metadata_backend_database(ctx->db)))
+    debug("[+] backend: detecting public backend settings (%lu connections)\n", connections);
+
+    if(!(backdb = libflist_metadata_backend_database_pool(ctx->db, connections)))
+        return NULL;
+
+    if(!(backdb = zf_backend_cached(backdb)))
         return NULL;
 
     // updating context
     if(!(ctx->backend = libflist_backend_init(backdb, "/")))
         return NULL;
 
+    if(cb->settings->batch) {
+        cb->settings->download = ctx->backend;
+        cb->settings->connections = connections;
+    }
+
     debug("[+] backend: public connected and attached to context\n");
 
     return ctx;
@@ -287,20 +605,59 @@ flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx) {
 //
 // integrity checker
 //
-int zf_integrity_check(zf_callback_t *cb, inode_t *inode) {
-    for(size_t i = 0; i < inode->chunks->size; i++) {
-        inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
+// all chunks of all the files of a directory are checked in one
+// batch, returns the amount of files with missing chunks
+static size_t zf_integrity_check_dirnode(zf_callback_t *cb, dirnode_t *dirnode) {
+    inode_chunks_t all = {.size = 0};
+    size_t failures = 0, offset = 0;
+    int *exists;
+
+    for(inode_t *inode = dirnode->inode_list; inode; inode = inode->next)
+        if(inode->type == INODE_FILE && inode->chunks)
+            all.size += inode->chunks->size;
+
+    if(all.size == 0)
+        return 0;
 
-        if(!libflist_backend_exists(cb->ctx->backend, chunk)) {
-            libflist_chunk_free(chunk);
-            return 0;
+    all.list = malloc(sizeof(inode_chunk_t) * all.size);
+    exists = malloc(sizeof(int) * all.size);
+
+    if(!all.list || !exists)
+        zf_diep(cb, "integrity: malloc");
+
+    // chunks are only referenced, not copied
+    for(inode_t *inode = dirnode->inode_list; inode; inode = inode->next) {
+        if(inode->type != INODE_FILE || !inode->chunks)
+            continue;
+
+        memcpy(&all.list[offset], inode->chunks->list, sizeof(inode_chunk_t) * inode->chunks->size);
+        offset += inode->chunks->size;
+    }
+
+    // nothing can be confirmed
+    if(libflist_backend_chunks_exists(cb->ctx->backend, &all, exists) < 0)
+        memset(exists, 0, sizeof(int) * all.size);
+
+    offset = 0;
+
+    for(inode_t *inode = dirnode->inode_list; inode; inode = inode->next) {
+        if(inode->type != INODE_FILE || !inode->chunks)
+            continue;
+
+        for(size_t i = 0; i < inode->chunks->size; i++) {
+            if(!exists[offset + i]) {
+                failures += 1;
+                break;
+            }
         }
 
-        libflist_chunk_free(chunk);
+        offset += inode->chunks->size;
     }
 
-    return 1;
+    free(all.list);
+    free(exists);
+
+    return failures;
 }
 
 //
@@ -330,9 +687,6 @@ static int zf_find_recursive_text(zf_callback_t *cb, dirnode_t *dirnode, int int
         if(inode->type == INODE_FILE) {
             libflist_stats_regular_add(cb->ctx, 1);
             libflist_stats_size_add(cb->ctx, inode->size);
-
-            if(integrity && !zf_integrity_check(cb, inode))
-                libflist_stats_failure_add(cb->ctx, 1);
         }
 
         if(inode->type == INODE_SPECIAL)
@@ -342,6 +696,9 @@ static int zf_find_recursive_text(zf_callback_t *cb, dirnode_t *dirnode, int int
             libflist_stats_symlink_add(cb->ctx, 1);
     }
 
+    if(integrity)
+        libflist_stats_failure_add(cb->ctx, zf_integrity_check_dirnode(cb, dirnode));
+
     return 0;
 }
 
@@ -378,9 +735,6 @@ static int zf_find_recursive_json(zf_callback_t *cb, dirnode_t *dirnode, int int
         if(inode->type == INODE_FILE) {
             libflist_stats_regular_add(cb->ctx, 1);
             libflist_stats_size_add(cb->ctx, inode->size);
-
-            if(integrity && !zf_integrity_check(cb, inode))
-                libflist_stats_failure_add(cb->ctx, 1);
         }
 
         if(inode->type == INODE_SPECIAL)
@@ -390,6 +744,9 @@ static int zf_find_recursive_json(zf_callback_t *cb, dirnode_t *dirnode, int int
             libflist_stats_symlink_add(cb->ctx, 1);
     }
 
+    if(integrity)
+        libflist_stats_failure_add(cb->ctx, zf_integrity_check_dirnode(cb, dirnode));
+
     return 0;
 }
 
@@ -4,15 +4,19 @@
     // automatic cleanup
     void __cleanup_free(void *p);
 
-    flist_ctx_t *zf_internal_init(char *mountpoint);
-    void zf_internal_cleanup(flist_ctx_t *ctx);
+    flist_ctx_t *zf_internal_init(char *mountpoint, flist_db_profile_t profile);
+    flist_db_profile_t zf_internal_db_profile();
+    int zf_internal_cleanup(flist_ctx_t *ctx);
+    int zf_internal_batch_cleanup(flist_ctx_t *ctx, zfe_settings_t *settings);
+    size_t zf_internal_workers_count();
+    flist_archive_format_t zf_internal_archive_format();
 
     void zf_internal_json_init(zf_callback_t *cb);
     void zf_internal_json_finalize(zf_callback_t *cb);
 
     int zf_backend_detect();
-    flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx);
-    flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx);
+    flist_ctx_t *zf_backend_extract(zf_callback_t *cb);
+    flist_ctx_t *zf_public_backend_extract(zf_callback_t *cb, size_t connections);
 
     int zf_open_file(zf_callback_t *cb, char *filename, char *endpoint);
     int zf_remove_database(zf_callback_t *cb, char *mountpoint);
@@ -16,30 +16,40 @@ zfe_settings_t settings;
 // commands list
 //
 zf_cmds_t zf_commands[] = {
-    {.name = "open",     .db = 0, .callback = zf_open,     .help = "open an flist to enable editing"},
-    {.name = "init",     .db = 0, .callback = zf_init,     .help = "initialize an empty flist to enable editing"},
-    {.name = "ls",       .db = 1, .callback = zf_ls,       .help = "list the content of a directory"},
-    {.name = "find",     .db = 1, .callback = zf_find,     .help = "list full contents of files and directories"},
-    {.name = "stat",     .db = 1, .callback = zf_stat,     .help = "dump inode full metadata"},
-    {.name = "cat",      .db = 1, .callback = zf_cat,      .help = "print file contents (backend metadata required)"},
-    {.name = "get",      .db = 1, .callback = zf_get,      .help = "download remote file (backend metadata required)"},
-    {.name = "put",      .db = 1, .callback = zf_put,      .help = "insert local file into the flist"},
-    {.name = "putdir",   .db = 1, .callback = zf_putdir,   .help = "insert local directory into the flist (recursively)"},
-    {.name = "chmod",    .db = 1, .callback = zf_chmod,    .help = "change mode of a file (like chmod command)"},
-    {.name = "rm",       .db = 1, .callback = zf_rm,       .help = "remove a file (not a directory)"},
-    {.name = "rmdir",    .db = 1, .callback = zf_rmdir,    .help = "remove a directory (recursively)"},
-    {.name = "mkdir",    .db = 1, .callback = zf_mkdir,    .help = "create an empty directory (non-recursive)"},
-    {.name = "metadata", .db = 1, .callback = zf_metadata, .help = "get or set metadata"},
-    {.name = "merge",    .db = 1, .callback = zf_merge,    .help = "merge another flist into the current one"},
-    {.name = "check",    .db = 1, .callback = zf_check,    .help = "check archive integrity (chunks valid in the backed)"},
-    {.name = "chunks",   .db = 1, .callback = zf_chunks,   .help = "dumps chunks for all files"},
-    {.name = "debug",    .db = 1, .callback = zf_debug,    .help = "provide and apply some debug features"},
-    {.name = "prefetch", .db = 0, .callback = zf_prefetch, .help = "read directory contents to fill flist cache"},
-    {.name = "hub",      .db = 0, .callback = zf_hub,      .help = "0-hub command line tools"},
-    {.name = "commit",   .db = 0, .callback = zf_commit,   .help = "commit changes to a new flist"},
-    {.name = "close",    .db = 0, .callback = zf_close,    .help = "close mountpoint and discard files"},
+    {.name = "open",     .db = 0, .readonly = 0, .callback = zf_open,     .help = "open an flist to enable editing"},
+    {.name = "init",     .db = 0, .readonly = 0, .callback = zf_init,     .help = "initialize an empty flist to enable editing"},
+    {.name = "ls",       .db = 1, .readonly = 1, .callback = zf_ls,       .help = "list the content of a directory"},
+    {.name = "find",     .db = 1, .readonly = 1, .callback = zf_find,     .help = "list full contents of files and directories"},
+    {.name = "stat",     .db = 1, .readonly = 1, .callback = zf_stat,     .help = "dump inode full metadata"},
+    {.name = "cat",      .db = 1, .readonly = 1, .callback = zf_cat,      .help = "print file contents (backend metadata required)"},
+    {.name = "get",      .db = 1, .readonly = 1, .callback = zf_get,      .help = "download remote file (backend metadata required)"},
+    {.name = "put",      .db = 1, .readonly = 0, .callback = zf_put,      .help = "insert local file into the flist"},
+    {.name = "putdir",   .db = 1, .readonly = 0, .callback = zf_putdir,   .help = "insert local directory into the flist (recursively)"},
+    {.name = "chmod",    .db = 1, .readonly = 0, .callback = zf_chmod,    .help = "change mode of a file (like chmod command)"},
+    {.name = "rm",       .db = 1, .readonly = 0, .callback = zf_rm,       .help = "remove a file (not a directory)"},
+    {.name = "rmdir",    .db = 1, .readonly = 0, .callback = zf_rmdir,    .help = "remove a directory (recursively)"},
+    {.name = "mkdir",    .db = 1, .readonly = 0, .callback = zf_mkdir,    .help = "create an empty directory (non-recursive)"},
+    {.name = "metadata", .db = 1, .readonly = 0, .callback = zf_metadata, .help = "get or set metadata"},
+    {.name = "merge",    .db = 1, .readonly = 0, .callback = zf_merge,    .help = "merge another flist into the current one"},
+    {.name = "check",    .db = 1, .readonly = 1, .callback = zf_check,    .help = "check archive integrity (chunks valid in the backed)"},
+    {.name = "chunks",   .db = 1, .readonly = 1, .callback = zf_chunks,   .help = "dumps chunks for all files"},
+    {.name = "debug",    .db = 1, .readonly = 0, .callback = zf_debug,    .help = "provide and apply some debug features"},
+    {.name = "prefetch", .db = 0, .readonly = 0, .callback = zf_prefetch, .help = "read directory contents to fill flist cache"},
+    {.name = "hub",      .db = 0, .readonly = 0, .callback = zf_hub,      .help = "0-hub command line tools"},
+    {.name = "commit",   .db = 0, .readonly = 0, .callback = zf_commit,   .help = "commit changes to a new flist"},
+    {.name = "close",    .db = 0, .readonly = 0, .callback = zf_close,    .help = "close mountpoint and discard files"},
+    {.name = "batch",    .db = 0, .readonly = 0, .callback = zf_batch,    .help = "run commands from a file (or stdin), one per line"},
+    {.name = "serve",    .db = 0, .readonly = 0, .callback = zf_serve,    .help = "serve json requests on a unix socket (daemon)"},
 };
 
+zf_cmds_t *zf_command_get(char *name) {
+    for(unsigned int i = 0; i < sizeof(zf_commands) / sizeof(zf_cmds_t); i++)
+        if(strcasecmp(zf_commands[i].name, name) == 0)
+            return &zf_commands[i];
+
+    return NULL;
+}
+
 int usage(char *basename) {
     fprintf(stderr, "Usage: %s [temporary-point] open <filename>\n", basename);
     fprintf(stderr, "       %s [temporary-point] <action> <arguments>\n", basename);
@@ -60,12 +70,60 @@ int usage(char *basename) {
     fprintf(stderr, "  get some progression reporting using ZFLIST_PROGRESS=1 environment variable.\n");
     fprintf(stderr, "  This works using JSON output aswell.\n");
     fprintf(stderr, "\n");
+    fprintf(stderr, "  Files chunks are processed in parallel, using all the available cores\n");
+    fprintf(stderr, "  by default, you can set the amount of workers using ZFLIST_WORKERS\n");
+    fprintf(stderr, "  environment variable (also used to compress the flist on commit).\n");
+    fprintf(stderr, "  Workspace database is opened with default settings, ZFLIST_DATABASE=build\n");
+    fprintf(stderr, "  speeds up large insertions (no journal, no sync) and ZFLIST_DATABASE=memory\n");
+    fprintf(stderr, "  works on an in-memory copy, saved on exit. Database is compacted on commit.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Flist is a tar.gz archive, set ZFLIST_ARCHIVE=zstd to commit a seekable\n");
+    fprintf(stderr, "  zstd archive instead (smaller, database readable without extraction).\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Files are downloaded using 8 chunks in parallel by default, you can\n");
+    fprintf(stderr, "  set this amount using ZFLIST_DOWNLOADS environment variable.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Files are splitted into fixed size chunks by default, you can use\n");
+    fprintf(stderr, "  content-defined chunks (better deduplication of modified files) by\n");
+    fprintf(stderr, "  setting ZFLIST_CHUNKING=cdc environment variable.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Files can be mapped in memory to be chunked (no copy, pages released\n");
+    fprintf(stderr, "  once processed) by setting ZFLIST_READER=mmap. Files must not be\n");
+    fprintf(stderr, "  truncated while being added in this mode.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Setting ZFLIST_INCREMENTAL=1 makes putdir reuse chunks of files already\n");
+    fprintf(stderr, "  on the flist with the same size and modification time, the destination\n");
+    fprintf(stderr, "  mirrors the source: existing entries are replaced, directories metadata\n");
+    fprintf(stderr, "  are refreshed and entries not found on the source anymore are removed.\n");
+    fprintf(stderr, "  Use ZFLIST_INCREMENTAL=strict to compare change time too.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Chunks are compressed with snappy and encrypted by default, you can use\n");
+    fprintf(stderr, "  ZFLIST_COMPRESSION=lz4, zstd (or zstd:level) or store, and disable encryption\n");
+    fprintf(stderr, "  with ZFLIST_ENCRYPTION=none. Older readers only support the default, any\n");
+    fprintf(stderr, "  other value is rejected.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Many edits can be applied at once with the -batch- action, commands are\n");
+    fprintf(stderr, "  read (one per line, or as json array) from a file or stdin and applied\n");
+    fprintf(stderr, "  with the database and backends kept open, one json result per command.\n");
+    fprintf(stderr, "  The -serve- action does the same for many workspaces, on a unix socket,\n");
+    fprintf(stderr, "  using ZFLIST_SERVE_WORKERS workers (clients served at the same time),\n");
+    fprintf(stderr, "  clients idle for ZFLIST_SERVE_IDLE seconds (60 by default) are dropped.\n");
+    fprintf(stderr, "\n");
     fprintf(stderr, "  First, you need to -open- an flist, then you can do some -edit-\n");
     fprintf(stderr, "  and finally you can -commit- (close) your changes to a new flist.\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "  If you want to upload chunks when inserting files, please set\n");
     fprintf(stderr, "  environment variable ZFLIST_BACKEND to a json backend formatted string,\n");
     fprintf(stderr, "  check backend documentation for more information\n");
+    fprintf(stderr, "  On a zero-db backend, you can set ZFLIST_SKIP_EXISTS=1 to upload chunks\n");
+    fprintf(stderr, "  without checking if they already exists (zero-db ignores duplicates).\n");
+    fprintf(stderr, "  Chunks known to be on the backend can be tracked between runs, by setting\n");
+    fprintf(stderr, "  ZFLIST_KNOWN_CHUNKS to a directory (index per backend). Known chunks are\n");
+    fprintf(stderr, "  not checked again, unless ZFLIST_KNOWN_POLICY=verify is set.\n");
+    fprintf(stderr, "  Setting ZFLIST_CHUNKS_MEMO to a file remembers encrypted chunks between\n");
+    fprintf(stderr, "  runs, unchanged chunks already on the backend are not encrypted again.\n");
+    fprintf(stderr, "  Downloaded chunks can be kept on a local cache directory, by setting\n");
+    fprintf(stderr, "  ZFLIST_CACHE (and ZFLIST_CACHE_SIZE, in bytes, 1 GB by default).\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "  To use the hub subsystem, you need to specify at least a jwt token\n");
     fprintf(stderr, "  via the environment variable ZFLIST_HUB_TOKEN, this jwt needs to be\n");
@@ -103,22 +161,33 @@ int zf_callback(zf_cmds_t *cmd, int argc, char *argv[], zfe_settings_t *settings
     if(progress && strcmp(progress, "1") == 0)
         cb.progress = 1;
 
-    // open database (if used)
-    if(cmd->db)
-        cb.ctx = zf_internal_init(settings->mnt);
+    // open database (if used), read-only when nothing is changed
+    if(cmd->db) {
+        if(!(cb.ctx = zf_internal_init(settings->mnt, cmd->readonly ? FLIST_DB_READONLY : zf_internal_db_profile()))) {
+            zf_error(&cb, cmd->name, "could not initialize workspace");
+
+            if(cb.jout)
+                zf_internal_json_finalize(&cb);
+
+            return 1;
+        }
+    }
 
     // call the callback
     debug("[+] system: callback found for command: %s\n", cmd->name);
     int value = cmd->callback(&cb);
 
+    // commit database (if used), before the response
+    // is written, saving changes can still fail
+    if(cmd->db && zf_internal_cleanup(cb.ctx)) {
+        zf_error(&cb, cmd->name, "could not save changes: %s", libflist_strerror());
+        value = 1;
+    }
+
     // dump json response if set
     if(cb.jout)
         zf_internal_json_finalize(&cb);
 
-    // commit database (if used)
-    if(cmd->db)
-        zf_internal_cleanup(cb.ctx);
-
     return value;
 }
 
@@ -160,11 +229,11 @@ int main(int argc, char *argv[]) {
 
     debug("[+] system: mountpoint: %s\n", settings.mnt);
 
-    // iterating over available commands and trigger callback
-    // for matching command
-    for(unsigned int i = 0; i < sizeof(zf_commands) / sizeof(zf_cmds_t); i++)
-        if(strcasecmp(zf_commands[i].name, action) == 0)
-            value = zf_callback(&zf_commands[i], nargc, nargv, &settings);
+    // looking for available command and trigger callback
+    zf_cmds_t *command;
+
+    if((command = zf_command_get(action)))
+        value = zf_callback(command, nargc, nargv, &settings);
 
     if(value == -1) {
         fprintf(stderr, "Unknown action '%s'\n", action);
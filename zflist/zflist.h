@@ -23,6 +23,11 @@
         char *user;          // 0-hub active user
         char *baseurl;       // 0-hub base url
 
+        int batch;                  // batch mode, backends kept between commands
+        flist_backend_t *upload;    // upload backend (batch mode)
+        flist_backend_t *download;  // public backend (batch mode)
+        size_t connections;         // public backend connections (batch mode)
+
     } zfe_settings_t;
 
     typedef struct zf_callback_t {
@@ -41,7 +46,10 @@
         int (*callback)(zf_callback_t *cb);
         char *help;  // help message
         int db;      // does the callback need the db
+        int readonly;  // callback doesn't change the db
 
     } zf_cmds_t;
 
+    zf_cmds_t *zf_command_get(char *name);
+
 #endif